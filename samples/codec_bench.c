@@ -0,0 +1,961 @@
+
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+/* Checks the library's table-driven codecs against copies of the
+   hand-written codecs they replaced, then times the two.
+
+   Each round encodes a random value with the reference encoder,
+   sometimes truncating, corrupting or extending the result, and
+   decodes it with both. They must agree on whether it decodes, on
+   how much of the input is used, and on what re-encoding the results
+   gives. Any disagreement is printed along with the input, and the
+   exit status is non-zero.
+
+   usage: codec_bench [rounds [seed]] */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <mw_common.h>
+#include <mw_message.h>
+
+
+#define DEFAULT_ROUNDS  100000
+
+
+/** encodings per type for the timing runs */
+#define BENCH_SET       1000
+
+
+/** passes over each set in the timing runs */
+#define BENCH_PASSES    200
+
+
+typedef void (*get_func)(struct mwGetBuffer *b, gpointer obj);
+typedef void (*put_func)(struct mwPutBuffer *b, gconstpointer obj);
+typedef void (*clear_func)(gpointer obj);
+typedef void (*fill_func)(GRand *r, gpointer obj);
+
+
+/* the hand-written codecs, as they were */
+
+
+static void ref_LoginInfo_put(struct mwPutBuffer *b,
+			      const struct mwLoginInfo *login) {
+
+  mwString_put(b, login->login_id);
+  guint16_put(b, login->type);
+  mwString_put(b, login->user_id);
+  mwString_put(b, login->user_name);
+  mwString_put(b, login->community);
+  gboolean_put(b, login->full);
+
+  if(login->full) {
+    mwString_put(b, login->desc);
+    guint32_put(b, login->ip_addr);
+    mwString_put(b, login->server_id);
+  }
+}
+
+
+static void ref_LoginInfo_get(struct mwGetBuffer *b,
+			      struct mwLoginInfo *login) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  mwString_get(b, &login->login_id);
+  guint16_get(b, &login->type);
+  mwString_get(b, &login->user_id);
+  mwString_get(b, &login->user_name);
+  mwString_get(b, &login->community);
+  gboolean_get(b, &login->full);
+
+  if(login->full) {
+    mwString_get(b, &login->desc);
+    guint32_get(b, &login->ip_addr);
+    mwString_get(b, &login->server_id);
+  }
+}
+
+
+static void ref_UserItem_put(struct mwPutBuffer *b,
+			     const struct mwUserItem *user) {
+
+  gboolean_put(b, user->full);
+  mwString_put(b, user->id);
+  mwString_put(b, user->community);
+
+  if(user->full)
+    mwString_put(b, user->name);
+}
+
+
+static void ref_UserItem_get(struct mwGetBuffer *b,
+			     struct mwUserItem *user) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  gboolean_get(b, &user->full);
+  mwString_get(b, &user->id);
+  mwString_get(b, &user->community);
+
+  if(user->full)
+    mwString_get(b, &user->name);
+}
+
+
+static void ref_UserStatus_put(struct mwPutBuffer *b,
+			       const struct mwUserStatus *stat) {
+
+  guint16_put(b, stat->status);
+  guint32_put(b, stat->time);
+  mwString_put(b, stat->desc);
+}
+
+
+static void ref_UserStatus_get(struct mwGetBuffer *b,
+			       struct mwUserStatus *stat) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  guint16_get(b, &stat->status);
+  guint32_get(b, &stat->time);
+  mwString_get(b, &stat->desc);
+
+  /* as the library does, for recent Sametime clients */
+  stat->time = 0;
+}
+
+
+static void ref_IdBlock_put(struct mwPutBuffer *b,
+			    const struct mwIdBlock *id) {
+
+  mwString_put(b, id->user);
+  mwString_put(b, id->community);
+}
+
+
+static void ref_IdBlock_get(struct mwGetBuffer *b, struct mwIdBlock *id) {
+  if(mwGetBuffer_error(b)) return;
+
+  mwString_get(b, &id->user);
+  mwString_get(b, &id->community);
+}
+
+
+static void ref_EncryptItem_put(struct mwPutBuffer *b,
+				const struct mwEncryptItem *ei) {
+
+  guint16_put(b, ei->id);
+  mwOpaque_put(b, &ei->info);
+}
+
+
+static void ref_EncryptItem_get(struct mwGetBuffer *b,
+				struct mwEncryptItem *ei) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  guint16_get(b, &ei->id);
+  mwOpaque_get(b, &ei->info);
+}
+
+
+static void ref_head_put(struct mwPutBuffer *b, struct mwMessage *msg) {
+  guint16_put(b, msg->type);
+  guint16_put(b, msg->options);
+  guint32_put(b, msg->channel);
+
+  if(msg->options & mwMessageOption_HAS_ATTRIBS)
+    mwOpaque_put(b, &msg->attribs);
+}
+
+
+static void ref_head_get(struct mwGetBuffer *b, struct mwMessage *msg) {
+  if(mwGetBuffer_error(b)) return;
+
+  guint16_get(b, &msg->type);
+  guint16_get(b, &msg->options);
+  guint32_get(b, &msg->channel);
+
+  if(msg->options & mwMessageOption_HAS_ATTRIBS)
+    mwOpaque_get(b, &msg->attribs);
+}
+
+
+static void ref_HANDSHAKE_put(struct mwPutBuffer *b,
+			      struct mwMsgHandshake *msg) {
+
+  guint16_put(b, msg->major);
+  guint16_put(b, msg->minor);
+  guint32_put(b, msg->head.channel);
+  guint32_put(b, msg->srvrcalc_addr);
+  guint16_put(b, msg->login_type);
+  guint32_put(b, msg->loclcalc_addr);
+
+  if(msg->major >= 0x001e && msg->minor >= 0x001d) {
+    guint16_put(b, msg->unknown_a);
+    guint32_put(b, msg->unknown_b);
+    mwString_put(b, msg->local_host);
+  }
+}
+
+
+static void ref_HANDSHAKE_get(struct mwGetBuffer *b,
+			      struct mwMsgHandshake *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  guint16_get(b, &msg->major);
+  guint16_get(b, &msg->minor);
+  guint32_get(b, &msg->head.channel);
+  guint32_get(b, &msg->srvrcalc_addr);
+  guint16_get(b, &msg->login_type);
+  guint32_get(b, &msg->loclcalc_addr);
+
+  if(msg->major >= 0x001e && msg->minor >= 0x001d) {
+    guint16_get(b, &msg->unknown_a);
+    guint32_get(b, &msg->unknown_b);
+    mwString_get(b, &msg->local_host);
+  }
+}
+
+
+static void ref_HANDSHAKE_ACK_put(struct mwPutBuffer *b,
+				  struct mwMsgHandshakeAck *msg) {
+
+  guint16_put(b, msg->major);
+  guint16_put(b, msg->minor);
+  guint32_put(b, msg->srvrcalc_addr);
+
+  if(msg->major >= 0x1e && msg->minor > 0x18) {
+    guint32_put(b, msg->magic);
+    mwOpaque_put(b, &msg->data);
+  }
+}
+
+
+static void ref_HANDSHAKE_ACK_get(struct mwGetBuffer *b,
+				  struct mwMsgHandshakeAck *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  guint16_get(b, &msg->major);
+  guint16_get(b, &msg->minor);
+  guint32_get(b, &msg->srvrcalc_addr);
+
+  if(msg->major >= 0x1e && msg->minor > 0x18) {
+    guint32_get(b, &msg->magic);
+    mwOpaque_get(b, &msg->data);
+  }
+}
+
+
+static void ref_LOGIN_REDIRECT_put(struct mwPutBuffer *b,
+				   struct mwMsgLoginRedirect *msg) {
+
+  mwString_put(b, msg->host);
+  mwString_put(b, msg->server_id);
+}
+
+
+static void ref_LOGIN_REDIRECT_get(struct mwGetBuffer *b,
+				   struct mwMsgLoginRedirect *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  mwString_get(b, &msg->host);
+  mwString_get(b, &msg->server_id);
+}
+
+
+static void ref_CHANNEL_SEND_put(struct mwPutBuffer *b,
+				 struct mwMsgChannelSend *msg) {
+
+  guint16_put(b, msg->type);
+  mwOpaque_put(b, &msg->data);
+}
+
+
+static void ref_CHANNEL_SEND_get(struct mwGetBuffer *b,
+				 struct mwMsgChannelSend *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  guint16_get(b, &msg->type);
+  mwOpaque_get(b, &msg->data);
+}
+
+
+static void ref_CHANNEL_DESTROY_put(struct mwPutBuffer *b,
+				    struct mwMsgChannelDestroy *msg) {
+
+  guint32_put(b, msg->reason);
+  mwOpaque_put(b, &msg->data);
+}
+
+
+static void ref_CHANNEL_DESTROY_get(struct mwGetBuffer *b,
+				    struct mwMsgChannelDestroy *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+
+  guint32_get(b, &msg->reason);
+  mwOpaque_get(b, &msg->data);
+}
+
+
+static void ref_SET_USER_STATUS_put(struct mwPutBuffer *b,
+				    struct mwMsgSetUserStatus *msg) {
+
+  ref_UserStatus_put(b, &msg->status);
+}
+
+
+static void ref_SET_USER_STATUS_get(struct mwGetBuffer *b,
+				    struct mwMsgSetUserStatus *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+  ref_UserStatus_get(b, &msg->status);
+}
+
+
+static void ref_SENSE_SERVICE_put(struct mwPutBuffer *b,
+				  struct mwMsgSenseService *msg) {
+
+  guint32_put(b, msg->service);
+}
+
+
+static void ref_SENSE_SERVICE_get(struct mwGetBuffer *b,
+				  struct mwMsgSenseService *msg) {
+
+  if(mwGetBuffer_error(b)) return;
+  guint32_get(b, &msg->service);
+}
+
+
+#define CASE(v, t) \
+case mwMessage_ ## v: \
+  ref_ ## v ## _put(b, (struct t *) msg); \
+  break;
+
+
+static void ref_message_put(struct mwPutBuffer *b, gconstpointer obj) {
+  struct mwMessage *msg = *(struct mwMessage **) obj;
+
+  ref_head_put(b, msg);
+
+  switch(msg->type) {
+    CASE(HANDSHAKE, mwMsgHandshake);
+    CASE(HANDSHAKE_ACK, mwMsgHandshakeAck);
+    CASE(LOGIN_REDIRECT, mwMsgLoginRedirect);
+    CASE(CHANNEL_SEND, mwMsgChannelSend);
+    CASE(CHANNEL_DESTROY, mwMsgChannelDestroy);
+    CASE(SET_USER_STATUS, mwMsgSetUserStatus);
+    CASE(SENSE_SERVICE, mwMsgSenseService);
+  default:
+    g_assert_not_reached();
+  }
+}
+
+
+#undef CASE
+
+
+#define CASE(v, t) \
+case mwMessage_ ## v: \
+  ref_ ## v ## _get(b, (struct t *) msg); \
+  break;
+
+
+static void ref_message_get(struct mwGetBuffer *b, gpointer obj) {
+  struct mwMessage head = { 0, 0, 0, { 0, NULL } };
+  struct mwMessage *msg;
+
+  ref_head_get(b, &head);
+  if(mwGetBuffer_error(b)) {
+    mwOpaque_clear(&head.attribs);
+    return;
+  }
+
+  msg = mwMessage_new(head.type);
+  if(! msg) {
+    mwOpaque_clear(&head.attribs);
+    return;
+  }
+
+  msg->options = head.options;
+  msg->channel = head.channel;
+  msg->attribs = head.attribs;
+
+  switch(head.type) {
+    CASE(HANDSHAKE, mwMsgHandshake);
+    CASE(HANDSHAKE_ACK, mwMsgHandshakeAck);
+    CASE(LOGIN_REDIRECT, mwMsgLoginRedirect);
+    CASE(CHANNEL_SEND, mwMsgChannelSend);
+    CASE(CHANNEL_DESTROY, mwMsgChannelDestroy);
+    CASE(SET_USER_STATUS, mwMsgSetUserStatus);
+    CASE(SENSE_SERVICE, mwMsgSenseService);
+  default:
+    ;
+  }
+
+  *(struct mwMessage **) obj = msg;
+}
+
+
+#undef CASE
+
+
+/* the library's message codec, shaped like the others */
+
+
+static void lib_message_get(struct mwGetBuffer *b, gpointer obj) {
+  *(struct mwMessage **) obj = mwMessage_get(b);
+}
+
+
+static void lib_message_put(struct mwPutBuffer *b, gconstpointer obj) {
+  mwMessage_put(b, *(struct mwMessage **) obj);
+}
+
+
+static void message_clear(gpointer obj) {
+  struct mwMessage **msg = obj;
+
+  if(*msg) mwMessage_free(*msg);
+  *msg = NULL;
+}
+
+
+/* random values */
+
+
+static char *rand_string(GRand *r) {
+  guint len, i;
+  char *str;
+
+  if(! g_rand_int_range(r, 0, 8)) return NULL;
+
+  len = g_rand_int_range(r, 0, 24);
+  str = g_malloc(len + 1);
+  for(i = 0; i < len; i++)
+    str[i] = (char) g_rand_int_range(r, 0x20, 0x7f);
+  str[len] = '\0';
+
+  return str;
+}
+
+
+static void rand_opaque(GRand *r, struct mwOpaque *o) {
+  gsize i;
+
+  o->len = g_rand_int_range(r, 0, 64);
+  o->data = o->len? g_malloc(o->len): NULL;
+  for(i = 0; i < o->len; i++)
+    o->data[i] = (guchar) g_rand_int(r);
+}
+
+
+/** a version number either side of where optional fields start */
+static guint16 rand_version(GRand *r) {
+  return (guint16) g_rand_int_range(r, 0x0016, 0x0020);
+}
+
+
+static void fill_LoginInfo(GRand *r, gpointer obj) {
+  struct mwLoginInfo *login = obj;
+
+  login->login_id = rand_string(r);
+  login->type = (guint16) g_rand_int(r);
+  login->user_id = rand_string(r);
+  login->user_name = rand_string(r);
+  login->community = rand_string(r);
+  login->full = g_rand_boolean(r);
+
+  if(login->full) {
+    login->desc = rand_string(r);
+    login->ip_addr = g_rand_int(r);
+    login->server_id = rand_string(r);
+  }
+}
+
+
+static void fill_UserItem(GRand *r, gpointer obj) {
+  struct mwUserItem *user = obj;
+
+  user->full = g_rand_boolean(r);
+  user->id = rand_string(r);
+  user->community = rand_string(r);
+  if(user->full) user->name = rand_string(r);
+}
+
+
+static void fill_UserStatus(GRand *r, gpointer obj) {
+  struct mwUserStatus *stat = obj;
+
+  stat->status = (guint16) g_rand_int(r);
+  stat->time = g_rand_int(r);
+  stat->desc = rand_string(r);
+}
+
+
+static void fill_IdBlock(GRand *r, gpointer obj) {
+  struct mwIdBlock *id = obj;
+
+  id->user = rand_string(r);
+  id->community = rand_string(r);
+}
+
+
+static void fill_EncryptItem(GRand *r, gpointer obj) {
+  struct mwEncryptItem *ei = obj;
+
+  ei->id = (guint16) g_rand_int(r);
+  rand_opaque(r, &ei->info);
+}
+
+
+static const enum mwMessageType message_types[] = {
+  mwMessage_HANDSHAKE,
+  mwMessage_HANDSHAKE_ACK,
+  mwMessage_LOGIN_REDIRECT,
+  mwMessage_CHANNEL_SEND,
+  mwMessage_CHANNEL_DESTROY,
+  mwMessage_SET_USER_STATUS,
+  mwMessage_SENSE_SERVICE,
+};
+
+
+/** whether an encoded message is of a type the reference codecs
+    cover, as corrupting its head may have changed the type */
+static gboolean message_covered(const struct mwOpaque *in) {
+  guint16 type;
+  guint i;
+
+  if(in->len < 2) return TRUE;
+  type = (in->data[0] << 8) | in->data[1];
+
+  for(i = 0; i < G_N_ELEMENTS(message_types); i++)
+    if(message_types[i] == type) return TRUE;
+
+  return FALSE;
+}
+
+
+static void fill_message(GRand *r, gpointer obj) {
+  guint i = g_rand_int_range(r, 0, G_N_ELEMENTS(message_types));
+  struct mwMessage *msg = mwMessage_new(message_types[i]);
+
+  if(g_rand_boolean(r)) {
+    msg->options = mwMessageOption_HAS_ATTRIBS;
+    rand_opaque(r, &msg->attribs);
+  }
+  msg->channel = g_rand_int(r);
+
+  switch(msg->type) {
+  case mwMessage_HANDSHAKE: {
+    struct mwMsgHandshake *m = (struct mwMsgHandshake *) msg;
+    m->major = rand_version(r);
+    m->minor = rand_version(r);
+    m->srvrcalc_addr = g_rand_int(r);
+    m->login_type = (guint16) g_rand_int(r);
+    m->loclcalc_addr = g_rand_int(r);
+    m->unknown_a = (guint16) g_rand_int(r);
+    m->unknown_b = g_rand_int(r);
+    m->local_host = rand_string(r);
+    break;
+  }
+
+  case mwMessage_HANDSHAKE_ACK: {
+    struct mwMsgHandshakeAck *m = (struct mwMsgHandshakeAck *) msg;
+    m->major = rand_version(r);
+    m->minor = rand_version(r);
+    m->srvrcalc_addr = g_rand_int(r);
+    m->magic = g_rand_int(r);
+    rand_opaque(r, &m->data);
+    break;
+  }
+
+  case mwMessage_LOGIN_REDIRECT: {
+    struct mwMsgLoginRedirect *m = (struct mwMsgLoginRedirect *) msg;
+    m->host = rand_string(r);
+    m->server_id = rand_string(r);
+    break;
+  }
+
+  case mwMessage_CHANNEL_SEND: {
+    struct mwMsgChannelSend *m = (struct mwMsgChannelSend *) msg;
+    m->type = (guint16) g_rand_int(r);
+    rand_opaque(r, &m->data);
+    break;
+  }
+
+  case mwMessage_CHANNEL_DESTROY: {
+    struct mwMsgChannelDestroy *m = (struct mwMsgChannelDestroy *) msg;
+    m->reason = g_rand_int(r);
+    rand_opaque(r, &m->data);
+    break;
+  }
+
+  case mwMessage_SET_USER_STATUS: {
+    struct mwMsgSetUserStatus *m = (struct mwMsgSetUserStatus *) msg;
+    fill_UserStatus(r, &m->status);
+    break;
+  }
+
+  case mwMessage_SENSE_SERVICE: {
+    struct mwMsgSenseService *m = (struct mwMsgSenseService *) msg;
+    m->service = g_rand_int(r);
+    break;
+  }
+
+  default:
+    ;
+  }
+
+  *(struct mwMessage **) obj = msg;
+}
+
+
+/** a type as decoded and encoded by the library and by the reference
+    codecs */
+struct codec_case {
+  const char *name;
+  gsize size;
+  fill_func fill;
+  get_func lib_get;
+  put_func lib_put;
+  get_func ref_get;
+  put_func ref_put;
+  clear_func clear;
+
+  /** optional. FALSE for input the reference codecs don't cover */
+  gboolean (*covered)(const struct mwOpaque *in);
+};
+
+
+#define TYPE_CASE(t) \
+  { #t, sizeof(struct mw ## t), fill_ ## t, \
+    (get_func) mw ## t ## _get, (put_func) mw ## t ## _put, \
+    (get_func) ref_ ## t ## _get, (put_func) ref_ ## t ## _put, \
+    (clear_func) mw ## t ## _clear, NULL }
+
+
+static const struct codec_case cases[] = {
+  TYPE_CASE(LoginInfo),
+  TYPE_CASE(UserItem),
+  TYPE_CASE(UserStatus),
+  TYPE_CASE(IdBlock),
+  TYPE_CASE(EncryptItem),
+  { "Message", sizeof(struct mwMessage *), fill_message,
+    lib_message_get, lib_message_put,
+    ref_message_get, ref_message_put,
+    message_clear, message_covered },
+};
+
+
+#undef TYPE_CASE
+
+
+/** a random value of the case's type, encoded by the reference
+    encoder */
+static void encode_random(GRand *r, const struct codec_case *c,
+			  struct mwOpaque *to) {
+
+  gpointer obj = g_malloc0(c->size);
+  struct mwPutBuffer *b = mwPutBuffer_new();
+
+  c->fill(r, obj);
+  c->ref_put(b, obj);
+  mwPutBuffer_finalize(to, b);
+
+  c->clear(obj);
+  g_free(obj);
+}
+
+
+/** leave the encoding as it is half the time, otherwise truncate it,
+    corrupt a few bytes, or add junk to the end */
+static void mutate(GRand *r, struct mwOpaque *o) {
+  guint i, n;
+
+  switch(g_rand_int_range(r, 0, 6)) {
+  case 0:
+    o->len = o->len? g_rand_int_range(r, 0, o->len): 0;
+    break;
+
+  case 1:
+    n = g_rand_int_range(r, 1, 4);
+    for(i = 0; o->len && i < n; i++)
+      o->data[g_rand_int_range(r, 0, o->len)] = (guchar) g_rand_int(r);
+    break;
+
+  case 2:
+    n = g_rand_int_range(r, 1, 16);
+    o->data = g_realloc(o->data, o->len + n);
+    for(i = 0; i < n; i++)
+      o->data[o->len++] = (guchar) g_rand_int(r);
+    break;
+
+  default:
+    ;
+  }
+}
+
+
+struct decoded {
+  gpointer obj;
+  gboolean error;
+  gsize remaining;
+};
+
+
+static void decode(get_func get, const struct codec_case *c,
+		   const struct mwOpaque *in, struct decoded *out) {
+
+  struct mwGetBuffer *b = mwGetBuffer_wrap(in);
+
+  out->obj = g_malloc0(c->size);
+  get(b, out->obj);
+  out->error = mwGetBuffer_error(b);
+  out->remaining = mwGetBuffer_remaining(b);
+
+  mwGetBuffer_free(b);
+}
+
+
+static void decoded_free(const struct codec_case *c, struct decoded *d) {
+  c->clear(d->obj);
+  g_free(d->obj);
+}
+
+
+static gboolean encode_same(put_func a, gconstpointer a_obj,
+			    put_func b, gconstpointer b_obj) {
+
+  struct mwPutBuffer *pa = mwPutBuffer_new();
+  struct mwPutBuffer *pb = mwPutBuffer_new();
+  struct mwOpaque oa, ob;
+  gboolean same;
+
+  a(pa, a_obj);
+  b(pb, b_obj);
+  mwPutBuffer_finalize(&oa, pa);
+  mwPutBuffer_finalize(&ob, pb);
+
+  same = oa.len == ob.len && ! memcmp(oa.data, ob.data, oa.len);
+
+  mwOpaque_clear(&oa);
+  mwOpaque_clear(&ob);
+  return same;
+}
+
+
+static void dump(const struct mwOpaque *o) {
+  gsize i;
+
+  for(i = 0; i < o->len; i++)
+    printf("%02x%s", o->data[i], (i % 16 == 15)? "\n": " ");
+  if(o->len % 16) printf("\n");
+}
+
+
+/** decode the input both ways and compare. @returns NULL if they
+    agree, or what they disagreed on */
+static const char *compare(const struct codec_case *c,
+			   const struct mwOpaque *in) {
+
+  struct decoded lib, ref;
+  const char *diff = NULL;
+
+  decode(c->lib_get, c, in, &lib);
+  decode(c->ref_get, c, in, &ref);
+
+  if(lib.error != ref.error) {
+    diff = "decode error";
+
+  } else if(lib.error) {
+    ; /* partial values aren't compared */
+
+  } else if(lib.remaining != ref.remaining) {
+    diff = "bytes consumed";
+
+  } else if(! encode_same(c->ref_put, lib.obj, c->ref_put, ref.obj)) {
+    diff = "decoded value";
+
+  } else if(! encode_same(c->lib_put, lib.obj, c->ref_put, lib.obj)) {
+    diff = "encoding";
+  }
+
+  decoded_free(c, &lib);
+  decoded_free(c, &ref);
+
+  return diff;
+}
+
+
+static guint fuzz(GRand *r, guint rounds) {
+  guint i, failed = 0;
+
+  for(i = 0; i < rounds; i++) {
+    const struct codec_case *c;
+    struct mwOpaque in;
+    const char *diff;
+
+    c = cases + g_rand_int_range(r, 0, G_N_ELEMENTS(cases));
+
+    encode_random(r, c, &in);
+    mutate(r, &in);
+
+    diff = (c->covered && ! c->covered(&in))? NULL: compare(c, &in);
+    if(diff && failed++ < 10) {
+      printf("%s: %s differs for input of %u bytes:\n",
+	     c->name, diff, (guint) in.len);
+      dump(&in);
+    }
+
+    mwOpaque_clear(&in);
+  }
+
+  return failed;
+}
+
+
+/** nanoseconds per decode of each of the set */
+static double time_get(get_func get, const struct codec_case *c,
+		       struct mwOpaque *set) {
+
+  gpointer obj = g_malloc0(c->size);
+  gint64 start = g_get_monotonic_time();
+  guint i, j;
+
+  for(i = 0; i < BENCH_PASSES; i++) {
+    for(j = 0; j < BENCH_SET; j++) {
+      struct mwGetBuffer *b = mwGetBuffer_wrap(set + j);
+      get(b, obj);
+      mwGetBuffer_free(b);
+      c->clear(obj);
+    }
+  }
+
+  g_free(obj);
+  return (g_get_monotonic_time() - start) * 1000.0
+    / (BENCH_PASSES * BENCH_SET);
+}
+
+
+/** nanoseconds per encode of each of the values */
+static double time_put(put_func put, const struct codec_case *c,
+		       gpointer values) {
+
+  gint64 start = g_get_monotonic_time();
+  guint i, j;
+
+  for(i = 0; i < BENCH_PASSES; i++) {
+    for(j = 0; j < BENCH_SET; j++) {
+      struct mwPutBuffer *b = mwPutBuffer_new();
+      put(b, (guchar *) values + j * c->size);
+      mwPutBuffer_free(b);
+    }
+  }
+
+  return (g_get_monotonic_time() - start) * 1000.0
+    / (BENCH_PASSES * BENCH_SET);
+}
+
+
+static void bench(GRand *r, const struct codec_case *c) {
+  struct mwOpaque *set = g_new0(struct mwOpaque, BENCH_SET);
+  guchar *values = g_malloc0(c->size * BENCH_SET);
+  double lib_get, ref_get, lib_put, ref_put;
+  guint i;
+
+  for(i = 0; i < BENCH_SET; i++) {
+    struct mwPutBuffer *b = mwPutBuffer_new();
+    gpointer obj = values + i * c->size;
+
+    c->fill(r, obj);
+    c->ref_put(b, obj);
+    mwPutBuffer_finalize(set + i, b);
+  }
+
+  lib_get = time_get(c->lib_get, c, set);
+  ref_get = time_get(c->ref_get, c, set);
+  lib_put = time_put(c->lib_put, c, values);
+  ref_put = time_put(c->ref_put, c, values);
+
+  printf("%-12s get %7.1f ns (ref %7.1f)   put %7.1f ns (ref %7.1f)\n",
+	 c->name, lib_get, ref_get, lib_put, ref_put);
+
+  for(i = 0; i < BENCH_SET; i++) {
+    mwOpaque_clear(set + i);
+    c->clear(values + i * c->size);
+  }
+
+  g_free(set);
+  g_free(values);
+}
+
+
+static void quiet(const gchar *domain, GLogLevelFlags flags,
+		  const gchar *msg, gpointer data) {
+
+  // `domain`, `flags`, `msg` and `data` unused
+  (void)domain;
+  (void)flags;
+  (void)msg;
+  (void)data;
+}
+
+
+int main(int argc, char *argv[]) {
+  guint rounds = DEFAULT_ROUNDS, failed, i;
+  guint32 seed;
+  GRand *r;
+
+  if(argc > 1) rounds = (guint) strtoul(argv[1], NULL, 0);
+  seed = (argc > 2)? (guint32) strtoul(argv[2], NULL, 0):
+    (guint32) g_get_monotonic_time();
+
+  /* malformed input is expected, and the library warns of each */
+  g_log_set_handler("meanwhile",
+		    G_LOG_LEVEL_WARNING | G_LOG_LEVEL_MESSAGE |
+		    G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG, quiet, NULL);
+
+  r = g_rand_new_with_seed(seed);
+
+  printf("fuzzing %u rounds, seed %u\n", rounds, seed);
+  failed = fuzz(r, rounds);
+  printf("%u of %u rounds differed\n\n", failed, rounds);
+
+  for(i = 0; i < G_N_ELEMENTS(cases); i++)
+    bench(r, cases + i);
+
+  g_rand_free(r);
+  return failed? 1: 0;
+}
+
@@ -28,6 +28,7 @@
 #include "mw_message.h"
 #include "mw_service.h"
 #include "mw_session.h"
+#include "mw_timer.h"
 #include "mw_util.h"
 
 
@@ -48,6 +49,12 @@ struct mwChannel {
   guint32 reserved;    /**< special, unknown meaning */
   guint32 id;          /**< channel ID */
   guint32 service;     /**< service ID */
+
+  /** the session's service for the service ID, looked up once and
+      then kept, so that incoming data is dispatched without a search
+      of the session. NULL if not yet known */
+  struct mwService *srvc;
+
   guint32 proto_type;  /**< service protocol type */
   guint32 proto_ver;   /**< service protocol version */
   guint32 options;     /**< channel options */
@@ -63,26 +70,94 @@ struct mwChannel {
   /** cipher information determined at channel acceptance */
   struct mwCipherInstance *cipher;
 
-  /** statistics table */
-  GHashTable *stats;
+  /** statistics counters */
+  struct mwChannelStats stats;
+
+  GQueue outgoing_queue;      /**< queued outgoing messages */
+  GQueue incoming_queue;      /**< queued incoming messages */
+
+  gsize queued_bytes;  /**< data bytes held in both queues */
+  gsize queue_limit;   /**< limit on queued_bytes, or zero */
 
-  GSList *outgoing_queue;     /**< queued outgoing messages */
-  GSList *incoming_queue;     /**< queued incoming messages */
+  /** TRUE if a send has been refused for being over a queue limit,
+      and the service has yet to be told that the queue drained */
+  gboolean blocked;
+
+  /** sum of the g_get_monotonic_time at which each message currently
+      in either queue was queued, and the earliest of them. Together
+      with the queue lengths, these give queueing latency on flush */
+  gint64 queued_sum;
+  gint64 queued_first;
+  guint queued_count;
 
   struct mw_datum srvc_data;  /**< service-specific data */
+
+  /** pending while an outgoing channel is in WAIT, if the set has an
+      accept timeout */
+  struct mwTimer accept_timer;
+
+  /** next unused channel in the owning set's free list */
+  struct mwChannel *next_free;
+};
+
+
+/** channels are allocated by their set this many at a time */
+#define CHANNEL_SLAB_SIZE  32
+
+
+/** starting size of a channel set's table, as a power of two */
+#define CHANNEL_TABLE_BITS  5
+
+
+/** a block of channel structures, owned by a channel set */
+struct channel_slab {
+  struct channel_slab *next;
+  struct mwChannel chans[CHANNEL_SLAB_SIZE];
 };
 
 
 struct mwChannelSet {
   struct mwSession *session;  /**< owning session */
-  GHashTable *map;            /**< map of all channels, by ID */
+
+  /** open-addressed table of all channels, by ID. Its size is a
+      power of two, and it is kept no more than half full */
+  struct mwChannel **table;
+  guint32 table_bits;         /**< log2 of the table size */
+  guint32 count;              /**< count of channels in the table */
+
+  struct channel_slab *slabs;     /**< every slab allocated by the set */
+  struct mwChannel *free_chans;   /**< unused channels from the slabs */
+
   guint32 counter;            /**< counter for outgoing ID */
+
+  gsize queued_bytes;  /**< data bytes queued across all channels */
+  gsize queue_limit;   /**< limit on queued_bytes, or zero */
+
+  /** TRUE if any channel was refused a send due to queue_limit */
+  gboolean blocked;
+
+  /** milliseconds an outgoing channel may WAIT to be accepted, or
+      zero to wait indefinitely */
+  guint accept_timeout;
 };
 
 
+/** Fibonacci hash of a channel ID into a table slot. Both outgoing
+    and incoming IDs tend to be sequential, which this spreads evenly
+    so that nearly every lookup lands on the first probe */
+#define CHANNEL_SLOT(cs, id) \
+  ((guint32) ((id) * 0x9e3779b9U) >> (32 - (cs)->table_bits))
+
+
+#define CHANNEL_TABLE_SIZE(cs)  (1U << (cs)->table_bits)
+
+
 static void flush_channel(struct mwChannel *);
 
 
+static void notify_drained(struct mwChannelSet *);
+
+
 static const char *state_str(enum mwChannelState state) {
   switch(state) {
   case mwChannel_NEW:      return "new";
@@ -107,6 +182,14 @@ static void state(struct mwChannel *chan, enum mwChannelState state,
 
   chan->state = state;
 
+  MW_TRACE(channel_state, chan, state, err_code, mwTrace_now());
+
+  if(state != mwChannel_WAIT)
+    mwTimer_cancel(&chan->accept_timer);
+
+  if(state == mwChannel_DESTROY || state == mwChannel_ERROR)
+    chan->stats.closed_at = time(NULL);
+
   if(err_code) {
     g_message("channel 0x%08x state: %s (0x%08x)",
 	      chan->id, state_str(state), err_code);
@@ -116,26 +199,32 @@ static void state(struct mwChannel *chan, enum mwChannelState state,
 }
 
 
-static gpointer get_stat(struct mwChannel *chan,
-			 enum mwChannelStatField field) {
+static void stat_queued(struct mwChannel *chan) {
+  gint64 now = g_get_monotonic_time();
 
-  return g_hash_table_lookup(chan->stats, (gpointer) field);
+  if(! chan->queued_count++) chan->queued_first = now;
+  chan->queued_sum += now;
+  chan->stats.queued++;
 }
 
 
-static void set_stat(struct mwChannel *chan, enum mwChannelStatField field,
-		     gpointer val) {
-
-  g_hash_table_insert(chan->stats, (gpointer) field, val);
-}
+/** account for every queued message having just been flushed */
+static void stat_flushed(struct mwChannel *chan) {
+  struct mwChannelStats *stats = &chan->stats;
+  gint64 now = g_get_monotonic_time();
+  guint64 oldest;
 
+  if(! chan->queued_count) return;
 
-#define incr_stat(chan, field, incr) \
-  set_stat(chan, field, get_stat(chan, field) + incr)
+  stats->queue_usec += (now * chan->queued_count) - chan->queued_sum;
 
+  oldest = now - chan->queued_first;
+  if(oldest > stats->queue_max_usec) stats->queue_max_usec = oldest;
 
-#define timestamp_stat(chan, field) \
-  set_stat(chan, field, (gpointer) time(NULL))
+  chan->queued_sum = 0;
+  chan->queued_first = 0;
+  chan->queued_count = 0;
+}
 
 
 static void sup_free(gpointer a) {
@@ -147,6 +236,8 @@ static struct mwCipherInstance *
 get_supported(struct mwChannel *chan, guint16 id) {
 
   guint32 cid = (guint32) id;
+
+  if(! chan->supported) return NULL;
   return g_hash_table_lookup(chan->supported, GUINT_TO_POINTER(cid));
 }
 
@@ -156,27 +247,142 @@ static void put_supported(struct mwChannel *chan,
 
   struct mwCipher *cipher = mwCipherInstance_getCipher(ci);
   guint32 cid = (guint32) mwCipher_getType(cipher);
+
+  if(! chan->supported)
+    chan->supported = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					    NULL, sup_free);
+
   g_hash_table_insert(chan->supported, GUINT_TO_POINTER(cid), ci);
 }
 
 
+static struct mwChannel *channel_alloc(struct mwChannelSet *cs) {
+  struct mwChannel *chan;
+
+  if(! cs->free_chans) {
+    struct channel_slab *slab = g_new0(struct channel_slab, 1);
+    int i;
+
+    slab->next = cs->slabs;
+    cs->slabs = slab;
+
+    for(i = CHANNEL_SLAB_SIZE; i--; ) {
+      slab->chans[i].next_free = cs->free_chans;
+      cs->free_chans = slab->chans + i;
+    }
+  }
+
+  chan = cs->free_chans;
+  cs->free_chans = chan->next_free;
+
+  memset(chan, 0x00, sizeof(struct mwChannel));
+  return chan;
+}
+
+
+static void channel_release(struct mwChannelSet *cs,
+			    struct mwChannel *chan) {
+
+  chan->next_free = cs->free_chans;
+  cs->free_chans = chan;
+}
+
+
+static struct mwChannel *table_find(struct mwChannelSet *cs, guint32 id) {
+  guint32 mask = CHANNEL_TABLE_SIZE(cs) - 1;
+  guint32 i = CHANNEL_SLOT(cs, id);
+  struct mwChannel *chan;
+
+  while( (chan = cs->table[i]) ) {
+    if(chan->id == id) return chan;
+    i = (i + 1) & mask;
+  }
+
+  return NULL;
+}
+
+
+static void table_put(struct mwChannelSet *cs, struct mwChannel *chan) {
+  guint32 mask = CHANNEL_TABLE_SIZE(cs) - 1;
+  guint32 i = CHANNEL_SLOT(cs, chan->id);
+
+  while(cs->table[i])
+    i = (i + 1) & mask;
+
+  cs->table[i] = chan;
+}
+
+
+static void table_grow(struct mwChannelSet *cs) {
+  struct mwChannel **old = cs->table;
+  guint32 i, old_size = CHANNEL_TABLE_SIZE(cs);
+
+  cs->table_bits++;
+  cs->table = g_new0(struct mwChannel *, CHANNEL_TABLE_SIZE(cs));
+
+  for(i = 0; i < old_size; i++) {
+    if(old[i]) table_put(cs, old[i]);
+  }
+
+  g_free(old);
+}
+
+
+static void table_insert(struct mwChannelSet *cs, struct mwChannel *chan) {
+  if((cs->count + 1) * 2 > CHANNEL_TABLE_SIZE(cs))
+    table_grow(cs);
+
+  table_put(cs, chan);
+  cs->count++;
+}
+
+
+/** remove a channel from the table by ID, shifting back any later
+    entries in the same probe run so that no tombstones are needed */
+static struct mwChannel *table_remove(struct mwChannelSet *cs, guint32 id) {
+  guint32 mask = CHANNEL_TABLE_SIZE(cs) - 1;
+  guint32 i = CHANNEL_SLOT(cs, id), j, k;
+  struct mwChannel *chan;
+
+  while( (chan = cs->table[i]) ) {
+    if(chan->id == id) break;
+    i = (i + 1) & mask;
+  }
+
+  if(! chan) return NULL;
+
+  for(j = i; ; ) {
+    j = (j + 1) & mask;
+    if(! cs->table[j]) break;
+
+    /* k is where the entry at j would rather be. If that's not
+       cyclically within (i, j], it can fill the hole at i */
+    k = CHANNEL_SLOT(cs, cs->table[j]->id);
+    if( (i <= j)? (k <= i || k > j): (k <= i && k > j) ) {
+      cs->table[i] = cs->table[j];
+      i = j;
+    }
+  }
+
+  cs->table[i] = NULL;
+  cs->count--;
+
+  return chan;
+}
+
+
 struct mwChannel *mwChannel_newIncoming(struct mwChannelSet *cs, guint32 id) {
   struct mwChannel *chan;
 
   g_return_val_if_fail(cs != NULL, NULL);
   g_return_val_if_fail(cs->session != NULL, NULL);
 
-  chan = g_new0(struct mwChannel, 1);
+  chan = channel_alloc(cs);
   chan->state = mwChannel_NEW;
   chan->session = cs->session;
   chan->id = id;
 
-  chan->stats = g_hash_table_new(g_direct_hash, g_direct_equal);
-
-  chan->supported = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-					  NULL, sup_free);
-
-  g_hash_table_insert(cs->map, GUINT_TO_POINTER(id), chan);
+  table_insert(cs, chan);
 
   state(chan, mwChannel_WAIT, 0);
 
@@ -189,13 +395,13 @@ struct mwChannel *mwChannel_newOutgoing(struct mwChannelSet *cs) {
   struct mwChannel *chan;
 
   g_return_val_if_fail(cs != NULL, NULL);
-  g_return_val_if_fail(cs->map != NULL, NULL);
+  g_return_val_if_fail(cs->table != NULL, NULL);
 
   /* grab the next id, and try to make sure there isn't already a
      channel using it */
   do {
     id = ++cs->counter;
-  } while(g_hash_table_lookup(cs->map, GUINT_TO_POINTER(id)));
+  } while(table_find(cs, id));
   
   chan = mwChannel_newIncoming(cs, id);
   state(chan, mwChannel_INIT, 0);
@@ -224,7 +430,11 @@ guint32 mwChannel_getServiceId(struct mwChannel *chan) {
 
 struct mwService *mwChannel_getService(struct mwChannel *chan) {
   g_return_val_if_fail(chan != NULL, NULL);
-  return mwSession_getService(chan->session, chan->service);
+
+  if(! chan->srvc)
+    chan->srvc = mwSession_getService(chan->session, chan->service);
+
+  return chan->srvc;
 }
 
 
@@ -233,6 +443,7 @@ void mwChannel_setService(struct mwChannel *chan, struct mwService *srvc) {
   g_return_if_fail(srvc != NULL);
   g_return_if_fail(chan->state == mwChannel_INIT);
   chan->service = mwService_getType(srvc);
+  chan->srvc = srvc;
 }
 
 
@@ -335,11 +546,77 @@ enum mwChannelState mwChannel_getState(struct mwChannel *chan) {
 
 gpointer mwChannel_getStatistic(struct mwChannel *chan,
 				enum mwChannelStatField stat) {
-  
+
+  struct mwChannelStats *stats;
+
   g_return_val_if_fail(chan != NULL, 0);
-  g_return_val_if_fail(chan->stats != NULL, 0);
+  stats = &chan->stats;
+
+  switch(stat) {
+  case mwChannelStat_MSG_SENT:
+    return GUINT_TO_POINTER((guint) stats->msg_sent);
+  case mwChannelStat_MSG_RECV:
+    return GUINT_TO_POINTER((guint) stats->msg_recv);
+  case mwChannelStat_U_BYTES_SENT:
+    return GUINT_TO_POINTER((guint) stats->u_bytes_sent);
+  case mwChannelStat_U_BYTES_RECV:
+    return GUINT_TO_POINTER((guint) stats->u_bytes_recv);
+  case mwChannelStat_OPENED_AT:
+    return GSIZE_TO_POINTER((gsize) stats->opened_at);
+  case mwChannelStat_CLOSED_AT:
+    return GSIZE_TO_POINTER((gsize) stats->closed_at);
+  default:
+    return NULL;
+  }
+}
+
 
-  return get_stat(chan, stat);
+void mwChannel_getStatistics(struct mwChannel *chan,
+			     struct mwChannelStats *out) {
+
+  g_return_if_fail(chan != NULL);
+  g_return_if_fail(out != NULL);
+
+  *out = chan->stats;
+}
+
+
+/** the server never answered our create. Treat it as though the server
+    had destroyed the channel, so the service stops waiting on it */
+static void accept_timeout(struct mwTimer *timer, gpointer data) {
+  struct mwChannel *chan = data;
+  struct mwMsgChannelDestroy *msg;
+  struct mwService *srvc;
+
+  // `timer` unused
+  (void)timer;
+
+  g_message("channel 0x%08x not accepted in time", chan->id);
+
+  msg = (struct mwMsgChannelDestroy *)
+    mwMessage_new(mwMessage_CHANNEL_DESTROY);
+  msg->head.channel = chan->id;
+  msg->reason = CONNECTION_TIMED;
+
+  state(chan, mwChannel_ERROR, CONNECTION_TIMED);
+
+  srvc = mwChannel_getService(chan);
+  if(srvc) mwService_recvDestroy(srvc, chan, msg);
+  mwMessage_free(MW_MESSAGE(msg));
+
+  /* let the server know too, in case it does eventually accept */
+  mwChannel_destroy(chan, CONNECTION_TIMED, NULL);
+}
+
+
+static void accept_timer_start(struct mwChannel *chan) {
+  struct mwChannelSet *cs = mwSession_getChannels(chan->session);
+  struct mwTimerWheel *wheel = mwSession_getTimerWheel(chan->session);
+
+  if(! wheel || ! cs->accept_timeout) return;
+
+  mwTimer_init(&chan->accept_timer, accept_timeout, chan);
+  mwTimer_schedule(&chan->accept_timer, wheel, cs->accept_timeout);
 }
 
 
@@ -390,13 +667,15 @@ int mwChannel_create(struct mwChannel *chan) {
 
   state(chan, (ret)? mwChannel_ERROR: mwChannel_WAIT, ret);
 
+  if(! ret) accept_timer_start(chan);
+
   return ret;
 }
 
 
 static void channel_open(struct mwChannel *chan) {
   state(chan, mwChannel_OPEN, 0);
-  timestamp_stat(chan, mwChannelStat_OPENED_AT);
+  chan->stats.opened_at = time(NULL);
   flush_channel(chan);
 }
 
@@ -490,16 +769,12 @@ int mwChannel_accept(struct mwChannel *chan) {
 }
 
 
-static void channel_free(struct mwChannel *chan) {
-  struct mwSession *s;
+static void channel_free(struct mwChannelSet *cs, struct mwChannel *chan) {
   struct mwMessage *msg;
-  GSList *l;
 
   /* maybe no warning in the future */
   g_return_if_fail(chan != NULL);
 
-  s = chan->session;
-
   mwLoginInfo_clear(&chan->user);
   mwOpaque_clear(&chan->addtl_create);
   mwOpaque_clear(&chan->addtl_accept);
@@ -509,30 +784,36 @@ static void channel_free(struct mwChannel *chan) {
     chan->supported = NULL;
   }
 
-  if(chan->stats) {
-    g_hash_table_destroy(chan->stats);
-    chan->stats = NULL;
-  }
-  
   mwCipherInstance_free(chan->cipher);
 
   /* clean up the outgoing queue */
-  for(l = chan->outgoing_queue; l; l = l->next) {
-    msg = (struct mwMessage *) l->data;
-    l->data = NULL;
+  while( (msg = g_queue_pop_head(&chan->outgoing_queue)) )
     mwMessage_free(msg);
-  }
-  g_slist_free(chan->outgoing_queue);
 
   /* clean up the incoming queue */
-  for(l = chan->incoming_queue; l; l = l->next) {
-    msg = (struct mwMessage *) l->data;
-    l->data = NULL;
+  while( (msg = g_queue_pop_head(&chan->incoming_queue)) )
     mwMessage_free(msg);
-  }
-  g_slist_free(chan->incoming_queue);
 
-  g_free(chan);
+  cs->queued_bytes -= chan->queued_bytes;
+  chan->queued_bytes = 0;
+
+  mwTimer_cancel(&chan->accept_timer);
+
+  channel_release(cs, chan);
+}
+
+
+/** remove a channel from its set, and free it */
+static void channel_remove(struct mwChannelSet *cs, struct mwChannel *chan) {
+  gboolean had_queue = chan->queued_bytes > 0;
+
+  if(table_remove(cs, chan->id) != chan)
+    return;
+
+  channel_free(cs, chan);
+
+  /* whatever it had queued no longer counts against the session */
+  if(had_queue) notify_drained(cs);
 }
 
 
@@ -563,7 +844,7 @@ int mwChannel_destroy(struct mwChannel *chan,
   if(info) mwOpaque_clone(&msg->data, info);
 
   /* remove the channel from the channel set */
-  g_hash_table_remove(cs->map, GUINT_TO_POINTER(chan->id));
+  channel_remove(cs, chan);
   
   /* send the message */
   ret = mwSession_send(session, (struct mwMessage *) msg);
@@ -573,11 +854,36 @@ int mwChannel_destroy(struct mwChannel *chan,
 }
 
 
+/** TRUE if len more bytes would fit within both the channel's and
+    the session's queue limits */
+static gboolean queue_fits(struct mwChannel *chan, gsize len) {
+  struct mwChannelSet *cs = mwSession_getChannels(chan->session);
+
+  if(chan->queue_limit && chan->queued_bytes + len > chan->queue_limit)
+    return FALSE;
+
+  if(cs->queue_limit && cs->queued_bytes + len > cs->queue_limit)
+    return FALSE;
+
+  return TRUE;
+}
+
+
+static void queue_account(struct mwChannel *chan, gsize len) {
+  struct mwChannelSet *cs = mwSession_getChannels(chan->session);
+
+  chan->queued_bytes += len;
+  cs->queued_bytes += len;
+  stat_queued(chan);
+}
+
+
 static void queue_outgoing(struct mwChannel *chan,
 			   struct mwMsgChannelSend *msg) {
 
   g_info("queue_outgoing, channel 0x%08x", chan->id);
-  chan->outgoing_queue = g_slist_append(chan->outgoing_queue, msg);
+  g_queue_push_tail(&chan->outgoing_queue, msg);
+  queue_account(chan, msg->data.len);
 }
 
 
@@ -591,6 +897,9 @@ static int channel_send(struct mwChannel *chan,
      opened */
 
   if(chan->state == mwChannel_OPEN) {
+    chan->stats.msg_sent++;
+    chan->stats.e_bytes_sent += msg->data.len;
+
     ret = mwSession_send(chan->session, (struct mwMessage *) msg);
     mwMessage_free(MW_MESSAGE(msg));
 
@@ -607,24 +916,79 @@ int mwChannel_sendEncrypted(struct mwChannel *chan,
 			    gboolean encrypt) {
 
   struct mwMsgChannelSend *msg;
+  struct mwOpaque empty = { 0, 0 };
 
   g_return_val_if_fail(chan != NULL, -1);
 
+  if(! data) data = &empty;
+
+  /* a message which would have to be queued, but won't fit, is
+     refused outright. The service will be told once the queue has
+     drained */
+  if(chan->state != mwChannel_OPEN && ! queue_fits(chan, data->len)) {
+    struct mwChannelSet *cs = mwSession_getChannels(chan->session);
+
+    g_info("queue limit reached, channel 0x%08x", chan->id);
+    chan->blocked = TRUE;
+    cs->blocked = TRUE;
+    chan->stats.blocked++;
+    return MW_CHANNEL_WOULD_BLOCK;
+  }
+
   msg = (struct mwMsgChannelSend *) mwMessage_new(mwMessage_CHANNEL_SEND);
   msg->head.channel = chan->id;
   msg->type = type;
 
-  mwOpaque_clone(&msg->data, data);
+  chan->stats.u_bytes_sent += data->len;
 
+  /* encrypting produces a new buffer anyway, so there's no need to
+     copy the data first */
   if(encrypt && chan->cipher) {
     msg->head.options = mwMessageOption_ENCRYPT;
-    mwCipherInstance_encrypt(chan->cipher, &msg->data);
+
+    if(MW_TRACE_ON(cipher_encrypt)) {
+      guint64 start = mwTrace_now();
+      mwCipherInstance_encryptCopy(chan->cipher, data, &msg->data);
+      MW_TRACE(cipher_encrypt, chan, data->len, msg->data.len,
+	       start, mwTrace_now());
+
+    } else {
+      mwCipherInstance_encryptCopy(chan->cipher, data, &msg->data);
+    }
+
+  } else {
+    mwOpaque_clone(&msg->data, data);
   }
 
   return channel_send(chan, msg);  
 }
 
 
+int mwChannel_sendFile(struct mwChannel *chan, guint32 type,
+		       int fd, guint64 offset, gsize len) {
+
+  struct mwMsgChannelSend *msg;
+  int ret;
+
+  g_return_val_if_fail(chan != NULL, -1);
+  g_return_val_if_fail(chan->state == mwChannel_OPEN, -1);
+  g_return_val_if_fail(chan->cipher == NULL, -1);
+
+  msg = (struct mwMsgChannelSend *) mwMessage_new(mwMessage_CHANNEL_SEND);
+  msg->head.channel = chan->id;
+  msg->type = type;
+
+  chan->stats.u_bytes_sent += len;
+  chan->stats.msg_sent++;
+  chan->stats.e_bytes_sent += len;
+
+  ret = mwSession_sendFile(chan->session, MW_MESSAGE(msg), fd, offset, len);
+  mwMessage_free(MW_MESSAGE(msg));
+
+  return ret;
+}
+
+
 int mwChannel_send(struct mwChannel *chan, guint32 type,
 		   struct mwOpaque *data) {
 
@@ -635,20 +999,44 @@ int mwChannel_send(struct mwChannel *chan, guint32 type,
 static void queue_incoming(struct mwChannel *chan,
 			   struct mwMsgChannelSend *msg) {
 
-  /* we clone the message, because session_process will clear it once
-     we return */
-
   struct mwMsgChannelSend *m = g_new0(struct mwMsgChannelSend, 1);
   m->head.type = msg->head.type;
   m->head.options = msg->head.options;
   m->head.channel = msg->head.channel;
-  mwOpaque_clone(&m->head.attribs, &msg->head.attribs);
-
   m->type = msg->type;
-  mwOpaque_clone(&m->data, &msg->data);
+
+  /* the session decodes data for a channel that isn't open onto the
+     heap, so it's taken over without copying. Should it be in the
+     session's arena anyway, it goes once it's been handled, and so
+     is copied */
+  if(mwSession_isArenaMessage(chan->session)) {
+    mwOpaque_clone(&m->head.attribs, &msg->head.attribs);
+    mwOpaque_clone(&m->data, &msg->data);
+
+  } else {
+    mwOpaque_steal(&m->head.attribs, &msg->head.attribs);
+    mwOpaque_steal(&m->data, &msg->data);
+  }
 
   g_info("queue_incoming, channel 0x%08x", chan->id);
-  chan->incoming_queue = g_slist_append(chan->incoming_queue, m);
+  g_queue_push_tail(&chan->incoming_queue, m);
+  queue_account(chan, m->data.len);
+}
+
+
+static void channel_dispatch(struct mwService *srvc,
+			     struct mwChannel *chan,
+			     guint16 type, struct mwOpaque *data) {
+
+  if(MW_TRACE_ON(service_dispatch)) {
+    guint64 start = mwTrace_now();
+    gsize len = data->len;
+    mwService_recv(srvc, chan, type, data);
+    MW_TRACE(service_dispatch, chan, type, len, start, mwTrace_now());
+
+  } else {
+    mwService_recv(srvc, chan, type, data);
+  }
 }
 
 
@@ -658,44 +1046,102 @@ static void channel_recv(struct mwChannel *chan,
   struct mwService *srvc;
   srvc = mwChannel_getService(chan);
 
-  incr_stat(chan, mwChannelStat_MSG_RECV, 1);
+  chan->stats.msg_recv++;
+  chan->stats.e_bytes_recv += msg->data.len;
 
   if(msg->head.options & mwMessageOption_ENCRYPT) {
     struct mwOpaque data = { 0, 0 };
     mwOpaque_clone(&data, &msg->data);
 
-    mwCipherInstance_decrypt(chan->cipher, &data);
-    mwService_recv(srvc, chan, msg->type, &data);
+    if(MW_TRACE_ON(cipher_decrypt)) {
+      guint64 start = mwTrace_now();
+      mwCipherInstance_decrypt(chan->cipher, &data);
+      MW_TRACE(cipher_decrypt, chan, msg->data.len, data.len,
+	       start, mwTrace_now());
+
+    } else {
+      mwCipherInstance_decrypt(chan->cipher, &data);
+    }
+
+    chan->stats.u_bytes_recv += data.len;
+
+    channel_dispatch(srvc, chan, msg->type, &data);
     mwOpaque_clear(&data);
     
   } else {
-    mwService_recv(srvc, chan, msg->type, &msg->data);
+    chan->stats.u_bytes_recv += msg->data.len;
+    channel_dispatch(srvc, chan, msg->type, &msg->data);
+  }
+}
+
+
+/** let the service for each blocked channel know that it may try
+    sending again */
+static void notify_drained(struct mwChannelSet *cs) {
+  GSList *drained = NULL;
+  guint32 i;
+
+  if(! cs->blocked) return;
+  cs->blocked = FALSE;
+
+  /* the service may destroy channels from within the call-back, so
+     collect the blocked channels before telling anyone */
+  for(i = 0; i < CHANNEL_TABLE_SIZE(cs); i++) {
+    struct mwChannel *chan = cs->table[i];
+
+    if(chan && chan->blocked && queue_fits(chan, 0)) {
+      chan->blocked = FALSE;
+      drained = g_slist_prepend(drained, GUINT_TO_POINTER(chan->id));
+
+    } else if(chan && chan->blocked) {
+      cs->blocked = TRUE;
+    }
+  }
+
+  while(drained) {
+    guint32 id = GPOINTER_TO_UINT(drained->data);
+    struct mwChannel *chan;
+    struct mwService *srvc;
+
+    drained = g_slist_delete_link(drained, drained);
+
+    chan = table_find(cs, id);
+    srvc = chan? mwChannel_getService(chan): NULL;
+    if(srvc) mwService_drained(srvc, chan);
   }
 }
 
 
 static void flush_channel(struct mwChannel *chan) {
-  GSList *l;
+  struct mwChannelSet *cs = mwSession_getChannels(chan->session);
+  struct mwMsgChannelSend *msg;
+
+  stat_flushed(chan);
 
-  for(l = chan->incoming_queue; l; l = l->next) {
-    struct mwMsgChannelSend *msg = (struct mwMsgChannelSend *) l->data;
-    l->data = NULL;
+  while( (msg = g_queue_pop_head(&chan->incoming_queue)) ) {
+    chan->queued_bytes -= msg->data.len;
+    cs->queued_bytes -= msg->data.len;
 
     channel_recv(chan, msg);
     mwMessage_free(MW_MESSAGE(msg));
+
+    /* the service may have closed the channel in response, which
+       will have already dumped what remains of the queues */
+    if(chan->state != mwChannel_OPEN) return;
   }
-  g_slist_free(chan->incoming_queue);
-  chan->incoming_queue = NULL;
 
-  for(l = chan->outgoing_queue; l; l = l->next) {
-    struct mwMessage *msg = (struct mwMessage *) l->data;
-    l->data = NULL;
+  while( (msg = g_queue_pop_head(&chan->outgoing_queue)) ) {
+    chan->queued_bytes -= msg->data.len;
+    cs->queued_bytes -= msg->data.len;
 
-    mwSession_send(chan->session, msg);
-    mwMessage_free(msg);
+    chan->stats.msg_sent++;
+    chan->stats.e_bytes_sent += msg->data.len;
+
+    mwSession_send(chan->session, MW_MESSAGE(msg));
+    mwMessage_free(MW_MESSAGE(msg));
   }
-  g_slist_free(chan->outgoing_queue);
-  chan->outgoing_queue = NULL;
+
+  notify_drained(cs);
 }
 
 
@@ -703,22 +1149,108 @@ void mwChannel_recv(struct mwChannel *chan, struct mwMsgChannelSend *msg) {
   if(chan->state == mwChannel_OPEN) {
     channel_recv(chan, msg);
 
-  } else {
+  } else if(queue_fits(chan, msg->data.len)) {
     queue_incoming(chan, msg);
+
+  } else {
+    /* there's no pushing back on the server, so a channel which
+       can't hold what it's being sent has to go */
+    g_warning("queue limit reached, channel 0x%08x", chan->id);
+    mwChannel_destroy(chan, INSUF_BUFFER, NULL);
+  }
+}
+
+
+void mwChannel_setQueueLimit(struct mwChannel *chan, gsize bytes) {
+  g_return_if_fail(chan != NULL);
+  chan->queue_limit = bytes;
+}
+
+
+gsize mwChannel_getQueueLimit(struct mwChannel *chan) {
+  g_return_val_if_fail(chan != NULL, 0);
+  return chan->queue_limit;
+}
+
+
+gsize mwChannel_getQueuedBytes(struct mwChannel *chan) {
+  g_return_val_if_fail(chan != NULL, 0);
+  return chan->queued_bytes;
+}
+
+
+void mwChannelSet_forgetService(struct mwChannelSet *cs,
+				struct mwService *srvc) {
+  guint32 i;
+
+  g_return_if_fail(cs != NULL);
+
+  for(i = 0; i < CHANNEL_TABLE_SIZE(cs); i++) {
+    struct mwChannel *chan = cs->table[i];
+    if(chan && chan->srvc == srvc) chan->srvc = NULL;
   }
 }
 
 
+void mwChannelSet_setAcceptTimeout(struct mwChannelSet *cs, guint msec) {
+  g_return_if_fail(cs != NULL);
+  cs->accept_timeout = msec;
+}
+
+
+guint mwChannelSet_getAcceptTimeout(struct mwChannelSet *cs) {
+  g_return_val_if_fail(cs != NULL, 0);
+  return cs->accept_timeout;
+}
+
+
+void mwChannelSet_setQueueLimit(struct mwChannelSet *cs, gsize bytes) {
+  g_return_if_fail(cs != NULL);
+  cs->queue_limit = bytes;
+}
+
+
+gsize mwChannelSet_getQueueLimit(struct mwChannelSet *cs) {
+  g_return_val_if_fail(cs != NULL, 0);
+  return cs->queue_limit;
+}
+
+
+gsize mwChannelSet_getQueuedBytes(struct mwChannelSet *cs) {
+  g_return_val_if_fail(cs != NULL, 0);
+  return cs->queued_bytes;
+}
+
+
 struct mwChannel *mwChannel_find(struct mwChannelSet *cs, guint32 chan) {
   g_return_val_if_fail(cs != NULL, NULL);
-  g_return_val_if_fail(cs->map != NULL, NULL);
-  return g_hash_table_lookup(cs->map, GUINT_TO_POINTER(chan));
+  g_return_val_if_fail(cs->table != NULL, NULL);
+  return table_find(cs, chan);
 }
 
 
 void mwChannelSet_free(struct mwChannelSet *cs) {
+  struct channel_slab *slab;
+  guint32 i;
+
   if(! cs) return;
-  if(cs->map) g_hash_table_destroy(cs->map);
+
+  if(cs->table) {
+    for(i = 0; i < CHANNEL_TABLE_SIZE(cs); i++) {
+      struct mwChannel *chan = cs->table[i];
+      if(! chan) continue;
+
+      cs->table[i] = NULL;
+      channel_free(cs, chan);
+    }
+    g_free(cs->table);
+  }
+
+  while( (slab = cs->slabs) ) {
+    cs->slabs = slab->next;
+    g_free(slab);
+  }
+
   g_free(cs);
 }
 
@@ -727,9 +1259,9 @@ struct mwChannelSet *mwChannelSet_new(struct mwSession *s) {
   struct mwChannelSet *cs = g_new0(struct mwChannelSet, 1);
   cs->session = s;
 
-  /* for some reason, g_int_hash/g_int_equal cause a SIGSEGV */
-  cs->map = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-				  NULL, (GDestroyNotify) channel_free);
+  cs->table_bits = CHANNEL_TABLE_BITS;
+  cs->table = g_new0(struct mwChannel *, CHANNEL_TABLE_SIZE(cs));
+
   return cs;
 }
 
@@ -779,7 +1311,7 @@ void mwChannel_recvCreate(struct mwChannel *chan,
   chan->proto_type = msg->proto_type;
   chan->proto_ver = msg->proto_ver;
   
-  srvc = mwSession_getService(session, msg->service);
+  srvc = mwChannel_getService(chan);
   if(srvc) {
     mwService_recvCreate(srvc, chan, msg);
 
@@ -813,7 +1345,7 @@ void mwChannel_recvAccept(struct mwChannel *chan,
 
   mwLoginInfo_clone(&chan->user, &msg->acceptor);
 
-  srvc = mwSession_getService(chan->session, chan->service);
+  srvc = mwChannel_getService(chan);
   if(! srvc) {
     g_warning("no service: 0x%08x", chan->service);
     mwChannel_destroy(chan, ERR_SERVICE_NO_SUPPORT, NULL);
@@ -871,9 +1403,9 @@ void mwChannel_recvDestroy(struct mwChannel *chan,
 
   cs = mwSession_getChannels(chan->session);
   g_return_if_fail(cs != NULL);
-  g_return_if_fail(cs->map != NULL);
+  g_return_if_fail(cs->table != NULL);
 
-  g_hash_table_remove(cs->map, GUINT_TO_POINTER(chan->id));
+  channel_remove(cs, chan);
 }
 
 
@@ -916,7 +1448,9 @@ GList *mwChannel_getSupportedCipherInstances(struct mwChannel *chan) {
   GList *list = NULL;
 
   g_return_val_if_fail(chan != NULL, NULL);
-  g_hash_table_foreach(chan->supported, collect, &list);
+
+  if(chan->supported)
+    g_hash_table_foreach(chan->supported, collect, &list);
 
   return list;
 }
@@ -927,7 +1461,6 @@ void mwChannel_selectCipherInstance(struct mwChannel *chan,
   struct mwCipher *c;
 
   g_return_if_fail(chan != NULL);
-  g_return_if_fail(chan->supported != NULL);
 
   chan->cipher = ci;
   if(ci) {
@@ -936,7 +1469,8 @@ void mwChannel_selectCipherInstance(struct mwChannel *chan,
     c = mwCipherInstance_getCipher(ci);
     cid = mwCipher_getType(c);
 
-    g_hash_table_steal(chan->supported, GUINT_TO_POINTER(cid));
+    if(chan->supported)
+      g_hash_table_steal(chan->supported, GUINT_TO_POINTER(cid));
 
     switch(mwCipher_getType(c)) {
     case mwCipher_RC2_40:
@@ -961,8 +1495,10 @@ void mwChannel_selectCipherInstance(struct mwChannel *chan,
     g_message("channel 0x%08x selected no cipher", chan->id);
   }
 
-  g_hash_table_destroy(chan->supported);
-  chan->supported = NULL;
+  if(chan->supported) {
+    g_hash_table_destroy(chan->supported);
+    chan->supported = NULL;
+  }
 }
 
 
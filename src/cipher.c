@@ -504,6 +504,24 @@ static int encrypt_RC2_40(struct mwCipherInstance *ci,
 }
 
 
+static int encrypt_copy_RC2_40(struct mwCipherInstance *ci,
+			       const struct mwOpaque *in,
+			       struct mwOpaque *out) {
+
+  struct mwCipherInstance_RC2_40 *cir;
+  struct mwCipher_RC2_40 *cr;
+
+  cir = (struct mwCipherInstance_RC2_40 *) ci;
+  cr = (struct mwCipher_RC2_40 *) ci->cipher;
+
+  /* only reads from in */
+  mwEncryptExpanded(cr->session_key, cir->outgoing_iv,
+		    (struct mwOpaque *) in, out);
+
+  return 0;
+}
+
+
 static int decrypt_RC2_40(struct mwCipherInstance *ci,
 			  struct mwOpaque *data) {
   
@@ -615,6 +633,7 @@ struct mwCipher *mwCipher_new_RC2_40(struct mwSession *s) {
   c->accept = accept_RC2_40;
 
   c->encrypt = encrypt_RC2_40;
+  c->encrypt_copy = encrypt_copy_RC2_40;
   c->decrypt = decrypt_RC2_40;
 
   return c;
@@ -754,6 +773,22 @@ static int encrypt_RC2_128(struct mwCipherInstance *ci,
 }
 
 
+static int encrypt_copy_RC2_128(struct mwCipherInstance *ci,
+				const struct mwOpaque *in,
+				struct mwOpaque *out) {
+
+  struct mwCipherInstance_RC2_128 *cir;
+
+  cir = (struct mwCipherInstance_RC2_128 *) ci;
+
+  /* only reads from in */
+  mwEncryptExpanded(cir->shared, cir->outgoing_iv,
+		    (struct mwOpaque *) in, out);
+
+  return 0;
+}
+
+
 static int decrypt_RC2_128(struct mwCipherInstance *ci,
 			   struct mwOpaque *data) {
 
@@ -803,6 +838,7 @@ struct mwCipher *mwCipher_new_RC2_128(struct mwSession *s) {
   c->accept = accept_RC2_128;
 
   c->encrypt = encrypt_RC2_128;
+  c->encrypt_copy = encrypt_copy_RC2_128;
   c->decrypt = decrypt_RC2_128;
 
   c->clear = clear_RC2_128;
@@ -944,6 +980,28 @@ int mwCipherInstance_encrypt(struct mwCipherInstance *ci,
 }
 
 
+int mwCipherInstance_encryptCopy(struct mwCipherInstance *ci,
+				 const struct mwOpaque *in,
+				 struct mwOpaque *out) {
+  struct mwCipher *cipher;
+
+  g_return_val_if_fail(in != NULL, -1);
+  g_return_val_if_fail(out != NULL, -1);
+
+  if(ci && ci->cipher && ci->cipher->encrypt_copy)
+    return ci->cipher->encrypt_copy(ci, in, out);
+
+  mwOpaque_clone(out, in);
+  if(! ci) return 0;
+
+  cipher = ci->cipher;
+  g_return_val_if_fail(cipher != NULL, -1);
+
+  return (cipher->encrypt)?
+    cipher->encrypt(ci, out): 0;
+}
+
+
 int mwCipherInstance_decrypt(struct mwCipherInstance *ci,
 			     struct mwOpaque *data) {
   struct mwCipher *cipher;
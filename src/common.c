@@ -21,6 +21,7 @@
 #include <glib.h>
 #include <string.h>
 
+#include "mw_codec.h"
 #include "mw_common.h"
 
 
@@ -70,9 +71,43 @@ struct mwGetBuffer {
 
   gboolean wrap;   /**< TRUE to indicate buf shouldn't be freed */
   gboolean error;  /**< TRUE to indicate an error */
+
+  struct mwArena *arena;  /**< where _get functions allocate, or NULL */
+  gboolean in_arena;      /**< TRUE if this was allocated from arena */
+};
+
+
+/** a block of arena memory. The memory itself follows the header */
+struct arena_block {
+  struct arena_block *next;  /**< the block filled before this one */
+  gsize size;                /**< bytes of memory after the header */
+  gsize used;                /**< bytes handed out */
+};
+
+
+struct mwArena {
+  struct arena_block *block;  /**< block currently handing out memory */
+  gsize hint;                 /**< size for the next new block */
 };
 
 
+/** allocations are rounded up to this, to stay aligned for any type */
+#define ARENA_ALIGN   (2 * sizeof(gpointer))
+#define ARENA_ROUND(n)  (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+
+/** smallest block allocated */
+#define ARENA_BLOCK   (4 * 1024)
+
+
+/** largest block kept over a reset */
+#define ARENA_KEEP    (64 * 1024)
+
+
+#define ARENA_HEADER  ARENA_ROUND(sizeof(struct arena_block))
+#define ARENA_DATA(blk)  ((guchar *) (blk) + ARENA_HEADER)
+
+
 #define BUFFER_USED(buffer) \
   ((buffer)->len - (buffer)->rem)
 
@@ -119,6 +154,92 @@ static gboolean check_buffer(struct mwGetBuffer *b, gsize needed) {
 }
 
 
+struct mwArena *mwArena_new(void) {
+  return g_new0(struct mwArena, 1);
+}
+
+
+gpointer mwArena_alloc(struct mwArena *a, gsize len) {
+  struct arena_block *blk;
+  gpointer mem;
+
+  g_return_val_if_fail(a != NULL, NULL);
+
+  len = ARENA_ROUND(len);
+  blk = a->block;
+
+  if(! blk || blk->size - blk->used < len) {
+    gsize size = MAX(a->hint, ARENA_BLOCK);
+
+    if(blk) size = MAX(size, blk->size * 2);
+    size = MAX(size, len);
+
+    blk = g_malloc(ARENA_HEADER + size);
+    blk->next = a->block;
+    blk->size = size;
+    blk->used = 0;
+    a->block = blk;
+  }
+
+  mem = ARENA_DATA(blk) + blk->used;
+  blk->used += len;
+
+  return mem;
+}
+
+
+gpointer mwArena_alloc0(struct mwArena *a, gsize len) {
+  gpointer mem = mwArena_alloc(a, len);
+  if(mem) memset(mem, 0, len);
+  return mem;
+}
+
+
+static void arena_blocks_free(struct mwArena *a) {
+  struct arena_block *blk;
+
+  while( (blk = a->block) ) {
+    a->block = blk->next;
+    g_free(blk);
+  }
+}
+
+
+void mwArena_reset(struct mwArena *a) {
+  struct arena_block *blk;
+  gsize total = 0;
+
+  g_return_if_fail(a != NULL);
+
+  blk = a->block;
+  if(! blk) return;
+
+  if(! blk->next && blk->size <= ARENA_KEEP) {
+    blk->used = 0;
+    return;
+  }
+
+  /* more than one block was needed. Start again with a single block
+     large enough for all of it, within reason */
+  for(; blk; blk = blk->next) total += blk->size;
+  arena_blocks_free(a);
+  a->hint = MIN(total, ARENA_KEEP);
+}
+
+
+void mwArena_free(struct mwArena *a) {
+  if(! a) return;
+  arena_blocks_free(a);
+  g_free(a);
+}
+
+
+/** allocate memory for something being read from a buffer */
+static gpointer get_alloc(struct mwGetBuffer *b, gsize len) {
+  return b->arena? mwArena_alloc(b->arena, len): g_malloc(len);
+}
+
+
 struct mwPutBuffer *mwPutBuffer_new() {
   return g_new0(struct mwPutBuffer, 1);
 }
@@ -167,6 +288,39 @@ struct mwGetBuffer *mwGetBuffer_new(struct mwOpaque *o) {
 }
 
 
+struct mwGetBuffer *mwGetBuffer_wrapArena(const struct mwOpaque *o,
+					  struct mwArena *arena) {
+
+  struct mwGetBuffer *b;
+
+  g_return_val_if_fail(arena != NULL, NULL);
+
+  b = mwArena_alloc0(arena, sizeof(struct mwGetBuffer));
+
+  if(o && o->len) {
+    b->buf = b->ptr = o->data;
+    b->len = b->rem = o->len;
+  }
+  b->wrap = TRUE;
+  b->arena = arena;
+  b->in_arena = TRUE;
+
+  return b;
+}
+
+
+void mwGetBuffer_setArena(struct mwGetBuffer *b, struct mwArena *arena) {
+  g_return_if_fail(b != NULL);
+  b->arena = arena;
+}
+
+
+struct mwArena *mwGetBuffer_getArena(struct mwGetBuffer *b) {
+  g_return_val_if_fail(b != NULL, NULL);
+  return b->arena;
+}
+
+
 struct mwGetBuffer *mwGetBuffer_wrap(const struct mwOpaque *o) {
   struct mwGetBuffer *b = g_new0(struct mwGetBuffer, 1);
 
@@ -238,7 +392,7 @@ gboolean mwGetBuffer_error(struct mwGetBuffer *b) {
 void mwGetBuffer_free(struct mwGetBuffer *b) {
   if(! b) return;
   if(! b->wrap) g_free(b->buf);
-  g_free(b);
+  if(! b->in_arena) g_free(b);
 }
 
 
@@ -382,8 +536,9 @@ void mwString_get(struct mwGetBuffer *b, char **val) {
   g_return_if_fail(check_buffer(b, (gsize) len));
 
   if(len) {
-    *val = g_malloc0(len + 1);
+    *val = get_alloc(b, len + 1);
     memcpy(*val, b->ptr, len);
+    (*val)[len] = '\0';
     b->ptr += len;
     b->rem -= len;
   }
@@ -431,7 +586,8 @@ void mwOpaque_get(struct mwGetBuffer *b, struct mwOpaque *o) {
 
   o->len = (gsize) tmp;
   if(tmp > 0) {
-    o->data = g_memdup(b->ptr, tmp);
+    o->data = get_alloc(b, tmp);
+    memcpy(o->data, b->ptr, tmp);
     b->ptr += tmp;
     b->rem -= tmp;
   }
@@ -467,26 +623,309 @@ void mwOpaque_clone(struct mwOpaque *to, const struct mwOpaque *from) {
 }
 
 
+void mwOpaque_steal(struct mwOpaque *to, struct mwOpaque *from) {
+  g_return_if_fail(to != NULL);
+  g_return_if_fail(from != NULL);
+
+  to->len = from->len;
+  to->data = from->data;
+
+  from->len = 0;
+  from->data = NULL;
+}
+
+
+/* table-driven codecs */
+
+
+#define FIELD_PTR(obj, f, type) \
+  ((type *) ((guchar *) (obj) + (f)->offset))
+
+
+#define FIELD_CPTR(obj, f, type) \
+  ((const type *) ((const guchar *) (obj) + (f)->offset))
+
+
+/** wire length of a fixed-size field, or zero for one of variable
+    length */
+static gsize field_size(enum mwFieldKind kind) {
+  switch(kind) {
+  case mwField_U16:
+    return guint16_buflen();
+  case mwField_U32:
+    return guint32_buflen();
+  case mwField_BOOL:
+    return gboolean_buflen();
+  default:
+    return 0;
+  }
+}
+
+
+/** the wire length of the run of fixed-size fields from f, stopping
+    at end or the first variable-length field, which is put in run */
+static gsize field_run(const struct mwField *f, const struct mwField *end,
+		       const struct mwField **run) {
+  gsize len = 0, n;
+
+  for(; f < end && (n = field_size(f->kind)); f++) len += n;
+
+  *run = f;
+  return len;
+}
+
+
+void mwCodec_get(struct mwGetBuffer *b, const struct mwCodec *c,
+		 gpointer obj) {
+
+  const struct mwField *f, *end, *run;
+  gsize len;
+
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(c != NULL);
+  g_return_if_fail(obj != NULL);
+
+  f = c->fields;
+  end = f + c->count;
+
+  while(f < end && ! b->error) {
+    len = field_run(f, end, &run);
+
+    if(len) {
+      if(! check_buffer(b, len)) return;
+
+      for(; f < run; f++) {
+	switch(f->kind) {
+	case mwField_U16:
+	  MW16_GET(b->ptr, *FIELD_PTR(obj, f, guint16));
+	  break;
+	case mwField_U32:
+	  MW32_GET(b->ptr, *FIELD_PTR(obj, f, guint32));
+	  break;
+	default:
+	  *FIELD_PTR(obj, f, gboolean) = !! *(b->ptr)++;
+	}
+      }
+
+      b->rem -= len;
+      continue;
+    }
+
+    switch(f->kind) {
+    case mwField_STRING:
+      mwString_get(b, FIELD_PTR(obj, f, char *));
+      break;
+    case mwField_OPAQUE:
+      mwOpaque_get(b, FIELD_PTR(obj, f, struct mwOpaque));
+      break;
+    case mwField_ID_BLOCK:
+      mwIdBlock_get(b, FIELD_PTR(obj, f, struct mwIdBlock));
+      break;
+    case mwField_LOGIN_INFO:
+      mwLoginInfo_get(b, FIELD_PTR(obj, f, struct mwLoginInfo));
+      break;
+    case mwField_USER_STATUS:
+      mwUserStatus_get(b, FIELD_PTR(obj, f, struct mwUserStatus));
+      break;
+    case mwField_PRIVACY_INFO:
+      mwPrivacyInfo_get(b, FIELD_PTR(obj, f, struct mwPrivacyInfo));
+      break;
+    default:
+      g_return_if_reached();
+    }
+    f++;
+  }
+}
+
+
+void mwCodec_put(struct mwPutBuffer *b, const struct mwCodec *c,
+		 gconstpointer obj) {
+
+  const struct mwField *f, *end, *run;
+  gsize len;
+
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(c != NULL);
+  g_return_if_fail(obj != NULL);
+
+  f = c->fields;
+  end = f + c->count;
+
+  while(f < end) {
+    len = field_run(f, end, &run);
+
+    if(len) {
+      ensure_buffer(b, len);
+
+      for(; f < run; f++) {
+	switch(f->kind) {
+	case mwField_U16:
+	  MW16_PUT(b->ptr, *FIELD_CPTR(obj, f, guint16));
+	  break;
+	case mwField_U32:
+	  MW32_PUT(b->ptr, *FIELD_CPTR(obj, f, guint32));
+	  break;
+	default:
+	  *(b->ptr)++ = (*FIELD_CPTR(obj, f, gboolean))? 1: 0;
+	}
+      }
+
+      b->rem -= len;
+      continue;
+    }
+
+    switch(f->kind) {
+    case mwField_STRING:
+      mwString_put(b, *FIELD_CPTR(obj, f, char *));
+      break;
+    case mwField_OPAQUE:
+      mwOpaque_put(b, FIELD_CPTR(obj, f, struct mwOpaque));
+      break;
+    case mwField_ID_BLOCK:
+      mwIdBlock_put(b, FIELD_CPTR(obj, f, struct mwIdBlock));
+      break;
+    case mwField_LOGIN_INFO:
+      mwLoginInfo_put(b, FIELD_CPTR(obj, f, struct mwLoginInfo));
+      break;
+    case mwField_USER_STATUS:
+      mwUserStatus_put(b, FIELD_CPTR(obj, f, struct mwUserStatus));
+      break;
+    case mwField_PRIVACY_INFO:
+      mwPrivacyInfo_put(b, FIELD_CPTR(obj, f, struct mwPrivacyInfo));
+      break;
+    default:
+      g_return_if_reached();
+    }
+    f++;
+  }
+}
+
+
+void mwCodec_clear(const struct mwCodec *c, gpointer obj) {
+  const struct mwField *f, *end;
+
+  g_return_if_fail(c != NULL);
+  if(! obj) return;
+
+  end = c->fields + c->count;
+
+  for(f = c->fields; f < end; f++) {
+    switch(f->kind) {
+    case mwField_U16:
+      *FIELD_PTR(obj, f, guint16) = 0;
+      break;
+    case mwField_U32:
+      *FIELD_PTR(obj, f, guint32) = 0;
+      break;
+    case mwField_BOOL:
+      *FIELD_PTR(obj, f, gboolean) = FALSE;
+      break;
+    case mwField_STRING:
+      g_free(*FIELD_PTR(obj, f, char *));
+      *FIELD_PTR(obj, f, char *) = NULL;
+      break;
+    case mwField_OPAQUE:
+      mwOpaque_clear(FIELD_PTR(obj, f, struct mwOpaque));
+      break;
+    case mwField_ID_BLOCK:
+      mwIdBlock_clear(FIELD_PTR(obj, f, struct mwIdBlock));
+      break;
+    case mwField_LOGIN_INFO:
+      mwLoginInfo_clear(FIELD_PTR(obj, f, struct mwLoginInfo));
+      break;
+    case mwField_USER_STATUS:
+      mwUserStatus_clear(FIELD_PTR(obj, f, struct mwUserStatus));
+      break;
+    case mwField_PRIVACY_INFO:
+      mwPrivacyInfo_clear(FIELD_PTR(obj, f, struct mwPrivacyInfo));
+      break;
+    }
+  }
+}
+
+
+void mwCodec_clone(const struct mwCodec *c, gpointer to,
+		   gconstpointer from) {
+
+  const struct mwField *f, *end;
+
+  g_return_if_fail(c != NULL);
+  g_return_if_fail(to != NULL);
+  g_return_if_fail(from != NULL);
+
+  end = c->fields + c->count;
+
+  for(f = c->fields; f < end; f++) {
+    switch(f->kind) {
+    case mwField_U16:
+      *FIELD_PTR(to, f, guint16) = *FIELD_CPTR(from, f, guint16);
+      break;
+    case mwField_U32:
+      *FIELD_PTR(to, f, guint32) = *FIELD_CPTR(from, f, guint32);
+      break;
+    case mwField_BOOL:
+      *FIELD_PTR(to, f, gboolean) = *FIELD_CPTR(from, f, gboolean);
+      break;
+    case mwField_STRING:
+      *FIELD_PTR(to, f, char *) = g_strdup(*FIELD_CPTR(from, f, char *));
+      break;
+    case mwField_OPAQUE:
+      mwOpaque_clone(FIELD_PTR(to, f, struct mwOpaque),
+		     FIELD_CPTR(from, f, struct mwOpaque));
+      break;
+    case mwField_ID_BLOCK:
+      mwIdBlock_clone(FIELD_PTR(to, f, struct mwIdBlock),
+		      FIELD_CPTR(from, f, struct mwIdBlock));
+      break;
+    case mwField_LOGIN_INFO:
+      mwLoginInfo_clone(FIELD_PTR(to, f, struct mwLoginInfo),
+			FIELD_CPTR(from, f, struct mwLoginInfo));
+      break;
+    case mwField_USER_STATUS:
+      mwUserStatus_clone(FIELD_PTR(to, f, struct mwUserStatus),
+			 FIELD_CPTR(from, f, struct mwUserStatus));
+      break;
+    case mwField_PRIVACY_INFO:
+      mwPrivacyInfo_clone(FIELD_PTR(to, f, struct mwPrivacyInfo),
+			  FIELD_CPTR(from, f, struct mwPrivacyInfo));
+      break;
+    }
+  }
+}
+
+
 /* 8.2 Common Structures */
 /* 8.2.1 Login Info block */
 
 
+static const struct mwField login_fields[] = {
+  MW_FIELD(STRING, mwLoginInfo, login_id),
+  MW_FIELD(U16, mwLoginInfo, type),
+  MW_FIELD(STRING, mwLoginInfo, user_id),
+  MW_FIELD(STRING, mwLoginInfo, user_name),
+  MW_FIELD(STRING, mwLoginInfo, community),
+  MW_FIELD(BOOL, mwLoginInfo, full),
+};
+
+
+/** present only in full login info */
+static const struct mwField login_full_fields[] = {
+  MW_FIELD(STRING, mwLoginInfo, desc),
+  MW_FIELD(U32, mwLoginInfo, ip_addr),
+  MW_FIELD(STRING, mwLoginInfo, server_id),
+};
+
+
+static const struct mwCodec login_codec = MW_CODEC(login_fields);
+static const struct mwCodec login_full_codec = MW_CODEC(login_full_fields);
+
+
 void mwLoginInfo_put(struct mwPutBuffer *b, const struct mwLoginInfo *login) {
   g_return_if_fail(b != NULL);
   g_return_if_fail(login != NULL);
 
-  mwString_put(b, login->login_id);
-  guint16_put(b, login->type);
-  mwString_put(b, login->user_id);
-  mwString_put(b, login->user_name);
-  mwString_put(b, login->community);
-  gboolean_put(b, login->full);
-
-  if(login->full) {
-    mwString_put(b, login->desc);
-    guint32_put(b, login->ip_addr);
-    mwString_put(b, login->server_id);
-  }
+  mwCodec_put(b, &login_codec, login);
+  if(login->full) mwCodec_put(b, &login_full_codec, login);
 }
 
 
@@ -496,32 +935,16 @@ void mwLoginInfo_get(struct mwGetBuffer *b, struct mwLoginInfo *login) {
 
   if(b->error) return;
 
-  mwString_get(b, &login->login_id);
-  guint16_get(b, &login->type);
-  mwString_get(b, &login->user_id);
-  mwString_get(b, &login->user_name);
-  mwString_get(b, &login->community);
-  gboolean_get(b, &login->full);
-  
-  if(login->full) {
-    mwString_get(b, &login->desc);
-    guint32_get(b, &login->ip_addr);
-    mwString_get(b, &login->server_id);
-  }
+  mwCodec_get(b, &login_codec, login);
+  if(login->full) mwCodec_get(b, &login_full_codec, login);
 }
 
 
 void mwLoginInfo_clear(struct mwLoginInfo *login) {
   if(! login) return;
 
-  g_free(login->login_id);
-  g_free(login->user_id);
-  g_free(login->user_name);
-  g_free(login->community);
-  g_free(login->desc);
-  g_free(login->server_id);
-
-  memset(login, 0x00, sizeof(struct mwLoginInfo));
+  mwCodec_clear(&login_codec, login);
+  mwCodec_clear(&login_full_codec, login);
 }
 
 
@@ -531,33 +954,38 @@ void mwLoginInfo_clone(struct mwLoginInfo *to,
   g_return_if_fail(to != NULL);
   g_return_if_fail(from != NULL);
 
-  to->login_id= g_strdup(from->login_id);
-  to->type = from->type;
-  to->user_id = g_strdup(from->user_id);
-  to->user_name = g_strdup(from->user_name);
-  to->community = g_strdup(from->community);
-
-  if( (to->full = from->full) ) {
-    to->desc = g_strdup(from->desc);
-    to->ip_addr = from->ip_addr;
-    to->server_id = g_strdup(from->server_id);
-  }
+  mwCodec_clone(&login_codec, to, from);
+  if(to->full) mwCodec_clone(&login_full_codec, to, from);
 }
 
 
 /* 8.2.2 Private Info Block */
 
 
+static const struct mwField user_item_fields[] = {
+  MW_FIELD(BOOL, mwUserItem, full),
+  MW_FIELD(STRING, mwUserItem, id),
+  MW_FIELD(STRING, mwUserItem, community),
+};
+
+
+/** present only in full user items */
+static const struct mwField user_item_full_fields[] = {
+  MW_FIELD(STRING, mwUserItem, name),
+};
+
+
+static const struct mwCodec user_item_codec = MW_CODEC(user_item_fields);
+static const struct mwCodec user_item_full_codec =
+  MW_CODEC(user_item_full_fields);
+
+
 void mwUserItem_put(struct mwPutBuffer *b, const struct mwUserItem *user) {
   g_return_if_fail(b != NULL);
   g_return_if_fail(user != NULL);
 
-  gboolean_put(b, user->full);
-  mwString_put(b, user->id);
-  mwString_put(b, user->community);
-  
-  if(user->full)
-    mwString_put(b, user->name);
+  mwCodec_put(b, &user_item_codec, user);
+  if(user->full) mwCodec_put(b, &user_item_full_codec, user);
 }
 
 
@@ -567,23 +995,16 @@ void mwUserItem_get(struct mwGetBuffer *b, struct mwUserItem *user) {
 
   if(b->error) return;
 
-  gboolean_get(b, &user->full);
-  mwString_get(b, &user->id);
-  mwString_get(b, &user->community);
-
-  if(user->full)
-    mwString_get(b, &user->name);
+  mwCodec_get(b, &user_item_codec, user);
+  if(user->full) mwCodec_get(b, &user_item_full_codec, user);
 }
 
 
 void mwUserItem_clear(struct mwUserItem *user) {
   if(! user) return;
 
-  g_free(user->id);
-  g_free(user->community);
-  g_free(user->name);
-
-  memset(user, 0x00, sizeof(struct mwUserItem));
+  mwCodec_clear(&user_item_codec, user);
+  mwCodec_clear(&user_item_full_codec, user);
 }
 
 
@@ -593,10 +1014,9 @@ void mwUserItem_clone(struct mwUserItem *to,
   g_return_if_fail(to != NULL);
   g_return_if_fail(from != NULL);
 
-  to->full = from->full;
-  to->id = g_strdup(from->id);
-  to->community = g_strdup(from->community);
-  to->name = (to->full)? g_strdup(from->name): NULL;
+  mwCodec_clone(&user_item_codec, to, from);
+  to->name = NULL;
+  if(to->full) mwCodec_clone(&user_item_full_codec, to, from);
 }
 
 
@@ -625,7 +1045,8 @@ void mwPrivacyInfo_get(struct mwGetBuffer *b, struct mwPrivacyInfo *info) {
 
   if(info->count) {
     guint32 c = info->count;
-    info->users = g_new0(struct mwUserItem, c);
+    info->users = get_alloc(b, sizeof(struct mwUserItem) * c);
+    memset(info->users, 0, sizeof(struct mwUserItem) * c);
     while(c--) mwUserItem_get(b, info->users + c);
   }
 }
@@ -667,15 +1088,24 @@ void mwPrivacyInfo_clear(struct mwPrivacyInfo *info) {
 /* 8.2.3 User Status Block */
 
 
+static const struct mwField user_status_fields[] = {
+  MW_FIELD(U16, mwUserStatus, status),
+  MW_FIELD(U32, mwUserStatus, time),
+  MW_FIELD(STRING, mwUserStatus, desc),
+};
+
+
+static const struct mwCodec user_status_codec =
+  MW_CODEC(user_status_fields);
+
+
 void mwUserStatus_put(struct mwPutBuffer *b,
 		      const struct mwUserStatus *stat) {
 
   g_return_if_fail(b != NULL);
   g_return_if_fail(stat != NULL);
 
-  guint16_put(b, stat->status);
-  guint32_put(b, stat->time);
-  mwString_put(b, stat->desc);
+  mwCodec_put(b, &user_status_codec, stat);
 }
 
 
@@ -685,9 +1115,7 @@ void mwUserStatus_get(struct mwGetBuffer *b, struct mwUserStatus *stat) {
 
   if(b->error) return;
 
-  guint16_get(b, &stat->status);
-  guint32_get(b, &stat->time);
-  mwString_get(b, &stat->desc);
+  mwCodec_get(b, &user_status_codec, stat);
 
   // # User Mikael Berthe <mikael.berthe@lilotux.net>
   // # Date 1195749751 -3600
@@ -704,8 +1132,7 @@ void mwUserStatus_get(struct mwGetBuffer *b, struct mwUserStatus *stat) {
 
 void mwUserStatus_clear(struct mwUserStatus *stat) {
   if(! stat) return;
-  g_free(stat->desc);
-  memset(stat, 0x00, sizeof(struct mwUserStatus));
+  mwCodec_clear(&user_status_codec, stat);
 }
 
 
@@ -715,21 +1142,39 @@ void mwUserStatus_clone(struct mwUserStatus *to,
   g_return_if_fail(to != NULL);
   g_return_if_fail(from != NULL);
 
-  to->status = from->status;
-  to->time = from->time;
-  to->desc = g_strdup(from->desc);
+  mwCodec_clone(&user_status_codec, to, from);
+}
+
+
+gboolean mwUserStatus_equal(const struct mwUserStatus *a,
+			    const struct mwUserStatus *b) {
+
+  g_return_val_if_fail(a != NULL, FALSE);
+  g_return_val_if_fail(b != NULL, FALSE);
+
+  return ( (a->status == b->status) &&
+	   (a->time == b->time) &&
+	   mw_streq(a->desc, b->desc) );
 }
 
 
 /* 8.2.4 ID Block */
 
 
+static const struct mwField id_block_fields[] = {
+  MW_FIELD(STRING, mwIdBlock, user),
+  MW_FIELD(STRING, mwIdBlock, community),
+};
+
+
+static const struct mwCodec id_block_codec = MW_CODEC(id_block_fields);
+
+
 void mwIdBlock_put(struct mwPutBuffer *b, const struct mwIdBlock *id) {
   g_return_if_fail(b != NULL);
   g_return_if_fail(id != NULL);
 
-  mwString_put(b, id->user);
-  mwString_put(b, id->community);
+  mwCodec_put(b, &id_block_codec, id);
 }
 
 
@@ -739,19 +1184,13 @@ void mwIdBlock_get(struct mwGetBuffer *b, struct mwIdBlock *id) {
 
   if(b->error) return;
 
-  mwString_get(b, &id->user);
-  mwString_get(b, &id->community);
+  mwCodec_get(b, &id_block_codec, id);
 }
 
 
 void mwIdBlock_clear(struct mwIdBlock *id) {
   if(! id) return;
-
-  g_free(id->user);
-  id->user = NULL;
-
-  g_free(id->community);
-  id->community = NULL;
+  mwCodec_clear(&id_block_codec, id);
 }
 
 
@@ -759,8 +1198,7 @@ void mwIdBlock_clone(struct mwIdBlock *to, const struct mwIdBlock *from) {
   g_return_if_fail(to != NULL);
   g_return_if_fail(from != NULL);
 
-  to->user = g_strdup(from->user);
-  to->community = g_strdup(from->community);
+  mwCodec_clone(&id_block_codec, to, from);
 }
 
 
@@ -782,6 +1220,16 @@ gboolean mwIdBlock_equal(const struct mwIdBlock *a,
 
 /* 8.2.5 Encryption Block */
 
+
+static const struct mwField encrypt_item_fields[] = {
+  MW_FIELD(U16, mwEncryptItem, id),
+  MW_FIELD(OPAQUE, mwEncryptItem, info),
+};
+
+
+static const struct mwCodec encrypt_item_codec =
+  MW_CODEC(encrypt_item_fields);
+
 /** @todo I think this can be put into cipher */
 
 void mwEncryptItem_put(struct mwPutBuffer *b,
@@ -789,10 +1237,8 @@ void mwEncryptItem_put(struct mwPutBuffer *b,
 
   g_return_if_fail(b != NULL);
   g_return_if_fail(ei != NULL);
-  
-  guint16_put(b, ei->id);
-  mwOpaque_put(b, &ei->info);
 
+  mwCodec_put(b, &encrypt_item_codec, ei);
 }
 
 
@@ -802,15 +1248,13 @@ void mwEncryptItem_get(struct mwGetBuffer *b, struct mwEncryptItem *ei) {
 
   if(b->error) return;
 
-  guint16_get(b, &ei->id);
-  mwOpaque_get(b, &ei->info);
+  mwCodec_get(b, &encrypt_item_codec, ei);
 }
 
 
 void mwEncryptItem_clear(struct mwEncryptItem *ei) {
   if(! ei) return;
-  ei->id = 0x0000;
-  mwOpaque_clear(&ei->info);
+  mwCodec_clear(&encrypt_item_codec, ei);
 }
 
 
@@ -927,6 +1371,30 @@ void mwAwareSnapshot_clone(struct mwAwareSnapshot *to,
 }
 
 
+gboolean mwAwareSnapshot_equal(const struct mwAwareSnapshot *a,
+			       const struct mwAwareSnapshot *b) {
+
+  g_return_val_if_fail(a != NULL, FALSE);
+  g_return_val_if_fail(b != NULL, FALSE);
+
+  if(! mwAwareIdBlock_equal(&a->id, &b->id))
+    return FALSE;
+
+  if(a->online != b->online)
+    return FALSE;
+
+  /* mwAwareSnapshot_clone only keeps the remainder for online
+     snapshots, so that's all there is to compare */
+  if(! a->online)
+    return TRUE;
+
+  return ( mwUserStatus_equal(&a->status, &b->status) &&
+	   mw_streq(a->alt_id, b->alt_id) &&
+	   mw_streq(a->name, b->name) &&
+	   mw_streq(a->group, b->group) );
+}
+
+
 void mwAwareSnapshot_clear(struct mwAwareSnapshot *idb) {
   if(! idb) return;
   mwAwareIdBlock_clear(&idb->id);
@@ -20,10 +20,49 @@
 
 #include <glib.h>
 
+#include "mw_codec.h"
 #include "mw_debug.h"
 #include "mw_message.h"
 
 
+/** allocate zeroed memory for part of a message being read, from
+    the buffer's arena if it has one */
+static gpointer get_alloc0(struct mwGetBuffer *b, gsize len) {
+  struct mwArena *a = mwGetBuffer_getArena(b);
+  return a? mwArena_alloc0(a, len): g_malloc0(len);
+}
+
+
+/** add to a list in a message being read, with the new link from the
+    buffer's arena if it has one */
+static GList *get_list_add(struct mwGetBuffer *b, GList *list,
+			   gpointer data, gboolean append) {
+
+  struct mwArena *a = mwGetBuffer_getArena(b);
+  GList *link, *last;
+
+  if(! a) {
+    return append? g_list_append(list, data): g_list_prepend(list, data);
+  }
+
+  link = mwArena_alloc0(a, sizeof(GList));
+  link->data = data;
+
+  if(! list) return link;
+
+  if(! append) {
+    link->next = list;
+    list->prev = link;
+    return link;
+  }
+
+  last = g_list_last(list);
+  last->next = link;
+  link->prev = last;
+  return list;
+}
+
+
 /* 7.1 Layering and message encapsulation */
 /* 7.1.1 The Sametime Message Header */
 
@@ -71,37 +110,44 @@ static void mwMessageHead_clear(struct mwMessage *msg) {
 /* 8.4.1.1 Handshake */
 
 
+static const struct mwField handshake_fields[] = {
+  MW_FIELD(U16, mwMsgHandshake, major),
+  MW_FIELD(U16, mwMsgHandshake, minor),
+  MW_FIELD(U32, mwMsgHandshake, head.channel),
+  MW_FIELD(U32, mwMsgHandshake, srvrcalc_addr),
+  MW_FIELD(U16, mwMsgHandshake, login_type),
+  MW_FIELD(U32, mwMsgHandshake, loclcalc_addr),
+};
+
+
+/** present from version 1e.1d */
+static const struct mwField handshake_ext_fields[] = {
+  MW_FIELD(U16, mwMsgHandshake, unknown_a),
+  MW_FIELD(U32, mwMsgHandshake, unknown_b),
+  MW_FIELD(STRING, mwMsgHandshake, local_host),
+};
+
+
+static const struct mwCodec handshake_codec = MW_CODEC(handshake_fields);
+static const struct mwCodec handshake_ext_codec =
+  MW_CODEC(handshake_ext_fields);
+
+
+#define HANDSHAKE_EXT(msg) \
+  ((msg)->major >= 0x001e && (msg)->minor >= 0x001d)
+
+
 static void HANDSHAKE_put(struct mwPutBuffer *b, struct mwMsgHandshake *msg) {
-  guint16_put(b, msg->major);
-  guint16_put(b, msg->minor);
-  guint32_put(b, msg->head.channel);
-  guint32_put(b, msg->srvrcalc_addr);
-  guint16_put(b, msg->login_type);
-  guint32_put(b, msg->loclcalc_addr);
-  
-  if(msg->major >= 0x001e && msg->minor >= 0x001d) {
-    guint16_put(b, msg->unknown_a);
-    guint32_put(b, msg->unknown_b);
-    mwString_put(b, msg->local_host);
-  }
+  mwCodec_put(b, &handshake_codec, msg);
+  if(HANDSHAKE_EXT(msg)) mwCodec_put(b, &handshake_ext_codec, msg);
 }
 
 
 static void HANDSHAKE_get(struct mwGetBuffer *b, struct mwMsgHandshake *msg) {
   if(mwGetBuffer_error(b)) return;
 
-  guint16_get(b, &msg->major);
-  guint16_get(b, &msg->minor);
-  guint32_get(b, &msg->head.channel);
-  guint32_get(b, &msg->srvrcalc_addr);
-  guint16_get(b, &msg->login_type);
-  guint32_get(b, &msg->loclcalc_addr);
-
-  if(msg->major >= 0x001e && msg->minor >= 0x001d) {
-    guint16_get(b, &msg->unknown_a);
-    guint32_get(b, &msg->unknown_b);
-    mwString_get(b, &msg->local_host);
-  }
+  mwCodec_get(b, &handshake_codec, msg);
+  if(HANDSHAKE_EXT(msg)) mwCodec_get(b, &handshake_ext_codec, msg);
 }
 
 
@@ -115,36 +161,46 @@ static void HANDSHAKE_clear(struct mwMsgHandshake *msg) {
 /* 8.4.1.2 HandshakeAck */
 
 
+static const struct mwField handshake_ack_fields[] = {
+  MW_FIELD(U16, mwMsgHandshakeAck, major),
+  MW_FIELD(U16, mwMsgHandshakeAck, minor),
+  MW_FIELD(U32, mwMsgHandshakeAck, srvrcalc_addr),
+};
+
+
+/** @todo: get a better handle on what versions support what parts
+    of this message. eg: minor version 0x0018 doesn't send these */
+static const struct mwField handshake_ack_ext_fields[] = {
+  MW_FIELD(U32, mwMsgHandshakeAck, magic),
+  MW_FIELD(OPAQUE, mwMsgHandshakeAck, data),
+};
+
+
+static const struct mwCodec handshake_ack_codec =
+  MW_CODEC(handshake_ack_fields);
+static const struct mwCodec handshake_ack_ext_codec =
+  MW_CODEC(handshake_ack_ext_fields);
+
+
+#define HANDSHAKE_ACK_EXT(msg) \
+  ((msg)->major >= 0x1e && (msg)->minor > 0x18)
+
+
 static void HANDSHAKE_ACK_get(struct mwGetBuffer *b,
 			      struct mwMsgHandshakeAck *msg) {
 
   if(mwGetBuffer_error(b)) return;
 
-  guint16_get(b, &msg->major);
-  guint16_get(b, &msg->minor);
-  guint32_get(b, &msg->srvrcalc_addr);
-
-  /** @todo: get a better handle on what versions support what parts
-      of this message. eg: minor version 0x0018 doesn't send the
-      following */
-  if(msg->major >= 0x1e && msg->minor > 0x18) {
-    guint32_get(b, &msg->magic);
-    mwOpaque_get(b, &msg->data);
-  }
+  mwCodec_get(b, &handshake_ack_codec, msg);
+  if(HANDSHAKE_ACK_EXT(msg)) mwCodec_get(b, &handshake_ack_ext_codec, msg);
 }
 
 
 static void HANDSHAKE_ACK_put(struct mwPutBuffer *b,
 			      struct mwMsgHandshakeAck *msg) {
 
-  guint16_put(b, msg->major);
-  guint16_put(b, msg->minor);
-  guint32_put(b, msg->srvrcalc_addr);
-
-  if(msg->major >= 0x1e && msg->minor > 0x18) {
-    guint32_put(b, msg->magic);
-    mwOpaque_put(b, &msg->data);
-  }
+  mwCodec_put(b, &handshake_ack_codec, msg);
+  if(HANDSHAKE_ACK_EXT(msg)) mwCodec_put(b, &handshake_ack_ext_codec, msg);
 }
 
 
@@ -238,34 +294,56 @@ static void LOGIN_CONTINUE_clear(struct mwMsgLoginContinue *msg) {
 /* 8.4.1.6 AuthPassed */
 
 
+static const struct mwField login_redirect_fields[] = {
+  MW_FIELD(STRING, mwMsgLoginRedirect, host),
+  MW_FIELD(STRING, mwMsgLoginRedirect, server_id),
+};
+
+
+static const struct mwCodec login_redirect_codec =
+  MW_CODEC(login_redirect_fields);
+
+
 static void LOGIN_REDIRECT_get(struct mwGetBuffer *b,
 			       struct mwMsgLoginRedirect *msg) {
 
   if(mwGetBuffer_error(b)) return;
-  mwString_get(b, &msg->host);
-  mwString_get(b, &msg->server_id);  
+  mwCodec_get(b, &login_redirect_codec, msg);
 }
 
 
 static void LOGIN_REDIRECT_put(struct mwPutBuffer *b,
 			       struct mwMsgLoginRedirect *msg) {
-  mwString_put(b, msg->host);
-  mwString_put(b, msg->server_id);
+  mwCodec_put(b, &login_redirect_codec, msg);
 }
 
 
 static void LOGIN_REDIRECT_clear(struct mwMsgLoginRedirect *msg) {
-  g_free(msg->host);
-  msg->host = NULL;
-
-  g_free(msg->server_id);
-  msg->server_id = NULL;
+  mwCodec_clear(&login_redirect_codec, msg);
 }
 
 
 /* 8.4.1.7 CreateCnl */
 
 
+/** up to the optional creator */
+static const struct mwField channel_create_fields[] = {
+  MW_FIELD(U32, mwMsgChannelCreate, reserved),
+  MW_FIELD(U32, mwMsgChannelCreate, channel),
+  MW_FIELD(ID_BLOCK, mwMsgChannelCreate, target),
+  MW_FIELD(U32, mwMsgChannelCreate, service),
+  MW_FIELD(U32, mwMsgChannelCreate, proto_type),
+  MW_FIELD(U32, mwMsgChannelCreate, proto_ver),
+  MW_FIELD(U32, mwMsgChannelCreate, options),
+  MW_FIELD(OPAQUE, mwMsgChannelCreate, addtl),
+  MW_FIELD(BOOL, mwMsgChannelCreate, creator_flag),
+};
+
+
+static const struct mwCodec channel_create_codec =
+  MW_CODEC(channel_create_fields);
+
+
 static void enc_offer_put(struct mwPutBuffer *b, struct mwEncryptOffer *enc) {
   guint16_put(b, enc->mode);
 
@@ -299,15 +377,7 @@ static void enc_offer_put(struct mwPutBuffer *b, struct mwEncryptOffer *enc) {
 static void CHANNEL_CREATE_put(struct mwPutBuffer *b,
 			       struct mwMsgChannelCreate *msg) {
 
-  guint32_put(b, msg->reserved);
-  guint32_put(b, msg->channel);
-  mwIdBlock_put(b, &msg->target);
-  guint32_put(b, msg->service);
-  guint32_put(b, msg->proto_type);
-  guint32_put(b, msg->proto_ver);
-  guint32_put(b, msg->options);
-  mwOpaque_put(b, &msg->addtl);
-  gboolean_put(b, msg->creator_flag);
+  mwCodec_put(b, &channel_create_codec, msg);
 
   if(msg->creator_flag)
     mwLoginInfo_put(b, &msg->creator);
@@ -335,9 +405,11 @@ static void enc_offer_get(struct mwGetBuffer *b,
     guint32_get(b, &count);
 
     while(count-- && (! mwGetBuffer_error(b))) {
-      struct mwEncryptItem *ei = g_new0(struct mwEncryptItem, 1);
+      struct mwEncryptItem *ei;
+
+      ei = get_alloc0(b, sizeof(struct mwEncryptItem));
       mwEncryptItem_get(b, ei);
-      enc->items = g_list_append(enc->items, ei);
+      enc->items = get_list_add(b, enc->items, ei, TRUE);
     }
 
     guint16_get(b, &enc->extra);
@@ -351,16 +423,8 @@ static void CHANNEL_CREATE_get(struct mwGetBuffer *b,
 
   if(mwGetBuffer_error(b)) return;
 
-  guint32_get(b, &msg->reserved);
-  guint32_get(b, &msg->channel);
-  mwIdBlock_get(b, &msg->target);
-  guint32_get(b, &msg->service);
-  guint32_get(b, &msg->proto_type);
-  guint32_get(b, &msg->proto_ver);
-  guint32_get(b, &msg->options);
-  mwOpaque_get(b, &msg->addtl);
-  gboolean_get(b, &msg->creator_flag);
-  
+  mwCodec_get(b, &channel_create_codec, msg);
+
   if(msg->creator_flag)
     mwLoginInfo_get(b, &msg->creator);
   
@@ -371,8 +435,7 @@ static void CHANNEL_CREATE_get(struct mwGetBuffer *b,
 static void CHANNEL_CREATE_clear(struct mwMsgChannelCreate *msg) {
   GList *list;
 
-  mwIdBlock_clear(&msg->target);
-  mwOpaque_clear(&msg->addtl);
+  mwCodec_clear(&channel_create_codec, msg);
   mwLoginInfo_clear(&msg->creator);
   
   for(list = msg->encrypt.items; list; list = list->next) {
@@ -386,6 +449,20 @@ static void CHANNEL_CREATE_clear(struct mwMsgChannelCreate *msg) {
 /* 8.4.1.8 AcceptCnl */
 
 
+/** up to the optional acceptor */
+static const struct mwField channel_accept_fields[] = {
+  MW_FIELD(U32, mwMsgChannelAccept, service),
+  MW_FIELD(U32, mwMsgChannelAccept, proto_type),
+  MW_FIELD(U32, mwMsgChannelAccept, proto_ver),
+  MW_FIELD(OPAQUE, mwMsgChannelAccept, addtl),
+  MW_FIELD(BOOL, mwMsgChannelAccept, acceptor_flag),
+};
+
+
+static const struct mwCodec channel_accept_codec =
+  MW_CODEC(channel_accept_fields);
+
+
 static void enc_accept_put(struct mwPutBuffer *b,
 			   struct mwEncryptAccept *enc) {
 
@@ -411,12 +488,8 @@ static void enc_accept_put(struct mwPutBuffer *b,
 static void CHANNEL_ACCEPT_put(struct mwPutBuffer *b,
 			       struct mwMsgChannelAccept *msg) {
   
-  guint32_put(b, msg->service);
-  guint32_put(b, msg->proto_type);
-  guint32_put(b, msg->proto_ver);
-  mwOpaque_put(b, &msg->addtl);
-  gboolean_put(b, msg->acceptor_flag);
-  
+  mwCodec_put(b, &channel_accept_codec, msg);
+
   if(msg->acceptor_flag)
     mwLoginInfo_put(b, &msg->acceptor);
   
@@ -438,7 +511,7 @@ static void enc_accept_get(struct mwGetBuffer *b,
   guint32_get(b, &skip);
 
   if(skip >= 6) {
-    enc->item = g_new0(struct mwEncryptItem, 1);
+    enc->item = get_alloc0(b, sizeof(struct mwEncryptItem));
     mwEncryptItem_get(b, enc->item);
   }
 
@@ -454,11 +527,7 @@ static void CHANNEL_ACCEPT_get(struct mwGetBuffer *b,
 
   if(mwGetBuffer_error(b)) return;
 
-  guint32_get(b, &msg->service);
-  guint32_get(b, &msg->proto_type);
-  guint32_get(b, &msg->proto_ver);
-  mwOpaque_get(b, &msg->addtl);
-  gboolean_get(b, &msg->acceptor_flag);
+  mwCodec_get(b, &channel_accept_codec, msg);
 
   if(msg->acceptor_flag)
     mwLoginInfo_get(b, &msg->acceptor);
@@ -468,7 +537,7 @@ static void CHANNEL_ACCEPT_get(struct mwGetBuffer *b,
 
 
 static void CHANNEL_ACCEPT_clear(struct mwMsgChannelAccept *msg) {
-  mwOpaque_clear(&msg->addtl);
+  mwCodec_clear(&channel_accept_codec, msg);
   mwLoginInfo_clear(&msg->acceptor);
 
   if(msg->encrypt.item) {
@@ -481,11 +550,18 @@ static void CHANNEL_ACCEPT_clear(struct mwMsgChannelAccept *msg) {
 /* 8.4.1.9 SendOnCnl */
 
 
+static const struct mwField channel_send_fields[] = {
+  MW_FIELD(U16, mwMsgChannelSend, type),
+  MW_FIELD(OPAQUE, mwMsgChannelSend, data),
+};
+
+
+static const struct mwCodec channel_send_codec = MW_CODEC(channel_send_fields);
+
+
 static void CHANNEL_SEND_put(struct mwPutBuffer *b,
 			     struct mwMsgChannelSend *msg) {
-
-  guint16_put(b, msg->type);
-  mwOpaque_put(b, &msg->data);
+  mwCodec_put(b, &channel_send_codec, msg);
 }
 
 
@@ -493,24 +569,31 @@ static void CHANNEL_SEND_get(struct mwGetBuffer *b,
 			     struct mwMsgChannelSend *msg) {
 
   if(mwGetBuffer_error(b)) return;
-
-  guint16_get(b, &msg->type);
-  mwOpaque_get(b, &msg->data);
+  mwCodec_get(b, &channel_send_codec, msg);
 }
 
 
 static void CHANNEL_SEND_clear(struct mwMsgChannelSend *msg) {
-  mwOpaque_clear(&msg->data);
+  mwCodec_clear(&channel_send_codec, msg);
 }
 
 
 /* 8.4.1.10 DestroyCnl */
 
 
+static const struct mwField channel_destroy_fields[] = {
+  MW_FIELD(U32, mwMsgChannelDestroy, reason),
+  MW_FIELD(OPAQUE, mwMsgChannelDestroy, data),
+};
+
+
+static const struct mwCodec channel_destroy_codec =
+  MW_CODEC(channel_destroy_fields);
+
+
 static void CHANNEL_DESTROY_put(struct mwPutBuffer *b,
 				struct mwMsgChannelDestroy *msg) {
-  guint32_put(b, msg->reason);
-  mwOpaque_put(b, &msg->data);
+  mwCodec_put(b, &channel_destroy_codec, msg);
 }
 
 
@@ -518,23 +601,30 @@ static void CHANNEL_DESTROY_get(struct mwGetBuffer *b,
 				struct mwMsgChannelDestroy *msg) {
 
   if(mwGetBuffer_error(b)) return;
-
-  guint32_get(b, &msg->reason);
-  mwOpaque_get(b, &msg->data);
+  mwCodec_get(b, &channel_destroy_codec, msg);
 }
 
 
 static void CHANNEL_DESTROY_clear(struct mwMsgChannelDestroy *msg) {
-  mwOpaque_clear(&msg->data);
+  mwCodec_clear(&channel_destroy_codec, msg);
 }
 
 
 /* 8.4.1.11 SetUserStatus */
 
 
+static const struct mwField set_user_status_fields[] = {
+  MW_FIELD(USER_STATUS, mwMsgSetUserStatus, status),
+};
+
+
+static const struct mwCodec set_user_status_codec =
+  MW_CODEC(set_user_status_fields);
+
+
 static void SET_USER_STATUS_put(struct mwPutBuffer *b,
 				struct mwMsgSetUserStatus *msg) {
-  mwUserStatus_put(b, &msg->status);
+  mwCodec_put(b, &set_user_status_codec, msg);
 }
 
 
@@ -542,21 +632,30 @@ static void SET_USER_STATUS_get(struct mwGetBuffer *b,
 				struct mwMsgSetUserStatus *msg) {
 
   if(mwGetBuffer_error(b)) return;
-  mwUserStatus_get(b, &msg->status);
+  mwCodec_get(b, &set_user_status_codec, msg);
 }
 
 
 static void SET_USER_STATUS_clear(struct mwMsgSetUserStatus *msg) {
-  mwUserStatus_clear(&msg->status);
+  mwCodec_clear(&set_user_status_codec, msg);
 }
 
 
 /* 8.4.1.12 SetPrivacyList */
 
 
+static const struct mwField set_privacy_list_fields[] = {
+  MW_FIELD(PRIVACY_INFO, mwMsgSetPrivacyList, privacy),
+};
+
+
+static const struct mwCodec set_privacy_list_codec =
+  MW_CODEC(set_privacy_list_fields);
+
+
 static void SET_PRIVACY_LIST_put(struct mwPutBuffer *b,
 				 struct mwMsgSetPrivacyList *msg) {
-  mwPrivacyInfo_put(b, &msg->privacy);
+  mwCodec_put(b, &set_privacy_list_codec, msg);
 }
 
 
@@ -564,21 +663,30 @@ static void SET_PRIVACY_LIST_get(struct mwGetBuffer *b,
 				 struct mwMsgSetPrivacyList *msg) {
 
   if(mwGetBuffer_error(b)) return;
-  mwPrivacyInfo_get(b, &msg->privacy);
+  mwCodec_get(b, &set_privacy_list_codec, msg);
 }
 
 
 static void SET_PRIVACY_LIST_clear(struct mwMsgSetPrivacyList *msg) {
-  mwPrivacyInfo_clear(&msg->privacy);
+  mwCodec_clear(&set_privacy_list_codec, msg);
 }
 
 
 /* Sense Service messages */
 
 
+static const struct mwField sense_service_fields[] = {
+  MW_FIELD(U32, mwMsgSenseService, service),
+};
+
+
+static const struct mwCodec sense_service_codec =
+  MW_CODEC(sense_service_fields);
+
+
 static void SENSE_SERVICE_put(struct mwPutBuffer *b,
 			      struct mwMsgSenseService *msg) {
-  guint32_put(b, msg->service);
+  mwCodec_put(b, &sense_service_codec, msg);
 }
 
 
@@ -586,28 +694,33 @@ static void SENSE_SERVICE_get(struct mwGetBuffer *b,
 			      struct mwMsgSenseService *msg) {
 
   if(mwGetBuffer_error(b)) return;
-  guint32_get(b, &msg->service);
+  mwCodec_get(b, &sense_service_codec, msg);
 }
 
 
 static void SENSE_SERVICE_clear(struct mwMsgSenseService *msg) {
-  // `msg` unused
-  (void)msg;
-  ;
+  mwCodec_clear(&sense_service_codec, msg);
 }
 
 
 /* Admin messages */
 
 
+static const struct mwField admin_fields[] = {
+  MW_FIELD(STRING, mwMsgAdmin, text),
+};
+
+
+static const struct mwCodec admin_codec = MW_CODEC(admin_fields);
+
+
 static void ADMIN_get(struct mwGetBuffer *b, struct mwMsgAdmin *msg) {
-  mwString_get(b, &msg->text);
+  mwCodec_get(b, &admin_codec, msg);
 }
 
 
 static void ADMIN_clear(struct mwMsgAdmin *msg) {
-  g_free(msg->text);
-  msg->text = NULL;
+  mwCodec_clear(&admin_codec, msg);
 }
 
 
@@ -617,6 +730,7 @@ static void ADMIN_clear(struct mwMsgAdmin *msg) {
 static void ANNOUNCE_get(struct mwGetBuffer *b, struct mwMsgAnnounce *msg) {
   struct mwOpaque o = { 0, 0 };
   struct mwGetBuffer *gb;
+  struct mwArena *arena;
   guint32 count;
 
   gboolean_get(b, &msg->sender_present);
@@ -625,19 +739,20 @@ static void ANNOUNCE_get(struct mwGetBuffer *b, struct mwMsgAnnounce *msg) {
   guint16_get(b, &msg->unknown_a);
   
   mwOpaque_get(b, &o);
-  gb = mwGetBuffer_wrap(&o);
+  arena = mwGetBuffer_getArena(b);
+  gb = arena? mwGetBuffer_wrapArena(&o, arena): mwGetBuffer_wrap(&o);
 
   gboolean_get(gb, &msg->may_reply);
   mwString_get(gb, &msg->text);
 
   mwGetBuffer_free(gb);
-  mwOpaque_clear(&o);
+  if(! arena) mwOpaque_clear(&o);
 
   guint32_get(b, &count);
   while(count--) {
     char *r = NULL;
     mwString_get(b, &r);
-    msg->recipients = g_list_prepend(msg->recipients, r);
+    msg->recipients = get_list_add(b, msg->recipients, r, FALSE);
   }
 }
 
@@ -726,8 +841,8 @@ struct mwMessage *mwMessage_new(enum mwMessageType type) {
    and cast to a specific subclass of mwMessage. */
 #define CASE(v, t) \
 case mwMessage_ ## v: \
-  msg = (struct mwMessage *) g_new0(struct t, 1); \
-  mwMessageHead_clone(msg, &head); \
+  msg = get_alloc0(b, sizeof(struct t)); \
+  if(arena) *msg = head; else mwMessageHead_clone(msg, &head); \
   v ## _get(b, (struct t *) msg); \
   break;
 
@@ -735,9 +850,14 @@ case mwMessage_ ## v: \
 struct mwMessage *mwMessage_get(struct mwGetBuffer *b) {
   struct mwMessage *msg = NULL;
   struct mwMessage head;
+  struct mwArena *arena;
   
   g_return_val_if_fail(b != NULL, NULL);
 
+  /* with an arena, the head's attributes are already where they
+     belong, and are simply copied into the message */
+  arena = mwGetBuffer_getArena(b);
+
   head.attribs.len = 0;
   head.attribs.data = NULL;
 
@@ -745,7 +865,7 @@ struct mwMessage *mwMessage_get(struct mwGetBuffer *b) {
   mwMessageHead_get(b, &head);
 
   if(mwGetBuffer_error(b)) {
-    mwMessageHead_clear(&head);
+    if(! arena) mwMessageHead_clear(&head);
     g_warning("problem parsing message head from buffer");
     return NULL;
   }
@@ -777,7 +897,7 @@ struct mwMessage *mwMessage_get(struct mwGetBuffer *b) {
 	      head.type);
   }
 
-  mwMessageHead_clear(&head);
+  if(! arena) mwMessageHead_clear(&head);
   
   return msg;
 }
@@ -106,6 +106,14 @@ struct mwChannel;
 struct mwChannelSet;
 
 
+/** returned from mwChannel_send when a message would have to be
+    queued, but would put the channel or its session over a queue
+    limit. The message is not sent. The channel's service will have
+    its drain handler called once there is room again.
+    @see mwChannel_setQueueLimit */
+#define MW_CHANNEL_WOULD_BLOCK  (-2)
+
+
 /** special ID indicating the master channel */
 #define MW_MASTER_CHANNEL_ID  0x00000000
 
@@ -155,6 +163,26 @@ enum mwChannelStatField {
 };
 
 
+/** channel statistics, as a snapshot taken by
+    mwChannel_getStatistics */
+struct mwChannelStats {
+  guint64 msg_sent;      /**< total send-on-chan messages sent */
+  guint64 msg_recv;      /**< total send-on-chan messages received */
+  guint64 u_bytes_sent;  /**< total bytes sent, pre-encryption */
+  guint64 u_bytes_recv;  /**< total bytes received, post-decryption */
+  guint64 e_bytes_sent;  /**< total bytes sent, post-encryption */
+  guint64 e_bytes_recv;  /**< total bytes received, pre-decryption */
+
+  guint64 queued;        /**< messages held until the channel opened */
+  guint64 queue_usec;    /**< total microseconds spent queued */
+  guint64 queue_max_usec;  /**< longest any message spent queued */
+  guint64 blocked;       /**< sends refused for being over a queue limit */
+
+  time_t opened_at;      /**< time when channel was opened */
+  time_t closed_at;      /**< time when channel was closed */
+};
+
+
 /** @enum mwEncryptPolicy
 
     Policy for a channel, dictating what sort of encryption should be
@@ -178,6 +206,37 @@ struct mwChannelSet *mwChannelSet_new(struct mwSession *);
 void mwChannelSet_free(struct mwChannelSet *);
 
 
+/** Drop any reference a channel in the set holds to srvc, such as
+    when the service is removed from the session. Those channels will
+    look their service up again when next it is needed. */
+void mwChannelSet_forgetService(struct mwChannelSet *cs,
+				struct mwService *srvc);
+
+
+/** Give up on outgoing channels which haven't been accepted within
+    msec milliseconds. The channel's service sees a channel destroy
+    with the reason CONNECTION_TIMED. Needs a timer wheel on the
+    session. Zero, the default, waits indefinitely. */
+void mwChannelSet_setAcceptTimeout(struct mwChannelSet *cs, guint msec);
+
+
+/** @returns the accept timeout in milliseconds, or zero */
+guint mwChannelSet_getAcceptTimeout(struct mwChannelSet *cs);
+
+
+/** Limit the total bytes of message data which may be queued across
+    all channels in the set, waiting for them to open. Zero for no
+    limit, which is the default. */
+void mwChannelSet_setQueueLimit(struct mwChannelSet *cs, gsize bytes);
+
+
+gsize mwChannelSet_getQueueLimit(struct mwChannelSet *cs);
+
+
+/** bytes of message data currently queued across the set */
+gsize mwChannelSet_getQueuedBytes(struct mwChannelSet *cs);
+
+
 /** Create an incoming channel with the given channel id. Channel's state
     will be set to WAIT. Primarily for use in mw_session */
 struct mwChannel *mwChannel_newIncoming(struct mwChannelSet *, guint32 id);
@@ -304,11 +363,33 @@ mwChannel_getCipherInstance(struct mwChannel *chan);
 enum mwChannelState mwChannel_getState(struct mwChannel *);
 
 
-/** obtain the value for a statistic field as a gpointer */
+/** obtain the value for a statistic field as a gpointer. Counters
+    are truncated to fit.
+    @see mwChannel_getStatistics */
 gpointer mwChannel_getStatistic(struct mwChannel *chan,
 				enum mwChannelStatField stat);
 
 
+/** copy all of a channel's statistics into out */
+void mwChannel_getStatistics(struct mwChannel *chan,
+			     struct mwChannelStats *out);
+
+
+/** Limit the bytes of message data which may be queued on a channel
+    while waiting for it to open. Sends beyond the limit return
+    MW_CHANNEL_WOULD_BLOCK. Incoming data beyond the limit causes the
+    channel to be destroyed. Zero for no limit, which is the
+    default. */
+void mwChannel_setQueueLimit(struct mwChannel *chan, gsize bytes);
+
+
+gsize mwChannel_getQueueLimit(struct mwChannel *chan);
+
+
+/** bytes of message data currently queued on a channel */
+gsize mwChannel_getQueuedBytes(struct mwChannel *chan);
+
+
 /** Formally open a channel.
 
     For outgoing channels: instruct the session to send a channel
@@ -352,6 +433,16 @@ int mwChannel_sendEncrypted(struct mwChannel *chan,
 			    gboolean encrypt);
 
 
+/** Compose a send-on-channel message whose data is len bytes of the
+    file fd from offset, and send it through the session's io_sendfile
+    handler, so that the data needn't pass through the library. The
+    channel must be open, and without a cipher.
+
+    @see mwSession_sendFile */
+int mwChannel_sendFile(struct mwChannel *chan, guint32 msg_type,
+		       int fd, guint64 offset, gsize len);
+
+
 /** pass a create message to a channel for handling */
 void mwChannel_recvCreate(struct mwChannel *chan,
 			  struct mwMsgChannelCreate *msg);
@@ -367,7 +458,12 @@ void mwChannel_recvDestroy(struct mwChannel *chan,
 			   struct mwMsgChannelDestroy *msg);
 
 
-/** Feed data into a channel. */
+/** Feed data into a channel. If the channel is not yet open, the
+    message is queued by taking over its head attribs and data, which
+    are left empty. The session decodes such messages as usual, rather
+    than into its arena. One in the arena regardless is copied, once,
+    and left as it was. The caller remains responsible for freeing msg
+    itself. */
 void mwChannel_recv(struct mwChannel *chan, struct mwMsgChannelSend *msg);
 
 
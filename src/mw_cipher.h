@@ -62,6 +62,14 @@ typedef int (*mwCipherProcessor)
      (struct mwCipherInstance *ci, struct mwOpaque *data);
 
 
+/** Process the given data into a freshly allocated buffer, leaving
+    the original untouched, so that data which isn't the caller's to
+    free needn't be copied first */
+typedef int (*mwCipherCopyProcessor)
+     (struct mwCipherInstance *ci,
+      const struct mwOpaque *in, struct mwOpaque *out);
+
+
 /** A cipher. Ciphers are primarily used to provide cipher instances
     for bi-directional encryption on channels, but some may be used
     for other activities. Expand upon this structure to create a
@@ -96,6 +104,9 @@ struct mwCipher {
   /** clean up a cipher instance before being free'd
       @see mwCipherInstance_free */
   void (*clear_instance)(struct mwCipherInstance *ci);
+
+  /** optional. @see mwCipherInstance_encryptCopy */
+  mwCipherCopyProcessor encrypt_copy;
 };
 
 
@@ -173,6 +184,14 @@ int mwCipherInstance_encrypt(struct mwCipherInstance *ci,
 			     struct mwOpaque *data);
 
 
+/** encrypt in into a new buffer in out, without altering in. Falls
+    back on copying in and encrypting the copy for ciphers without an
+    encrypt_copy processor */
+int mwCipherInstance_encryptCopy(struct mwCipherInstance *ci,
+				 const struct mwOpaque *in,
+				 struct mwOpaque *out);
+
+
 /** decrypt data */
 int mwCipherInstance_decrypt(struct mwCipherInstance *ci,
 			     struct mwOpaque *data);
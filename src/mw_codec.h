@@ -0,0 +1,100 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_CODEC_H
+#define _MW_CODEC_H
+
+
+/* Table-driven codecs for the common types and messages.
+
+   A structure whose wire form is a plain sequence of fields is
+   described by a table of mwField, one per field in wire order, each
+   naming the field's kind and the offset of its member. The mwCodec
+   functions then read, write, clear and clone the structure from the
+   table. Each run of consecutive fixed-size fields is checked against
+   the buffer once, and then read or written without further checks.
+
+   Parts of a structure which are only present depending on an earlier
+   field are described by a table of their own, and handled by hand
+   around the calls. */
+
+
+#include <glib.h>
+
+#include "mw_common.h"
+
+
+enum mwFieldKind {
+  mwField_U16,           /**< guint16 */
+  mwField_U32,           /**< guint32 */
+  mwField_BOOL,          /**< gboolean, as a single byte */
+  mwField_STRING,        /**< char *, as per mwString_get */
+  mwField_OPAQUE,        /**< struct mwOpaque */
+  mwField_ID_BLOCK,      /**< struct mwIdBlock */
+  mwField_LOGIN_INFO,    /**< struct mwLoginInfo */
+  mwField_USER_STATUS,   /**< struct mwUserStatus */
+  mwField_PRIVACY_INFO,  /**< struct mwPrivacyInfo */
+};
+
+
+struct mwField {
+  enum mwFieldKind kind;
+  gsize offset;  /**< of the member within its structure */
+};
+
+
+struct mwCodec {
+  const struct mwField *fields;
+  guint count;
+};
+
+
+/** describe member of struct type as a field of the given kind */
+#define MW_FIELD(kind, type, member) \
+  { mwField_ ## kind, G_STRUCT_OFFSET(struct type, member) }
+
+
+/** a codec for a static array of mwField */
+#define MW_CODEC(fields) \
+  { (fields), G_N_ELEMENTS(fields) }
+
+
+/** read the fields described by the codec into obj. Stops at the first
+    field the buffer doesn't have enough data for, setting its error
+    flag */
+void mwCodec_get(struct mwGetBuffer *b, const struct mwCodec *c,
+		 gpointer obj);
+
+
+/** write the fields described by the codec from obj */
+void mwCodec_put(struct mwPutBuffer *b, const struct mwCodec *c,
+		 gconstpointer obj);
+
+
+/** free and zero the fields described by the codec in obj */
+void mwCodec_clear(const struct mwCodec *c, gpointer obj);
+
+
+/** deep-copy the fields described by the codec from one object to
+    another */
+void mwCodec_clone(const struct mwCodec *c, gpointer to,
+		   gconstpointer from);
+
+
+#endif /* _MW_CODEC_H */
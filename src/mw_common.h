@@ -74,6 +74,10 @@ struct mwPutBuffer;
     buffer to be read from */
 struct mwGetBuffer;
 
+/** @struct mwArena
+    memory handed out in pieces and reclaimed all at once */
+struct mwArena;
+
 
 /** A length of binary data, not null-terminated. */
 struct mwOpaque {
@@ -223,6 +227,35 @@ struct mwEncryptItem {
 };
 
 
+/** @name arena allocation functions */
+/*@{*/
+
+
+/** allocate a new, empty arena */
+struct mwArena *mwArena_new(void);
+
+
+/** allocate len bytes from the arena, aligned for any type. The
+    memory is valid until the arena is reset or free'd */
+gpointer mwArena_alloc(struct mwArena *a, gsize len);
+
+
+/** as mwArena_alloc, with the memory zeroed */
+gpointer mwArena_alloc0(struct mwArena *a, gsize len);
+
+
+/** release everything allocated from the arena at once, keeping a
+    block of memory for reuse */
+void mwArena_reset(struct mwArena *a);
+
+
+/** destroy the arena, and everything allocated from it */
+void mwArena_free(struct mwArena *a);
+
+
+/*@}*/
+
+
 /** @name buffer utility functions */
 /*@{*/
 
@@ -273,6 +306,24 @@ struct mwGetBuffer *mwGetBuffer_wrap(const struct mwOpaque *data);
 void mwGetBuffer_free(struct mwGetBuffer *b);
 
 
+/** as mwGetBuffer_wrap, but the buffer itself is allocated from the
+    arena, which is also set as the buffer's arena. Freeing the buffer
+    is still safe, and does nothing. */
+struct mwGetBuffer *mwGetBuffer_wrapArena(const struct mwOpaque *data,
+					  struct mwArena *arena);
+
+
+/** Have everything read from the buffer by the _get functions
+    allocated from an arena instead of individually, or NULL to stop.
+    Whatever is read then lasts only until the arena is reset, and
+    mustn't be cleared or free'd, only cloned. */
+void mwGetBuffer_setArena(struct mwGetBuffer *b, struct mwArena *arena);
+
+
+/** the buffer's arena, or NULL */
+struct mwArena *mwGetBuffer_getArena(struct mwGetBuffer *b);
+
+
 /** reset the buffer to the very beginning. Also clears the buffer's
     error flag. */
 void mwGetBuffer_reset(struct mwGetBuffer *b);
@@ -332,6 +383,10 @@ void mwOpaque_free(struct mwOpaque *o);
 
 void mwOpaque_clone(struct mwOpaque *to, const struct mwOpaque *from);
 
+/** move the contents of from into to without copying, leaving from
+    empty. As with clone, to should be pristine beforehand */
+void mwOpaque_steal(struct mwOpaque *to, struct mwOpaque *from);
+
 
 /*@}*/
 
@@ -379,6 +434,9 @@ void mwUserStatus_clear(struct mwUserStatus *stat);
 void mwUserStatus_clone(struct mwUserStatus *to,
 			const struct mwUserStatus *from);
 
+gboolean mwUserStatus_equal(const struct mwUserStatus *a,
+			    const struct mwUserStatus *b);
+
 
 void mwIdBlock_put(struct mwPutBuffer *b, const struct mwIdBlock *id);
 
@@ -419,6 +477,9 @@ void mwAwareSnapshot_clear(struct mwAwareSnapshot *idb);
 void mwAwareSnapshot_clone(struct mwAwareSnapshot *to,
 			   const struct mwAwareSnapshot *from);
 
+gboolean mwAwareSnapshot_equal(const struct mwAwareSnapshot *a,
+			       const struct mwAwareSnapshot *b);
+
 
 void mwEncryptItem_put(struct mwPutBuffer *b,
 		       const struct mwEncryptItem *item);
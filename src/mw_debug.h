@@ -26,6 +26,7 @@
 #include <glib.h>
 
 #include "mw_common.h"
+#include "mw_trace.h"
 
 
 /** replaces NULL strings with "(null)". useful for printf where
@@ -45,6 +46,32 @@
 #endif
 
 
+/** the installed trace handler. @see mwTrace_setHandler */
+extern const struct mwTraceHandler *mw_trace_handler;
+
+
+#ifndef MW_DISABLE_TRACE
+
+/** TRUE if the named member of the trace handler is set. Guards the
+    gathering of anything needed only for the trace */
+#define MW_TRACE_ON(hook) \
+  G_UNLIKELY(mw_trace_handler != NULL && mw_trace_handler->hook != NULL)
+
+/** call the named member of the trace handler, if it's set */
+#define MW_TRACE(hook, ...) \
+  do { if(MW_TRACE_ON(hook)) mw_trace_handler->hook(__VA_ARGS__); } while(0)
+
+#else
+
+/* the call is kept, though never made, so that the arguments are
+   still type-checked and counted as used */
+#define MW_TRACE_ON(hook)    FALSE
+#define MW_TRACE(hook, ...) \
+  do { if(0) mw_trace_handler->hook(__VA_ARGS__); } while(0)
+
+#endif
+
+
 #ifndef MW_MAILME_ADDRESS
 /** email address used in mw_debug_mailme. */
 #define MW_MAILME_ADDRESS  "meanwhile-devel@lists.sourceforge.net"
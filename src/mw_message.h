@@ -82,7 +82,11 @@ struct mwMessage {
 struct mwMessage *mwMessage_new(enum mwMessageType type);
 
 
-/** build a message from its representation */
+/** build a message from its representation. If the buffer has an
+    arena, the message and everything in it comes from the arena, and
+    must not be passed to mwMessage_free.
+
+    @see mwGetBuffer_setArena */
 struct mwMessage *mwMessage_get(struct mwGetBuffer *b);
 
 
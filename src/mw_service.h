@@ -113,6 +113,20 @@ typedef void (*mwService_funcRecv)
       guint16 msg_type,
       struct mwOpaque *data);
 
+typedef void (*mwService_funcDrained)
+     (struct mwService *service,
+      struct mwChannel *channel);
+
+
+/** An entry in a service's dispatch table, pairing a
+    service-dependant message type with its input handler.
+
+    @relates mwService_setHandlers */
+struct mwServiceHandler {
+  guint16 msg_type;            /**< the message type handled */
+  mwService_funcRecv recv;     /**< handler for that message type */
+};
+
 
 /** A service is the recipient of sendOnCnl messages sent over
     channels marked with the corresponding service id. Services
@@ -206,6 +220,22 @@ struct mwService {
       @relates mwService_getClientData
       @relates mwService_setClientData */
   GDestroyNotify client_cleanup;
+
+  /** Optional. The service's drain handler. Called when a channel
+      which had refused a send with MW_CHANNEL_WOULD_BLOCK has room
+      in its queue again.
+
+      @relates mwService_drained */
+  mwService_funcDrained drained;
+
+  /** Dense table of input handlers, indexed by message type less
+      dispatch_base. Types outside of the table, or with a NULL entry,
+      go to mwService::recv. Should not be set by hand.
+
+      @relates mwService_setHandlers */
+  mwService_funcRecv *dispatch;
+  guint16 dispatch_base;  /**< lowest message type in dispatch */
+  guint32 dispatch_len;   /**< count of entries in dispatch */
 };
 
 
@@ -230,6 +260,20 @@ void mwService_init(struct mwService *service,
 		    guint32 service_type);
 
 
+/** Registers per-type input handlers for a service, replacing any
+    registered before. The handlers are copied into a table indexed
+    directly by message type, so that incoming data is dispatched
+    without searching. Message types without a handler continue to
+    be given to mwService::recv.
+
+    @param service   the service to register handlers for
+    @param handlers  array of message type and handler pairs
+    @param count     count of entries in handlers */
+void mwService_setHandlers(struct mwService *service,
+			   const struct mwServiceHandler *handlers,
+			   guint count);
+
+
 /** Indicate that a service is started. To be used by service
     implementations when the service is fully started. */
 void mwService_started(struct mwService *service);
@@ -292,6 +336,14 @@ void mwService_recv(struct mwService *service,
 		    struct mwOpaque *data);
 
 
+/** Triggers the drain handler on the service
+
+    @param service  the service owning the channel
+    @param channel  the channel which may be sent on again */
+void mwService_drained(struct mwService *service,
+		       struct mwChannel *channel);
+
+
 /** @return the appropriate type id for the service */
 guint32 mwService_getType(struct mwService *);
 
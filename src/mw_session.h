@@ -56,6 +56,7 @@ struct mwChannelSet;
 struct mwCipher;
 struct mwMessage;
 struct mwService;
+struct mwTimerWheel;
 
 
 /** default protocol major version */
@@ -191,6 +192,12 @@ struct mwSessionHandler {
   void (*on_announce)(struct mwSession *, struct mwLoginInfo *from,
 		      gboolean may_reply, const char *text);
 
+  /** write len bytes of the file fd, from offset, to the server
+      connection, following whatever was last written with io_write.
+      Optional. Lets file transfers over unencrypted channels be sent
+      with sendfile, without the data passing through the library.
+      Should return zero for success, non-zero for error */
+  int (*io_sendfile)(struct mwSession *, int fd, guint64 offset, gsize len);
 };
 
 
@@ -222,6 +229,12 @@ void mwSession_stop(struct mwSession *, guint32 reason);
 void mwSession_recv(struct mwSession *, const guchar *, gsize);
 
 
+/** TRUE while the message being handled was decoded into the
+    session's arena, and so only lasts until its handler returns.
+    Anything to be kept from such a message must be copied */
+gboolean mwSession_isArenaMessage(struct mwSession *);
+
+
 /** primarily used by services to have messages serialized and sent
     @param s    session to send message over
     @param msg  message to serialize and send
@@ -229,6 +242,15 @@ void mwSession_recv(struct mwSession *, const guchar *, gsize);
 int mwSession_send(struct mwSession *s, struct mwMessage *msg);
 
 
+/** send a send-on-channel message whose data is len bytes of the
+    file fd from offset. The message's own data is ignored. The frame
+    header is written with io_write, and the data with io_sendfile
+    @returns    0 for success, or -1 if the session's handler has no
+                io_sendfile */
+int mwSession_sendFile(struct mwSession *s, struct mwMessage *msg,
+		       int fd, guint64 offset, gsize len);
+
+
 /** sends the keepalive byte */
 int mwSession_sendKeepalive(struct mwSession *s);
 
@@ -295,6 +317,27 @@ gpointer mwSession_getStateInfo(struct mwSession *);
 struct mwChannelSet *mwSession_getChannels(struct mwSession *);
 
 
+/** attach a timer wheel to the session, which will then be used for
+    its keepalives and for timeouts in its channels and services. The
+    wheel may be shared among many sessions, and must outlive them.
+    Should be set before the session is started. */
+void mwSession_setTimerWheel(struct mwSession *, struct mwTimerWheel *);
+
+
+/** the session's timer wheel, or NULL if none has been set */
+struct mwTimerWheel *mwSession_getTimerWheel(struct mwSession *);
+
+
+/** send a keepalive whenever the session has been started and nothing
+    has been written to the server for the given count of seconds.
+    Needs a timer wheel. Zero, the default, disables keepalives */
+void mwSession_setKeepalive(struct mwSession *, guint seconds);
+
+
+/** the keepalive interval in seconds, or zero if disabled */
+guint mwSession_getKeepalive(struct mwSession *);
+
+
 /** adds a service to the session. If the session is started (or when
     the session is successfully started) and the service has a start
     function, the session will request service availability from the
@@ -0,0 +1,149 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_SESSION_POOL_H
+#define _MW_SESSION_POOL_H
+
+
+/** @file mw_session_pool.h
+
+    An optional I/O engine for hosting many sessions in one process.
+
+    The rest of the library leaves all I/O to the client. Where a
+    client has thousands of sessions to run, it may instead hand each
+    session's connected socket to a session pool. The pool puts the
+    socket into non-blocking mode, watches every socket with a single
+    edge-triggered epoll instance, reads in large blocks straight into
+    mwSession_recv, and queues writes which the socket can't yet take.
+    The pool also runs a timer wheel, which it lends to any of its
+    sessions that don't already have one, for their keepalives and
+    timeouts.
+
+    To use a pool, set the io_write and io_close members of each
+    session's handler to mwSessionPool_ioWrite and
+    mwSessionPool_ioClose, add the session and its socket with
+    mwSessionPool_add, then call mwSessionPool_run repeatedly. Setting
+    io_sendfile to mwSessionPool_ioSendfile as well lets unencrypted
+    file transfers go from file to socket without passing through the
+    library.
+
+    Only built on systems which provide epoll.
+*/
+
+
+#include "mw_common.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct mwSession;
+struct mwTimerWheel;
+
+
+/** @struct mwSessionPool
+    A set of sessions sharing a single poll loop */
+struct mwSessionPool;
+
+
+/** allocate a new, empty session pool */
+struct mwSessionPool *mwSessionPool_new(void);
+
+
+/** free a session pool, closing the sockets of any sessions still in
+    it. The sessions themselves are not free'd */
+void mwSessionPool_free(struct mwSessionPool *pool);
+
+
+/** the pool's epoll file descriptor, which becomes readable whenever
+    mwSessionPool_run has work to do. Allows a pool to be nested in
+    another event loop */
+int mwSessionPool_getFd(struct mwSessionPool *pool);
+
+
+/** the pool's timer wheel, run from mwSessionPool_run */
+struct mwTimerWheel *mwSessionPool_getTimerWheel(struct mwSessionPool *pool);
+
+
+/** add a session and its connected socket to the pool. The pool takes
+    ownership of the socket, and will close it when the session's
+    connection is closed or the session is removed.
+
+    @returns zero for success, non-zero if the session is already in
+    a pool or the socket could not be watched */
+int mwSessionPool_add(struct mwSessionPool *pool,
+		      struct mwSession *session, int sock);
+
+
+/** remove a session from the pool and close its socket, discarding
+    anything still waiting to be written */
+void mwSessionPool_remove(struct mwSessionPool *pool,
+			  struct mwSession *session);
+
+
+/** set the keepalive interval of every session in the pool, and of
+    sessions added later. Zero disables their keepalives. Until this
+    is called, each session keeps its own setting.
+    @see mwSession_setKeepalive */
+void mwSessionPool_setKeepalive(struct mwSessionPool *pool,
+				guint seconds);
+
+
+/** @returns the keepalive interval in seconds */
+guint mwSessionPool_getKeepalive(struct mwSessionPool *pool);
+
+
+/** wait up to timeout milliseconds for activity on any of the pool's
+    sockets, and handle all that is found. A timeout of zero returns
+    immediately, and a negative timeout waits indefinitely, or until
+    the next timer on the pool's wheel is due.
+
+    @returns the count of sockets handled, or -1 on error */
+int mwSessionPool_run(struct mwSessionPool *pool, int timeout);
+
+
+/** for use as mwSessionHandler::io_write of pooled sessions. Writes as
+    much as the socket will take immediately, and queues the rest to
+    be written as the socket becomes ready */
+int mwSessionPool_ioWrite(struct mwSession *session,
+			  const guchar *buf, gsize len);
+
+
+/** for use as mwSessionHandler::io_sendfile of pooled sessions. With
+    nothing already queued, uses sendfile for as much as the socket
+    will take immediately. The rest is read into the queue, so that it
+    stays in order with later writes */
+int mwSessionPool_ioSendfile(struct mwSession *session, int fd,
+			     guint64 offset, gsize len);
+
+
+/** for use as mwSessionHandler::io_close of pooled sessions. Makes a
+    last attempt at writing anything queued, then closes the socket
+    and removes the session from its pool */
+void mwSessionPool_ioClose(struct mwSession *session);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _MW_SESSION_POOL_H */
@@ -0,0 +1,131 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_SESSION_SHARDS_H
+#define _MW_SESSION_SHARDS_H
+
+
+/** @file mw_session_shards.h
+
+    Runs sessions across several threads, for using every core.
+
+    Sessions are not thread-safe, and nothing in the rest of the
+    library takes a lock. A shard set instead pins each session to one
+    of a fixed count of worker threads, each of which runs its own
+    mwSessionPool. A session, and every callback it triggers, is then
+    only ever touched from its own shard's thread.
+
+    Work for a session which originates on any other thread is handed
+    to that session's thread with mwSessionShards_call, which pushes
+    onto a lock-free queue owned by the shard. For example, to send an
+    IM as session B from within a callback of session A, call a
+    function which sends the IM via mwSessionShards_call on session B.
+
+    Pooled sessions must use mwSessionPool_ioWrite and
+    mwSessionPool_ioClose in their handlers, as with a single pool.
+    Like the session pool, only built on systems which provide epoll.
+*/
+
+
+#include "mw_common.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct mwSession;
+
+
+/** @struct mwSessionShards
+    A set of worker threads, each running a pool of sessions */
+struct mwSessionShards;
+
+
+/** A function to run on a session's own thread */
+typedef void (*mwSessionShards_func)(struct mwSession *session,
+				     gpointer data);
+
+
+/** start a new set of count worker threads */
+struct mwSessionShards *mwSessionShards_new(guint count);
+
+
+/** stop and join every worker thread, close the sockets of any
+    sessions still pooled, and free the set. Calls still queued are
+    dropped, having their data's destroy function called, and the
+    sockets of adds still queued are closed. Must not be
+    called from one of the set's own threads. The sessions themselves
+    are not free'd */
+void mwSessionShards_free(struct mwSessionShards *shards);
+
+
+/** @returns the count of worker threads in the set */
+guint mwSessionShards_getCount(struct mwSessionShards *shards);
+
+
+/** @returns the index of the worker thread a session is pinned to.
+    Depends only on the session, and so may be asked from any thread */
+guint mwSessionShards_getShard(struct mwSessionShards *shards,
+			       struct mwSession *session);
+
+
+/** hand a session and its connected socket to the session's shard,
+    which adds them to its pool. From here on the session should only
+    be used from its shard's thread, via mwSessionShards_call. Safe
+    from any thread */
+void mwSessionShards_add(struct mwSessionShards *shards,
+			 struct mwSession *session, int sock);
+
+
+/** have the session's shard remove it from its pool, closing its
+    socket. Safe from any thread */
+void mwSessionShards_remove(struct mwSessionShards *shards,
+			    struct mwSession *session);
+
+
+/** run func with the session and data on the session's own thread,
+    soon after. Calls made from the same thread for sessions on the
+    same shard run in the order they were made. Safe from any thread.
+
+    @param shards   the shard set
+    @param session  the session to run func for
+    @param func     the function to run
+    @param data     passed to func
+    @param clear    optional, called with data once func has run, or
+                    if the call is dropped */
+void mwSessionShards_call(struct mwSessionShards *shards,
+			  struct mwSession *session,
+			  mwSessionShards_func func,
+			  gpointer data, GDestroyNotify clear);
+
+
+/** set the keepalive interval of every shard's pool.
+    @see mwSessionPool_setKeepalive */
+void mwSessionShards_setKeepalive(struct mwSessionShards *shards,
+				  guint seconds);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _MW_SESSION_SHARDS_H */
@@ -94,6 +94,13 @@ typedef void (*mwAwareAttributeHandler)
 struct mwAwareHandler {
   mwAwareAttributeHandler on_attrib;
   void (*clear)(struct mwServiceAware *srvc);
+
+  /** optional. Called when an aware addition or removal is held back
+      by a coalescing window which had nothing pending. Client code
+      should arrange for mwServiceAware_flush to be called once
+      window_ms milliseconds have elapsed.
+      @see mwServiceAware_setCoalesceWindow */
+  void (*schedule_flush)(struct mwServiceAware *srvc, guint window_ms);
 };
 
 
@@ -139,6 +146,45 @@ mwServiceAware_new(struct mwSession *session,
 		   struct mwAwareHandler *handler);
 
 
+/** Hold back aware additions and removals for up to window_ms
+    milliseconds, so that they may be sent upstream together. Within
+    the window, an addition and a removal of the same ID cancel each
+    other out. A window of zero (the default) sends each change
+    immediately, and flushes anything already pending.
+
+    Because the library has no timer of its own, the handler's
+    schedule_flush call-back is triggered when a window opens, and it
+    is up to client code to call mwServiceAware_flush when it closes.
+*/
+void mwServiceAware_setCoalesceWindow(struct mwServiceAware *srvc,
+				      guint window_ms);
+
+
+guint mwServiceAware_getCoalesceWindow(struct mwServiceAware *srvc);
+
+
+/** Send any pending aware additions and removals as (at most) one
+    AWARE_ADD and one AWARE_REMOVE message.
+    @return  0 for success, non-zero to indicate an error. */
+int mwServiceAware_flush(struct mwServiceAware *srvc);
+
+
+/** Spread the watched IDs across count buddy list channels, each
+    holding the IDs which hash to it. Lists are unaffected by the
+    partitioning. Can only be changed while the service is stopped.
+    @return  0 for success, non-zero to indicate an error. */
+int mwServiceAware_setShardCount(struct mwServiceAware *srvc, guint count);
+
+
+guint mwServiceAware_getShardCount(struct mwServiceAware *srvc);
+
+
+/** Count of status updates which were identical to the last known
+    status for that user, and so did not trigger any on_aware
+    call-backs */
+guint64 mwServiceAware_getSuppressedCount(struct mwServiceAware *srvc);
+
+
 /** Set an attribute value for this session */
 int mwServiceAware_setAttribute(struct mwServiceAware *srvc,
 				guint32 key, struct mwOpaque *opaque);
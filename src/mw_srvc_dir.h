@@ -94,7 +94,10 @@ struct mwDirectoryMember {
 };
 
 
-/** Appropriate function signature for handling directory search results */
+/** Appropriate function signature for handling directory search
+    results. Called with each page of results as it becomes available,
+    whether fetched or cached. The members belong to the service, and
+    are only valid for the duration of the call */
 typedef void (*mwSearchHandler)
      (struct mwDirectory *dir,
       guint32 code, guint32 offset, GList *members);
@@ -130,6 +133,17 @@ struct mwDirectoryHandler *
 mwServiceDirectory_getHandler(struct mwServiceDirectory *srvc);
 
 
+/** Fetch up to prefetch pages of search results ahead of the one
+    being viewed, and keep up to cache pages for each address book,
+    shared by all of its directories. A page which is already kept is
+    handed over by mwDirectory_next, mwDirectory_previous or
+    mwDirectory_search before they return, with no round-trip. Both
+    default to zero, each page then being fetched when it's asked
+    for. Prefetching is limited to the pages which may be kept. */
+void mwServiceDirectory_setPaging(struct mwServiceDirectory *srvc,
+				  guint prefetch, guint cache);
+
+
 /** most recent list of address books available in service */
 GList *mwServiceDirectory_getAddressBooks(struct mwServiceDirectory *srvc);
 
@@ -185,11 +199,16 @@ struct mwAddressBook *mwDirectory_getAddressBook(struct mwDirectory *dir);
 int mwDirectory_open(struct mwDirectory *dir, mwSearchHandler cb);
 
 
-/** continue a search into its next results */
+/** continue a search into its next results. On a directory which
+    hasn't been searched, lists its first page instead.
+
+    @returns -1 if there are known to be no more results */
 int mwDirectory_next(struct mwDirectory *dir);
 
 
-/** continue a search into its previous results */
+/** continue a search into its previous results
+
+    @returns -1 if already at the first page */
 int mwDirectory_previous(struct mwDirectory *dir);
 
 
@@ -93,6 +93,19 @@ enum mwFileTranferCode {
 };
 
 
+/** file transfer counters, as a snapshot taken by
+    mwFileTransfer_getStats */
+struct mwFileTransferStats {
+  guint64 bytes;      /**< bytes sent or received */
+  guint64 acks;       /**< acknowledgements received or sent */
+  guint in_flight;    /**< chunks sent and not yet acknowledged */
+  guint64 usec;       /**< microseconds since the transfer opened */
+  guint64 rate;       /**< average bytes per second since then */
+  guint64 queued;     /**< bytes yet to be sent or received */
+  guint64 eta;        /**< microseconds until done at rate, or 0 */
+};
+
+
 struct mwFileTransferHandler {
 
   /** an incoming file transfer has been offered */
@@ -132,6 +145,18 @@ const GList *
 mwServiceFileTransfer_getTransfers(struct mwServiceFileTransfer *srvc);
 
 
+/** Limit the transfers sent with mwFileTransfer_sendFile to rate bytes
+    per second between them, or zero for no limit, the default. Needs a
+    timer wheel on the session to wait for the budget, without one the
+    rate isn't limited. Within the budget and their windows, transfers
+    take turns at sending, each sending as many chunks a turn as its
+    weight.
+
+    @see mwFileTransfer_setWeight */
+void mwServiceFileTransfer_setBudget(struct mwServiceFileTransfer *srvc,
+				     guint64 rate);
+
+
 struct mwFileTransfer *
 mwFileTransfer_new(struct mwServiceFileTransfer *srvc,
 		   const struct mwIdBlock *who, const char *msg,
@@ -231,6 +256,78 @@ int mwFileTransfer_send(struct mwFileTransfer *ft,
 int mwFileTransfer_ack(struct mwFileTransfer *ft);
 
 
+/** Send the whole of an open outbound transfer from a file, reading
+    from offset onwards. Nothing may have been sent on the transfer
+    with mwFileTransfer_send beforehand. Chunks are sent as the window
+    allows, more being sent as each is acknowledged, so that nothing
+    more is needed from the client but to keep the session running.
+    The file is closed once the transfer has been sent or closed. Read
+    errors close the transfer with ERR_FAILURE.
+
+    Where the session handler has an io_sendfile and the channel isn't
+    encrypted, the data is written straight from the file by
+    io_sendfile. Otherwise the file is mapped, where possible, and
+    chunks are sent from the mapping rather than read into a buffer.
+
+    @see mwFileTransfer_setWindow
+    @see mwServiceFileTransfer_setBudget */
+int mwFileTransfer_sendFile(struct mwFileTransfer *ft, int fd,
+			    guint64 offset);
+
+
+/** Set the most chunks mwFileTransfer_sendFile may have sent but not
+    yet acknowledged, and the size of each. The window is held to at
+    least 4 chunks, so that a receiver batching its acks is never left
+    waiting, and to at most 1 MB worth of chunks, as that's what may
+    be left queued on the session. Chunks may be at most 256 KB. The
+    default is 4 chunks of 8 KB.
+    The chunk size may not be changed while a file is being read into
+    a buffer. */
+void mwFileTransfer_setWindow(struct mwFileTransfer *ft,
+			      guint window, gsize chunk);
+
+
+/** Receive an inbound transfer straight into a file, writing from
+    offset onwards. Each chunk is written where it belongs as it
+    arrives, and acknowledged automatically as set by
+    mwFileTransfer_setAckBatch, rather than being handed to
+    mwFileTransferHandler::ft_recv. The file is closed once the
+    transfer has been received or closed. Write errors close the
+    transfer with ERR_FAILURE. Must be called before any data has
+    arrived, typically from ft_offered or ft_opened. */
+int mwFileTransfer_recvFile(struct mwFileTransfer *ft, int fd,
+			    guint64 offset);
+
+
+/** As mwFileTransfer_recvFile, but into a region of memory at least
+    mwFileTransfer_getFileSize bytes long, such as a writable mapping
+    of the destination file. The region remains the caller's, and must
+    stay valid until the transfer is done or closed. */
+int mwFileTransfer_recvBuffer(struct mwFileTransfer *ft,
+			      guchar *buf, gsize len);
+
+
+/** Acknowledge only every chunks-th chunk received by
+    mwFileTransfer_recvFile or mwFileTransfer_recvBuffer, and the last.
+    The default of one acks every chunk, as the protocol expects. A
+    batched ack carries the count of chunks it covers, which
+    mwFileTransfer_sendFile takes off its window. Batches are held to
+    four chunks, the smallest window a sender of ours may have, so a
+    full window is always acked. */
+void mwFileTransfer_setAckBatch(struct mwFileTransfer *ft, guint chunks);
+
+
+/** Set how many chunks a transfer sent with mwFileTransfer_sendFile
+    may send each time its turn comes, relative to the other transfers
+    on the same service. The default is one. */
+void mwFileTransfer_setWeight(struct mwFileTransfer *ft, guint weight);
+
+
+/** take a snapshot of a transfer's counters and throughput */
+void mwFileTransfer_getStats(struct mwFileTransfer *ft,
+			     struct mwFileTransferStats *stats);
+
+
 void mwFileTransfer_setClientData(struct mwFileTransfer *ft,
 				  gpointer data, GDestroyNotify clean);
 
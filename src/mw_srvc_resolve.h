@@ -96,12 +96,39 @@ struct mwResolveResult {
   guint32 code;    /**< @see mwResolveCode */
   char *name;      /**< name of the result */
   GList *matches;  /**< list of mwResolveMatch */
+
+  guint32 match_count;  /**< count of matches */
+  struct mwResolveMatch *match_array;  /**< the same matches, in order */
+};
+
+
+/** count of matches in a result */
+guint mwResolveResult_getMatchCount(const struct mwResolveResult *r);
+
+
+/** the nth match in a result, or NULL if there are fewer. Together
+    with mwResolveResult_getMatchCount, walks the matches without
+    following the list */
+struct mwResolveMatch *
+mwResolveResult_getMatch(const struct mwResolveResult *r, guint n);
+
+
+/** resolve cache counters, as a snapshot taken by
+    mwServiceResolve_getCacheStats */
+struct mwResolveCacheStats {
+  guint64 hits;     /**< requests answered from the cache */
+  guint64 misses;   /**< requests sent on for want of a cached result */
+  guint64 evicted;  /**< results dropped to make room for newer ones */
+  guint64 expired;  /**< results dropped for being older than the TTL */
+  guint entries;    /**< results presently cached */
 };
 
 
 /** Handle the results of a resolve request. If there was a cleanup
     function specified to mwServiceResolve_search, it will be called
-    upon the user data after this callback returns.
+    upon the user data after this callback returns. The results, and
+    everything they point to, belong to the service and are only
+    valid until then.
 
     @param srvc     the resolve service
     @param id       the resolve request ID
@@ -128,6 +155,9 @@ struct mwServiceResolve *mwServiceResolve_new(struct mwSession *);
     @param data     optional user data attached to the request
     @param cleanup  optional function to clean up user data
     @return         generated ID for the search request, or SEARCH_ERROR
+
+    If the cache is enabled and holds a result for every query, the
+    handler is called before this returns, and nothing is sent.
 */
 guint32 mwServiceResolve_resolve(struct mwServiceResolve *srvc,
 				 GList *queries, enum mwResolveFlag flags,
@@ -141,6 +171,53 @@ guint32 mwServiceResolve_resolve(struct mwServiceResolve *srvc,
 void mwServiceResolve_cancelResolve(struct mwServiceResolve *, guint32);
 
 
+/** Fail resolve requests which haven't been answered within msec
+    milliseconds. Their handler is called with the code
+    CONNECTION_TIMED and no results. Needs a timer wheel on the
+    session. Zero, the default, waits indefinitely. Applies to
+    requests made afterwards. */
+void mwServiceResolve_setTimeout(struct mwServiceResolve *srvc,
+				 guint msec);
+
+
+/** @returns the request timeout in milliseconds, or zero */
+guint mwServiceResolve_getTimeout(struct mwServiceResolve *srvc);
+
+
+/** Gather single-query requests with the same flags for up to msec
+    milliseconds, or until max have been gathered, and send them as
+    one. A query already waiting for an answer isn't asked again, its
+    answer goes to every request for it. Needs a timer wheel on the
+    session to wait at all, without one each request is still sent
+    immediately. A max of one or zero, the default, disables this,
+    sending anything already gathered.
+
+    A batched request may fail after mwServiceResolve_resolve has
+    returned its ID, in which case its handler is called with the
+    code ERR_FAILURE and no results. */
+void mwServiceResolve_setCoalesce(struct mwServiceResolve *srvc,
+				  guint msec, guint max);
+
+
+/** Cache the results of up to size queries, each for ttl seconds,
+    keyed by query string and flags. Names which can't be resolved
+    are cached as well as those which can. Once enabled, a request
+    whose every query is in the cache is answered from it. A ttl of
+    zero keeps results until they are pushed out by newer ones. A size
+    of zero, the default, disables and empties the cache. */
+void mwServiceResolve_setCache(struct mwServiceResolve *srvc,
+			       guint size, guint ttl);
+
+
+/** forget every cached result, leaving the cache enabled */
+void mwServiceResolve_clearCache(struct mwServiceResolve *srvc);
+
+
+/** take a snapshot of the cache counters */
+void mwServiceResolve_getCacheStats(struct mwServiceResolve *srvc,
+				    struct mwResolveCacheStats *stats);
+
+
 #ifdef __cplusplus
 }
 #endif
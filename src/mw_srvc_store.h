@@ -100,6 +100,18 @@ typedef void (*mwStorageCallback)
 struct mwServiceStorage *mwServiceStorage_new(struct mwSession *);
 
 
+/** Fail load and save requests which haven't completed within msec
+    milliseconds. Their callback receives the result CONNECTION_TIMED.
+    Needs a timer wheel on the session. Zero, the default, waits
+    indefinitely. Applies to requests made afterwards. */
+void mwServiceStorage_setTimeout(struct mwServiceStorage *srvc,
+				 guint msec);
+
+
+/** @returns the request timeout in milliseconds, or zero */
+guint mwServiceStorage_getTimeout(struct mwServiceStorage *srvc);
+
+
 /** create an empty storage unit */
 struct mwStorageUnit *mwStorageUnit_new(guint32 key);
 
@@ -0,0 +1,123 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_TIMER_H
+#define _MW_TIMER_H
+
+
+/** @file mw_timer.h
+
+    A hierarchical timer wheel, for driving session keepalives and
+    request timeouts across any number of sessions.
+
+    The library still doesn't run an event loop of its own. A client
+    creates a wheel, attaches it to its sessions with
+    mwSession_setTimerWheel, and calls mwTimerWheel_run whenever
+    mwTimerWheel_getTimeout says something may be due. One wheel may
+    be shared by every session on a thread.
+
+    Timers are embedded in the structures they belong to, so
+    scheduling allocates nothing, and both scheduling and cancelling a
+    timer take constant time. The wheel has a resolution of one
+    millisecond.
+*/
+
+
+#include "mw_common.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct mwTimer;
+
+
+/** @struct mwTimerWheel
+    A set of pending timers, and the clock they are measured by */
+struct mwTimerWheel;
+
+
+/** called when a timer expires. The timer is no longer pending, and
+    may be scheduled again from within the call */
+typedef void (*mwTimer_func)(struct mwTimer *timer, gpointer data);
+
+
+/** A single timer. Should be initialized with mwTimer_init, and not
+    otherwise set or checked by hand */
+struct mwTimer {
+  struct mwTimer *next;    /**< next timer in the same wheel slot */
+  struct mwTimer **pprev;  /**< link pointing to this, NULL if idle */
+  struct mwTimerWheel *wheel;  /**< wheel this is pending in */
+  guint64 expires;         /**< wheel time at which this is due */
+  guint level;             /**< wheel level this is pending in */
+
+  mwTimer_func func;
+  gpointer data;
+};
+
+
+/** allocate a new timer wheel, with its clock starting at zero */
+struct mwTimerWheel *mwTimerWheel_new(void);
+
+
+/** free a timer wheel. Any timers still pending are cancelled
+    without being called */
+void mwTimerWheel_free(struct mwTimerWheel *wheel);
+
+
+/** the wheel's clock in milliseconds, as of its last run */
+guint64 mwTimerWheel_getTime(struct mwTimerWheel *wheel);
+
+
+/** call every timer which has come due */
+void mwTimerWheel_run(struct mwTimerWheel *wheel);
+
+
+/** @returns the milliseconds until mwTimerWheel_run should next be
+    called, or -1 if there are no pending timers. May be sooner than
+    the next timer is actually due */
+gint mwTimerWheel_getTimeout(struct mwTimerWheel *wheel);
+
+
+/** prepare a timer for use. The timer is idle until scheduled */
+void mwTimer_init(struct mwTimer *timer, mwTimer_func func, gpointer data);
+
+
+/** schedule a timer to be called msec milliseconds from now,
+    replacing any earlier schedule */
+void mwTimer_schedule(struct mwTimer *timer, struct mwTimerWheel *wheel,
+		      guint msec);
+
+
+/** cancel a timer if it is pending. Safe to call on an idle timer */
+void mwTimer_cancel(struct mwTimer *timer);
+
+
+/** TRUE if the timer is scheduled and hasn't yet been called */
+gboolean mwTimer_isPending(struct mwTimer *timer);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _MW_TIMER_H */
@@ -0,0 +1,106 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _MW_TRACE_H
+#define _MW_TRACE_H
+
+
+/** @file mw_trace.h
+
+    Tracing hooks on the library's hot paths.
+
+    A client wanting to observe what the library is doing, without the
+    cost of formatting log messages, may install a trace handler. Each
+    of its members is optional, and is called with the sizes involved
+    and with timestamps from mwTrace_now. Where no handler or member
+    is set, the cost at each trace point is a single predictable
+    branch. Building the library with MW_DISABLE_TRACE defined, as
+    done by configure --disable-trace, removes the trace points
+    entirely.
+*/
+
+
+#include "mw_channel.h"
+#include "mw_common.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct mwSession;
+
+
+/** A table of trace call-backs. Members left NULL are not traced */
+struct mwTraceHandler {
+
+  /** a block of data was handed to mwSession_recv */
+  void (*frame_recv)(struct mwSession *s, gsize len, guint64 ns);
+
+  /** a complete message of len bytes was parsed, as of start_ns,
+      finishing at end_ns */
+  void (*message_decoded)(struct mwSession *s, guint16 type, gsize len,
+			  guint64 start_ns, guint64 end_ns);
+
+  /** a channel changed state. reason is non-zero for errors */
+  void (*channel_state)(struct mwChannel *chan,
+			enum mwChannelState state, guint32 reason,
+			guint64 ns);
+
+  /** data sent on a channel was encrypted from in_len to out_len
+      bytes */
+  void (*cipher_encrypt)(struct mwChannel *chan,
+			 gsize in_len, gsize out_len,
+			 guint64 start_ns, guint64 end_ns);
+
+  /** data received on a channel was decrypted from in_len to out_len
+      bytes */
+  void (*cipher_decrypt)(struct mwChannel *chan,
+			 gsize in_len, gsize out_len,
+			 guint64 start_ns, guint64 end_ns);
+
+  /** data received on a channel was handed to its service, which
+      returned at end_ns */
+  void (*service_dispatch)(struct mwChannel *chan, guint16 msg_type,
+			   gsize len, guint64 start_ns, guint64 end_ns);
+};
+
+
+/** Install a trace handler for the whole library, or NULL to stop
+    tracing. The handler is not copied, and must remain valid until
+    replaced. Sessions on other threads may see the change late, so
+    it is best set before any are started. */
+void mwTrace_setHandler(const struct mwTraceHandler *handler);
+
+
+/** the installed trace handler, or NULL */
+const struct mwTraceHandler *mwTrace_getHandler(void);
+
+
+/** a monotonic clock in nanoseconds, as used for trace timestamps */
+guint64 mwTrace_now(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _MW_TRACE_H */
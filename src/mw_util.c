@@ -27,7 +27,7 @@ static void collect_keys(gpointer key, gpointer val, gpointer data) {
   (void)val;
 
   GList **list = data;
-  *list = g_list_append(*list, key);
+  *list = g_list_prepend(*list, key);
 }
 
 
@@ -44,7 +44,7 @@ static void collect_values(gpointer key, gpointer val, gpointer data) {
   (void)key;
 
   GList **list = data;
-  *list = g_list_append(*list, val);
+  *list = g_list_prepend(*list, val);
 }
 
 
@@ -52,12 +52,38 @@
   g_hash_table_steal((ht), GUINT_TO_POINTER((guint)(key)))
 
 
+/** GList of the keys in a map, in no particular order */
 GList *map_collect_keys(GHashTable *ht);
 
 
+/** GList of the values in a map, in no particular order */
 GList *map_collect_values(GHashTable *ht);
 
 
+/** walk each key:val pair of a map in place, without collecting
+    them first. The map must not be modified during the walk, other
+    than through map_iter_remove.
+
+    @code
+    GHashTableIter iter;
+    gpointer k, v;
+
+    map_iter_init(&iter, ht);
+    while(map_iter_next(&iter, &k, &v)) { ... }
+    @endcode
+*/
+#define map_iter_init(iter, ht) \
+  g_hash_table_iter_init((iter), (ht))
+
+
+#define map_iter_next(iter, key, val) \
+  g_hash_table_iter_next((iter), (key), (val))
+
+
+#define map_iter_remove(iter) \
+  g_hash_table_iter_remove((iter))
+
+
 struct mw_datum {
   gpointer data;
   GDestroyNotify clear;
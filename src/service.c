@@ -98,11 +98,61 @@ void mwService_recv(struct mwService *s, struct mwChannel *chan,
 	    mwService_getSession(s), s, data->data, data->len);
   */
 
+  /* the unsigned subtraction wraps types below the base out of range */
+  if((guint16) (msg_type - s->dispatch_base) < s->dispatch_len) {
+    mwService_funcRecv h = s->dispatch[msg_type - s->dispatch_base];
+    if(h) {
+      h(s, chan, msg_type, data);
+      return;
+    }
+  }
+
   if(s->recv)
     s->recv(s, chan, msg_type, data);
 }
 
 
+void mwService_setHandlers(struct mwService *s,
+			   const struct mwServiceHandler *handlers,
+			   guint count) {
+
+  guint16 lo = 0xffff, hi = 0x0000;
+  guint i;
+
+  g_return_if_fail(s != NULL);
+  g_return_if_fail(handlers != NULL || count == 0);
+
+  g_free(s->dispatch);
+  s->dispatch = NULL;
+  s->dispatch_base = 0;
+  s->dispatch_len = 0;
+
+  if(! count) return;
+
+  for(i = 0; i < count; i++) {
+    if(handlers[i].msg_type < lo) lo = handlers[i].msg_type;
+    if(handlers[i].msg_type > hi) hi = handlers[i].msg_type;
+  }
+
+  s->dispatch_base = lo;
+  s->dispatch_len = (guint32) (hi - lo) + 1;
+  s->dispatch = g_new0(mwService_funcRecv, s->dispatch_len);
+
+  for(i = 0; i < count; i++)
+    s->dispatch[handlers[i].msg_type - lo] = handlers[i].recv;
+}
+
+
+void mwService_drained(struct mwService *s, struct mwChannel *chan) {
+  g_return_if_fail(s != NULL);
+  g_return_if_fail(chan != NULL);
+  g_return_if_fail(s->session == mwChannel_getSession(chan));
+
+  if(s->drained)
+    s->drained(s, chan);
+}
+
+
 guint32 mwService_getType(struct mwService *s) {
   g_return_val_if_fail(s != NULL, 0x00);
   return s->type;
@@ -232,6 +282,7 @@ void mwService_free(struct mwService *srvc) {
   if(srvc->client_cleanup)
     srvc->client_cleanup(srvc->client_data);
 
+  g_free(srvc->dispatch);
   g_free(srvc);
 }
 
@@ -28,6 +28,7 @@
 #include "mw_message.h"
 #include "mw_service.h"
 #include "mw_session.h"
+#include "mw_timer.h"
 #include "mw_util.h"
 
 
@@ -54,6 +55,10 @@ struct mwSession {
   guchar *buf;  /**< buffer for incoming message data */
   gsize buf_len;       /**< length of buf */
   gsize buf_used;      /**< offset to last-used byte of buf */
+
+  struct mwArena *arena;  /**< incoming messages are decoded into this */
+  guint decoding;         /**< depth of nested session_process calls */
+  gboolean in_arena;      /**< the outermost message is in the arena */
   
   struct mwLoginInfo login;      /**< login information */
   struct mwUserStatus status;    /**< user status */
@@ -73,6 +78,13 @@ struct mwSession {
 
   /** optional user data */
   struct mw_datum client_data;
+
+  /** drives keepalives and timeouts, not owned by the session */
+  struct mwTimerWheel *timers;
+
+  guint keepalive;              /**< keepalive interval in seconds */
+  struct mwTimer keepalive_timer;
+  guint64 last_write;           /**< wheel time of the latest write */
 };
 
 
@@ -110,6 +122,35 @@ static void session_defaults(struct mwSession *s) {
 }
 
 
+/** sends a keepalive if nothing else has been written for a full
+    interval, and schedules the next check */
+static void keepalive_fire(struct mwTimer *timer, gpointer data) {
+  struct mwSession *s = data;
+  guint64 interval = (guint64) s->keepalive * 1000;
+  guint64 idle = mwTimerWheel_getTime(s->timers) - s->last_write;
+
+  if(idle < interval) {
+    mwTimer_schedule(timer, s->timers, interval - idle);
+
+  } else {
+    mwTimer_schedule(timer, s->timers, interval);
+    mwSession_sendKeepalive(s);
+  }
+}
+
+
+/** keepalives run only while the session is started */
+static void keepalive_update(struct mwSession *s) {
+  if(s->timers && s->keepalive && mwSession_isStarted(s)) {
+    if(! mwTimer_isPending(&s->keepalive_timer))
+      mwTimer_schedule(&s->keepalive_timer, s->timers, s->keepalive * 1000);
+
+  } else {
+    mwTimer_cancel(&s->keepalive_timer);
+  }
+}
+
+
 struct mwSession *mwSession_new(struct mwSessionHandler *handler) {
   struct mwSession *s;
 
@@ -128,12 +169,15 @@ struct mwSession *mwSession_new(struct mwSessionHandler *handler) {
   s->channels = mwChannelSet_new(s);
   s->services = map_guint_new();
   s->ciphers = map_guint_new();
+  s->arena = mwArena_new();
 
   s->attributes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
 					(GDestroyNotify) mw_datum_free);
 
   session_defaults(s);
 
+  mwTimer_init(&s->keepalive_timer, keepalive_fire, s);
+
   return s;
 }
 
@@ -184,6 +228,7 @@ void mwSession_free(struct mwSession *s) {
   s->handler = NULL;
 
   session_buf_free(s);
+  mwTimer_cancel(&s->keepalive_timer);
 
   mwChannelSet_free(s->channels);
   g_hash_table_destroy(s->services);
@@ -194,6 +239,7 @@ void mwSession_free(struct mwSession *s) {
   mwUserStatus_clear(&s->status);
   mwPrivacyInfo_clear(&s->privacy);
 
+  mwArena_free(s->arena);
   g_free(s);
 }
 
@@ -204,6 +250,8 @@ static int io_write(struct mwSession *s, const guchar *buf, gsize len) {
   g_return_val_if_fail(s->handler != NULL, -1);
   g_return_val_if_fail(s->handler->io_write != NULL, -1);
 
+  if(s->timers) s->last_write = mwTimerWheel_getTime(s->timers);
+
   return s->handler->io_write(s, buf, len);
 }
 
@@ -231,6 +279,8 @@ static void state(struct mwSession *s, enum mwSessionState state,
   s->state = state;
   s->state_info = info;
 
+  keepalive_update(s);
+
   switch(state) {
   case mwSession_STOPPING:
   case mwSession_STOPPED:
@@ -632,12 +682,37 @@ case mwMessage_ ## var: \
   break;
 
 
+/** whether a message may be decoded into the arena. Data sent on a
+    channel that isn't open yet is queued until it is, so it's decoded
+    as usual, for the queue to take over without copying */
+static gboolean arena_suits(struct mwSession *s,
+			    const guchar *buf, gsize len) {
+
+  struct mwChannel *chan;
+  guint16 type;
+  guint32 id;
+
+  /* the head begins with a guint16 type, a guint16 of options and
+     the guint32 channel id */
+  if(len < 8) return TRUE;
+
+  type = (buf[0] << 8) | buf[1];
+  if(type != mwMessage_CHANNEL_SEND) return TRUE;
+
+  id = ((guint32) buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7];
+  chan = mwChannel_find(s->channels, id);
+
+  return ! chan || mwChannel_isState(chan, mwChannel_OPEN);
+}
+
+
 static void session_process(struct mwSession *s,
 			    const guchar *buf, gsize len) {
 
   struct mwOpaque o = { .len = len, .data = (guchar *) buf };
   struct mwGetBuffer *b;
   struct mwMessage *msg;
+  struct mwArena *arena;
 
   g_return_if_fail(s != NULL);
   g_return_if_fail(buf != NULL);
@@ -645,11 +720,24 @@ static void session_process(struct mwSession *s,
   /* ignore zero-length messages */
   if(len == 0) return;
 
+  /* the message is decoded into the session's arena, which is reset
+     once it's been handled. A handler may feed the session more data
+     in turn, and messages decoded then are allocated as usual, so as
+     not to be reset from under the outer message */
+  arena = s->decoding || ! arena_suits(s, buf, len)? NULL: s->arena;
+
   /* wrap up buf */
-  b = mwGetBuffer_wrap(&o);
+  b = arena? mwGetBuffer_wrapArena(&o, arena): mwGetBuffer_wrap(&o);
 
   /* attempt to parse the message. */
-  msg = mwMessage_get(b);
+  if(MW_TRACE_ON(message_decoded)) {
+    guint64 start = mwTrace_now();
+    msg = mwMessage_get(b);
+    if(msg) MW_TRACE(message_decoded, s, msg->type, len, start, mwTrace_now());
+
+  } else {
+    msg = mwMessage_get(b);
+  }
 
   if(mwGetBuffer_error(b)) {
     mw_mailme_opaque(&o, "parsing of message failed");
@@ -657,8 +745,12 @@ static void session_process(struct mwSession *s,
 
   mwGetBuffer_free(b);
 
+  if(! msg && arena) mwArena_reset(arena);
   g_return_if_fail(msg != NULL);
 
+  if(! s->decoding) s->in_arena = (arena != NULL);
+  s->decoding++;
+
   /* handle each of the appropriate incoming types of mwMessage */
   switch(msg->type) {
     CASE(HANDSHAKE_ACK, mwMsgHandshakeAck);
@@ -678,13 +770,27 @@ static void session_process(struct mwSession *s,
     g_warning("unknown message type 0x%04x, no handler", msg->type);
   }
 
-  mwMessage_free(msg);
+  s->decoding--;
+
+  if(arena) {
+    mwArena_reset(arena);
+  } else {
+    mwMessage_free(msg);
+  }
 }
 
 
 #undef CASE
 
 
+gboolean mwSession_isArenaMessage(struct mwSession *s) {
+  g_return_val_if_fail(s != NULL, FALSE);
+
+  /* only the outermost message may be decoded into the arena */
+  return s->decoding == 1 && s->in_arena;
+}
+
+
 #define ADVANCE(b, n, count) { b += count; n -= count; }
 
 
@@ -865,6 +971,8 @@ void mwSession_recv(struct mwSession *s, const guchar *buf, gsize n) {
 
   g_return_if_fail(s != NULL);
 
+  MW_TRACE(frame_recv, s, n, mwTrace_now());
+
   while(n > 0) {
     remain = session_recv(s, b, n);
     b += (n - remain);
@@ -873,6 +981,15 @@ void mwSession_recv(struct mwSession *s, const guchar *buf, gsize n) {
 }
 
 
+/** write a big-endian length into the four bytes at buf */
+static void frame_len_set(guchar *buf, guint32 len) {
+  buf[0] = (len >> 24) & 0xff;
+  buf[1] = (len >> 16) & 0xff;
+  buf[2] = (len >> 8) & 0xff;
+  buf[3] = len & 0xff;
+}
+
+
 int mwSession_send(struct mwSession *s, struct mwMessage *msg) {
   struct mwPutBuffer *b;
   struct mwOpaque o;
@@ -883,16 +1000,13 @@ int mwSession_send(struct mwSession *s, struct mwMessage *msg) {
   /* writing nothing is easy */
   if(! msg) return 0;
 
-  /* first we render the message into an opaque */
+  /* render the message behind room for its length, which is filled
+     in afterwards, rather than copying the message into a frame */
   b = mwPutBuffer_new();
+  guint32_put(b, 0x00);
   mwMessage_put(b, msg);
   mwPutBuffer_finalize(&o, b);
-
-  /* then we render the opaque into... another opaque! */
-  b = mwPutBuffer_new();
-  mwOpaque_put(b, &o);
-  mwOpaque_clear(&o);
-  mwPutBuffer_finalize(&o, b);
+  frame_len_set(o.data, o.len - 4);
 
   /* then we use that opaque's data and length to write to the socket */
   ret = io_write(s, o.data, o.len);
@@ -913,6 +1027,48 @@ int mwSession_send(struct mwSession *s, struct mwMessage *msg) {
 }
 
 
+int mwSession_sendFile(struct mwSession *s, struct mwMessage *msg,
+		       int fd, guint64 offset, gsize len) {
+
+  struct mwMsgChannelSend *send = (struct mwMsgChannelSend *) msg;
+  struct mwOpaque data, o;
+  struct mwPutBuffer *b;
+  int ret;
+
+  g_return_val_if_fail(s != NULL, -1);
+  g_return_val_if_fail(msg != NULL, -1);
+  g_return_val_if_fail(msg->type == mwMessage_CHANNEL_SEND, -1);
+  g_return_val_if_fail(len <= G_MAXUINT32 - 0x100, -1);
+
+  if(! s->handler->io_sendfile) return -1;
+
+  /* render the message with empty data, then correct the lengths of
+     both the data and the frame to include what io_sendfile will
+     write after it. The data's length is always the last four bytes */
+  data = send->data;
+  send->data.len = 0;
+  send->data.data = NULL;
+
+  b = mwPutBuffer_new();
+  guint32_put(b, 0x00);
+  mwMessage_put(b, msg);
+  mwPutBuffer_finalize(&o, b);
+
+  send->data = data;
+
+  frame_len_set(o.data, o.len - 4 + len);
+  frame_len_set(o.data + o.len - 4, len);
+
+  ret = io_write(s, o.data, o.len);
+  mwOpaque_clear(&o);
+
+  if(! ret && len)
+    ret = s->handler->io_sendfile(s, fd, offset, len);
+
+  return ret;
+}
+
+
 int mwSession_sendKeepalive(struct mwSession *s) {
   const guchar b = 0x80;
 
@@ -1048,6 +1204,40 @@ struct mwChannelSet *mwSession_getChannels(struct mwSession *session) {
 }
 
 
+void mwSession_setTimerWheel(struct mwSession *s,
+			     struct mwTimerWheel *wheel) {
+
+  g_return_if_fail(s != NULL);
+
+  mwTimer_cancel(&s->keepalive_timer);
+  s->timers = wheel;
+  if(wheel) s->last_write = mwTimerWheel_getTime(wheel);
+
+  keepalive_update(s);
+}
+
+
+struct mwTimerWheel *mwSession_getTimerWheel(struct mwSession *s) {
+  g_return_val_if_fail(s != NULL, NULL);
+  return s->timers;
+}
+
+
+void mwSession_setKeepalive(struct mwSession *s, guint seconds) {
+  g_return_if_fail(s != NULL);
+
+  s->keepalive = seconds;
+  mwTimer_cancel(&s->keepalive_timer);
+  keepalive_update(s);
+}
+
+
+guint mwSession_getKeepalive(struct mwSession *s) {
+  g_return_val_if_fail(s != NULL, 0);
+  return s->keepalive;
+}
+
+
 gboolean mwSession_addService(struct mwSession *s, struct mwService *srv) {
   g_return_val_if_fail(s != NULL, FALSE);
   g_return_val_if_fail(srv != NULL, FALSE);
@@ -1080,7 +1270,10 @@ struct mwService *mwSession_removeService(struct mwSession *s, guint32 srv) {
   g_return_val_if_fail(s->services != NULL, NULL);
 
   svc = map_guint_lookup(s->services, srv);
-  if(svc) map_guint_remove(s->services, srv);
+  if(svc) {
+    map_guint_remove(s->services, srv);
+    mwChannelSet_forgetService(s->channels, svc);
+  }
   return svc;
 }
 
@@ -0,0 +1,496 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include "mw_error.h"
+#include "mw_session.h"
+#include "mw_session_pool.h"
+#include "mw_timer.h"
+
+
+/** session property under which a pooled session's entry is kept */
+#define POOL_PROPERTY  "session.pool.entry"
+
+
+/** how much to read from a socket in a single call */
+#define POOL_READ_LEN  (64 * 1024)
+
+
+/** most events to collect from a single epoll_wait */
+#define POOL_EVENTS  256
+
+
+struct pool_entry {
+  struct mwSessionPool *pool;
+  struct mwSession *session;  /**< NULL once the session is free'd */
+  int sock;
+
+  GByteArray *outgoing;  /**< data waiting for the socket */
+  guint out_off;         /**< start of unwritten data in outgoing */
+
+  /** TRUE once closed. The entry itself is kept until no events from
+      the current epoll_wait may still refer to it */
+  gboolean dead;
+  struct pool_entry *dead_next;
+};
+
+
+struct mwSessionPool {
+  int epfd;              /**< the epoll instance */
+  guchar *buf;           /**< shared read buffer, POOL_READ_LEN long */
+
+  GHashTable *entries;   /**< set of live entries */
+  struct pool_entry *dead;  /**< closed entries, waiting to be free'd */
+
+  /** lent to pooled sessions which don't have their own */
+  struct mwTimerWheel *timers;
+  guint keepalive;       /**< keepalive interval in seconds, or zero */
+};
+
+
+/** attempt to write everything queued for the entry.
+
+    @returns zero if the queue was emptied or the socket is full, or
+    -1 on error */
+static int entry_flush(struct pool_entry *entry) {
+  GByteArray *out = entry->outgoing;
+
+  while(entry->out_off < out->len) {
+    ssize_t ret = write(entry->sock, out->data + entry->out_off,
+			out->len - entry->out_off);
+
+    if(ret > 0) {
+      entry->out_off += ret;
+
+    } else if(ret < 0 && errno == EINTR) {
+      continue;
+
+    } else if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 0;
+
+    } else {
+      return -1;
+    }
+  }
+
+  g_byte_array_set_size(out, 0);
+  entry->out_off = 0;
+  return 0;
+}
+
+
+static void entry_detach(struct pool_entry *entry);
+
+
+/** close the entry's socket and take it out of the pool */
+static void entry_close(struct pool_entry *entry) {
+  struct mwSessionPool *pool = entry->pool;
+  struct mwSession *session;
+
+  if(entry->dead) return;
+  entry->dead = TRUE;
+
+  /* best effort at getting out whatever the session last said, such
+     as the channel destroy sent by mwSession_stop */
+  entry_flush(entry);
+
+  epoll_ctl(pool->epfd, EPOLL_CTL_DEL, entry->sock, NULL);
+  close(entry->sock);
+  entry->sock = -1;
+
+  g_byte_array_free(entry->outgoing, TRUE);
+  entry->outgoing = NULL;
+
+  g_hash_table_remove(pool->entries, entry);
+  entry->dead_next = pool->dead;
+  pool->dead = entry;
+
+  session = entry->session;
+  entry->session = NULL;
+  if(! session) return;
+
+  /* the wheel goes with the pool, so don't leave it with the session */
+  if(mwSession_getTimerWheel(session) == pool->timers)
+    mwSession_setTimerWheel(session, NULL);
+
+  mwSession_removeProperty(session, POOL_PROPERTY);
+}
+
+
+/** clear function for the session property, in case the session is
+    free'd while still in the pool */
+static void entry_detach(struct pool_entry *entry) {
+  entry->session = NULL;
+  entry_close(entry);
+}
+
+
+static void pool_reap(struct mwSessionPool *pool) {
+  while(pool->dead) {
+    struct pool_entry *entry = pool->dead;
+    pool->dead = entry->dead_next;
+    g_free(entry);
+  }
+}
+
+
+/** the connection has gone away. Stop the session, which in turn
+    closes the entry via mwSessionPool_ioClose */
+static void entry_lost(struct pool_entry *entry) {
+  struct mwSession *session = entry->session;
+
+  if(session && !mwSession_isStopping(session)
+     && !mwSession_isStopped(session)) {
+    mwSession_stop(session, CONNECTION_BROKEN);
+  }
+
+  entry_close(entry);
+}
+
+
+/** read from the socket until it would block, as required by an edge
+    triggered watch */
+static void entry_read(struct pool_entry *entry) {
+  struct mwSessionPool *pool = entry->pool;
+
+  while(! entry->dead) {
+    ssize_t ret = read(entry->sock, pool->buf, POOL_READ_LEN);
+
+    if(ret > 0) {
+      if(entry->session) mwSession_recv(entry->session, pool->buf, ret);
+
+    } else if(ret < 0 && errno == EINTR) {
+      continue;
+
+    } else if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+
+    } else {
+      entry_lost(entry);
+      return;
+    }
+  }
+}
+
+
+static void entry_event(struct pool_entry *entry, guint32 events) {
+  if(entry->dead) return;
+
+  if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+    entry_read(entry);
+
+  if(entry->dead) return;
+
+  if(events & (EPOLLHUP | EPOLLERR)) {
+    entry_lost(entry);
+    return;
+  }
+
+  if((events & EPOLLOUT) && entry_flush(entry))
+    entry_lost(entry);
+}
+
+
+struct mwSessionPool *mwSessionPool_new(void) {
+  struct mwSessionPool *pool;
+  int epfd;
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(epfd < 0) {
+    g_warning("epoll_create1 failed: %s", g_strerror(errno));
+    return NULL;
+  }
+
+  pool = g_new0(struct mwSessionPool, 1);
+  pool->epfd = epfd;
+  pool->buf = g_malloc(POOL_READ_LEN);
+  pool->entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+  pool->timers = mwTimerWheel_new();
+
+  return pool;
+}
+
+
+void mwSessionPool_free(struct mwSessionPool *pool) {
+  GHashTableIter iter;
+  gpointer k;
+
+  g_return_if_fail(pool != NULL);
+
+  /* entry_close removes from the table, so collect them first */
+  while(g_hash_table_size(pool->entries)) {
+    g_hash_table_iter_init(&iter, pool->entries);
+    g_hash_table_iter_next(&iter, &k, NULL);
+    entry_close(k);
+  }
+
+  pool_reap(pool);
+
+  g_hash_table_destroy(pool->entries);
+  mwTimerWheel_free(pool->timers);
+  close(pool->epfd);
+  g_free(pool->buf);
+  g_free(pool);
+}
+
+
+int mwSessionPool_getFd(struct mwSessionPool *pool) {
+  g_return_val_if_fail(pool != NULL, -1);
+  return pool->epfd;
+}
+
+
+struct mwTimerWheel *mwSessionPool_getTimerWheel(struct mwSessionPool *pool) {
+  g_return_val_if_fail(pool != NULL, NULL);
+  return pool->timers;
+}
+
+
+int mwSessionPool_add(struct mwSessionPool *pool,
+		      struct mwSession *session, int sock) {
+
+  struct pool_entry *entry;
+  struct epoll_event ev;
+  int flags;
+
+  g_return_val_if_fail(pool != NULL, -1);
+  g_return_val_if_fail(session != NULL, -1);
+  g_return_val_if_fail(sock >= 0, -1);
+
+  if(mwSession_getProperty(session, POOL_PROPERTY)) {
+    g_warning("session is already in a pool");
+    return -1;
+  }
+
+  flags = fcntl(sock, F_GETFL, 0);
+  if(flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+    g_warning("couldn't make socket non-blocking: %s", g_strerror(errno));
+    return -1;
+  }
+
+  entry = g_new0(struct pool_entry, 1);
+  entry->pool = pool;
+  entry->session = session;
+  entry->sock = sock;
+  entry->outgoing = g_byte_array_new();
+
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = entry;
+
+  if(epoll_ctl(pool->epfd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+    g_warning("couldn't watch socket: %s", g_strerror(errno));
+    g_byte_array_free(entry->outgoing, TRUE);
+    g_free(entry);
+    return -1;
+  }
+
+  g_hash_table_insert(pool->entries, entry, entry);
+  mwSession_setProperty(session, POOL_PROPERTY, entry,
+			(GDestroyNotify) entry_detach);
+
+  if(! mwSession_getTimerWheel(session))
+    mwSession_setTimerWheel(session, pool->timers);
+
+  if(pool->keepalive)
+    mwSession_setKeepalive(session, pool->keepalive);
+
+  return 0;
+}
+
+
+void mwSessionPool_remove(struct mwSessionPool *pool,
+			  struct mwSession *session) {
+
+  struct pool_entry *entry;
+
+  g_return_if_fail(pool != NULL);
+  g_return_if_fail(session != NULL);
+
+  entry = mwSession_getProperty(session, POOL_PROPERTY);
+  g_return_if_fail(entry != NULL);
+  g_return_if_fail(entry->pool == pool);
+
+  /* discard rather than flush what's queued */
+  g_byte_array_set_size(entry->outgoing, 0);
+  entry->out_off = 0;
+
+  entry_close(entry);
+}
+
+
+void mwSessionPool_setKeepalive(struct mwSessionPool *pool,
+				guint seconds) {
+
+  GHashTableIter iter;
+  gpointer k;
+
+  g_return_if_fail(pool != NULL);
+
+  pool->keepalive = seconds;
+
+  g_hash_table_iter_init(&iter, pool->entries);
+  while(g_hash_table_iter_next(&iter, &k, NULL)) {
+    struct pool_entry *entry = k;
+    mwSession_setKeepalive(entry->session, seconds);
+  }
+}
+
+
+guint mwSessionPool_getKeepalive(struct mwSessionPool *pool) {
+  g_return_val_if_fail(pool != NULL, 0);
+  return pool->keepalive;
+}
+
+
+int mwSessionPool_run(struct mwSessionPool *pool, int timeout) {
+  struct epoll_event events[POOL_EVENTS];
+  int count, i, due;
+
+  g_return_val_if_fail(pool != NULL, -1);
+
+  /* wake in time for the next timer */
+  due = mwTimerWheel_getTimeout(pool->timers);
+  if(due >= 0 && (timeout < 0 || timeout > due))
+    timeout = due;
+
+  count = epoll_wait(pool->epfd, events, POOL_EVENTS, timeout);
+  if(count < 0 && errno != EINTR) {
+    g_warning("epoll_wait failed: %s", g_strerror(errno));
+    return -1;
+  }
+
+  for(i = 0; i < count; i++)
+    entry_event(events[i].data.ptr, events[i].events);
+
+  mwTimerWheel_run(pool->timers);
+  pool_reap(pool);
+
+  return count < 0? 0: count;
+}
+
+
+int mwSessionPool_ioWrite(struct mwSession *session,
+			  const guchar *buf, gsize len) {
+
+  struct pool_entry *entry;
+
+  g_return_val_if_fail(session != NULL, -1);
+
+  entry = mwSession_getProperty(session, POOL_PROPERTY);
+  if(! entry || entry->dead) return -1;
+
+  /* with nothing already waiting, try the socket directly */
+  while(len && entry->out_off == entry->outgoing->len) {
+    ssize_t ret = write(entry->sock, buf, len);
+
+    if(ret > 0) {
+      buf += ret;
+      len -= ret;
+
+    } else if(ret < 0 && errno == EINTR) {
+      continue;
+
+    } else if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+
+    } else {
+      return -1;
+    }
+  }
+
+  if(len) g_byte_array_append(entry->outgoing, buf, len);
+
+  return 0;
+}
+
+
+int mwSessionPool_ioSendfile(struct mwSession *session, int fd,
+			     guint64 offset, gsize len) {
+
+  struct pool_entry *entry;
+  GByteArray *out;
+  guint start;
+
+  g_return_val_if_fail(session != NULL, -1);
+
+  entry = mwSession_getProperty(session, POOL_PROPERTY);
+  if(! entry || entry->dead) return -1;
+
+  /* with nothing already waiting, let the kernel copy what it can */
+  while(len && entry->out_off == entry->outgoing->len) {
+    off_t off = (off_t) offset;
+    ssize_t ret = sendfile(entry->sock, fd, &off, len);
+
+    if(ret > 0) {
+      offset += ret;
+      len -= ret;
+
+    } else if(ret < 0 && errno == EINTR) {
+      continue;
+
+    } else if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+
+    } else {
+      /* including a file shorter than promised */
+      return -1;
+    }
+  }
+
+  if(! len) return 0;
+
+  /* queue the remainder */
+  out = entry->outgoing;
+  start = out->len;
+  g_byte_array_set_size(out, start + len);
+
+  while(len) {
+    ssize_t ret = pread(fd, out->data + start, len, (off_t) offset);
+
+    if(ret > 0) {
+      start += ret;
+      offset += ret;
+      len -= ret;
+
+    } else if(ret < 0 && errno == EINTR) {
+      continue;
+
+    } else {
+      g_byte_array_set_size(out, start);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+void mwSessionPool_ioClose(struct mwSession *session) {
+  struct pool_entry *entry;
+
+  g_return_if_fail(session != NULL);
+
+  entry = mwSession_getProperty(session, POOL_PROPERTY);
+  if(entry) entry_close(entry);
+}
@@ -0,0 +1,381 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "mw_session.h"
+#include "mw_session_pool.h"
+#include "mw_session_shards.h"
+#include "mw_timer.h"
+
+
+struct shard;
+struct shard_task;
+
+
+/** the internal half of a task, run on the shard's thread */
+typedef void (*shard_task_run)(struct shard *sh, struct shard_task *t);
+
+
+struct shard_task {
+  struct shard_task *next;
+
+  shard_task_run run;
+  struct mwSession *session;
+
+  mwSessionShards_func func;  /**< for calls from mwSessionShards_call */
+  gpointer data;
+  GDestroyNotify clear;
+};
+
+
+struct shard {
+  GThread *thread;
+  struct mwSessionPool *pool;
+
+  int epfd;    /**< waits on the pool's epoll fd and on wake_fd */
+  int wake_fd; /**< eventfd, written when tasks are pushed */
+
+  /** tasks pushed by any thread, most recent first. A lock-free
+      stack, from which the shard's thread takes everything at once */
+  struct shard_task *tasks;
+
+  gint quit;   /**< set to ask the thread to exit */
+};
+
+
+struct mwSessionShards {
+  guint count;
+  struct shard *shards;
+};
+
+
+static void task_free(struct shard_task *t) {
+  if(t->clear) t->clear(t->data);
+  g_free(t);
+}
+
+
+static void shard_wake(struct shard *sh) {
+  uint64_t one = 1;
+
+  if(write(sh->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    g_warning("couldn't wake shard: %s", g_strerror(errno));
+}
+
+
+/** push a task onto a shard's queue. Any number of threads may push
+    at once, and only the thread which finds the queue empty needs to
+    wake the shard */
+static void shard_push(struct shard *sh, struct shard_task *t) {
+  struct shard_task *head;
+
+  do {
+    head = g_atomic_pointer_get(&sh->tasks);
+    t->next = head;
+  } while(! g_atomic_pointer_compare_and_exchange(&sh->tasks, head, t));
+
+  if(! head) shard_wake(sh);
+}
+
+
+/** take every queued task at once, in the order they were pushed */
+static struct shard_task *shard_take(struct shard *sh) {
+  struct shard_task *head, *rev = NULL;
+
+  do {
+    head = g_atomic_pointer_get(&sh->tasks);
+  } while(head &&
+	  ! g_atomic_pointer_compare_and_exchange(&sh->tasks, head, NULL));
+
+  while(head) {
+    struct shard_task *next = head->next;
+    head->next = rev;
+    rev = head;
+    head = next;
+  }
+
+  return rev;
+}
+
+
+static void shard_drain(struct shard *sh) {
+  struct shard_task *t = shard_take(sh);
+
+  while(t) {
+    struct shard_task *next = t->next;
+    t->run(sh, t);
+    task_free(t);
+    t = next;
+  }
+}
+
+
+static gpointer shard_main(gpointer data) {
+  struct shard *sh = data;
+  struct mwTimerWheel *timers = mwSessionPool_getTimerWheel(sh->pool);
+
+  while(! g_atomic_int_get(&sh->quit)) {
+    struct epoll_event events[2];
+    int count, i;
+
+    /* the pool needs to be run in time for its next timer, even when
+       nothing else is happening */
+    count = epoll_wait(sh->epfd, events, 2, mwTimerWheel_getTimeout(timers));
+
+    for(i = 0; i < count; i++) {
+      if(events[i].data.fd == sh->wake_fd) {
+	uint64_t n;
+	if(read(sh->wake_fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+	  g_warning("couldn't read shard wake: %s", g_strerror(errno));
+      }
+    }
+
+    shard_drain(sh);
+    mwSessionPool_run(sh->pool, 0);
+  }
+
+  return NULL;
+}
+
+
+static gboolean shard_init(struct shard *sh, guint index) {
+  struct epoll_event ev;
+  char *name;
+
+  sh->pool = mwSessionPool_new();
+  if(! sh->pool) return FALSE;
+
+  sh->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  sh->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+  if(sh->wake_fd < 0 || sh->epfd < 0) {
+    g_warning("couldn't create shard: %s", g_strerror(errno));
+    return FALSE;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.fd = sh->wake_fd;
+  epoll_ctl(sh->epfd, EPOLL_CTL_ADD, sh->wake_fd, &ev);
+
+  ev.events = EPOLLIN;
+  ev.data.fd = mwSessionPool_getFd(sh->pool);
+  epoll_ctl(sh->epfd, EPOLL_CTL_ADD, ev.data.fd, &ev);
+
+  name = g_strdup_printf("mw-shard-%u", index);
+  sh->thread = g_thread_new(name, shard_main, sh);
+  g_free(name);
+
+  return TRUE;
+}
+
+
+static void shard_clear(struct shard *sh) {
+  struct shard_task *t;
+
+  if(sh->thread) {
+    g_atomic_int_set(&sh->quit, 1);
+    shard_wake(sh);
+    g_thread_join(sh->thread);
+    sh->thread = NULL;
+  }
+
+  /* the thread is gone, so whatever it didn't get to is dropped */
+  for(t = shard_take(sh); t; ) {
+    struct shard_task *next = t->next;
+    task_free(t);
+    t = next;
+  }
+
+  if(sh->pool) mwSessionPool_free(sh->pool);
+  if(sh->epfd >= 0) close(sh->epfd);
+  if(sh->wake_fd >= 0) close(sh->wake_fd);
+}
+
+
+struct mwSessionShards *mwSessionShards_new(guint count) {
+  struct mwSessionShards *set;
+  guint i;
+
+  g_return_val_if_fail(count > 0, NULL);
+
+  set = g_new0(struct mwSessionShards, 1);
+  set->count = count;
+  set->shards = g_new0(struct shard, count);
+
+  for(i = 0; i < count; i++) {
+    set->shards[i].epfd = -1;
+    set->shards[i].wake_fd = -1;
+  }
+
+  for(i = 0; i < count; i++) {
+    if(! shard_init(set->shards + i, i)) {
+      mwSessionShards_free(set);
+      return NULL;
+    }
+  }
+
+  return set;
+}
+
+
+void mwSessionShards_free(struct mwSessionShards *set) {
+  guint i;
+
+  g_return_if_fail(set != NULL);
+
+  for(i = 0; i < set->count; i++)
+    shard_clear(set->shards + i);
+
+  g_free(set->shards);
+  g_free(set);
+}
+
+
+guint mwSessionShards_getCount(struct mwSessionShards *set) {
+  g_return_val_if_fail(set != NULL, 0);
+  return set->count;
+}
+
+
+guint mwSessionShards_getShard(struct mwSessionShards *set,
+			       struct mwSession *session) {
+
+  /* Fibonacci hash of the session's address, skipping the low bits
+     which allocation alignment leaves constant */
+  guint64 h = (guint64) GPOINTER_TO_SIZE(session) >> 4;
+
+  g_return_val_if_fail(set != NULL, 0);
+
+  h *= G_GUINT64_CONSTANT(0x9e3779b97f4a7c15);
+  return (guint) ((h >> 32) % set->count);
+}
+
+
+static struct shard *shard_for(struct mwSessionShards *set,
+			       struct mwSession *session) {
+  return set->shards + mwSessionShards_getShard(set, session);
+}
+
+
+/** an add task dropped before it ran still owns its socket */
+static void add_clear(gpointer data) {
+  close(GPOINTER_TO_INT(data));
+}
+
+
+static void run_add(struct shard *sh, struct shard_task *t) {
+  int sock = GPOINTER_TO_INT(t->data);
+
+  /* the socket is the pool's from here, or closed */
+  t->clear = NULL;
+  if(mwSessionPool_add(sh->pool, t->session, sock)) close(sock);
+}
+
+
+static void run_remove(struct shard *sh, struct shard_task *t) {
+  mwSessionPool_remove(sh->pool, t->session);
+}
+
+
+static void run_call(struct shard *sh, struct shard_task *t) {
+  // `sh` unused
+  (void)sh;
+
+  t->func(t->session, t->data);
+}
+
+
+static void run_keepalive(struct shard *sh, struct shard_task *t) {
+  mwSessionPool_setKeepalive(sh->pool, GPOINTER_TO_UINT(t->data));
+}
+
+
+static struct shard_task *task_new(shard_task_run run,
+				   struct mwSession *session,
+				   gpointer data) {
+
+  struct shard_task *t = g_new0(struct shard_task, 1);
+  t->run = run;
+  t->session = session;
+  t->data = data;
+  return t;
+}
+
+
+void mwSessionShards_add(struct mwSessionShards *set,
+			 struct mwSession *session, int sock) {
+
+  struct shard_task *t;
+
+  g_return_if_fail(set != NULL);
+  g_return_if_fail(session != NULL);
+  g_return_if_fail(sock >= 0);
+
+  t = task_new(run_add, session, GINT_TO_POINTER(sock));
+  t->clear = add_clear;
+
+  shard_push(shard_for(set, session), t);
+}
+
+
+void mwSessionShards_remove(struct mwSessionShards *set,
+			    struct mwSession *session) {
+
+  g_return_if_fail(set != NULL);
+  g_return_if_fail(session != NULL);
+
+  shard_push(shard_for(set, session), task_new(run_remove, session, NULL));
+}
+
+
+void mwSessionShards_call(struct mwSessionShards *set,
+			  struct mwSession *session,
+			  mwSessionShards_func func,
+			  gpointer data, GDestroyNotify clear) {
+
+  struct shard_task *t;
+
+  g_return_if_fail(set != NULL);
+  g_return_if_fail(session != NULL);
+  g_return_if_fail(func != NULL);
+
+  t = task_new(run_call, session, data);
+  t->func = func;
+  t->clear = clear;
+
+  shard_push(shard_for(set, session), t);
+}
+
+
+void mwSessionShards_setKeepalive(struct mwSessionShards *set,
+				  guint seconds) {
+  guint i;
+
+  g_return_if_fail(set != NULL);
+
+  for(i = 0; i < set->count; i++) {
+    shard_push(set->shards + i,
+	       task_new(run_keepalive, NULL, GUINT_TO_POINTER(seconds)));
+  }
+}
@@ -31,14 +31,26 @@
 #include "mw_util.h"
 
 
-struct mwServiceAware {
-  struct mwService service;
+/** one partition of the service's watched entries, with its own
+    buddy list channel */
+struct aware_shard {
 
-  struct mwAwareHandler *handler;
+  /** the buddy list channel for this shard */
+  struct mwChannel *channel;
 
   /** map of ENTRY_KEY(aware_entry):aware_entry */
   GHashTable *entries;
 
+  /** TRUE once the channel has been accepted */
+  gboolean accepted;
+};
+
+
+struct mwServiceAware {
+  struct mwService service;
+
+  struct mwAwareHandler *handler;
+
   /** set of guint32:attrib_watch_entry attribute keys */
   GHashTable *attribs;
 
@@ -46,8 +58,23 @@ struct mwServiceAware {
       a mwAwareList */
   GList *lists;
 
-  /** the buddy list channel */
-  struct mwChannel *channel;
+  /** watched entries are spread across shard_count shards by the
+      hash of their ID. The first shard's channel also carries this
+      session's own attributes */
+  struct aware_shard *shards;
+  guint shard_count;
+
+  /** coalescing window in milliseconds, or zero to send aware
+      additions and removals immediately */
+  guint coalesce_window;
+
+  /** map of ENTRY_KEY(aware_entry):aware_entry for entries whose
+      membership has changed within the current coalescing window */
+  GHashTable *pending;
+
+  /** count of status updates which matched the cached snapshot, and
+      so were not passed on to any lists */
+  guint64 suppressed;
 };
 
 
@@ -67,9 +94,35 @@ struct mwAwareList {
 };
 
 
+/** attribute values up to this size are kept inside the attribute
+    itself, rather than in a separate allocation */
+#define ATTRIB_INLINE_LEN  16
+
+
+enum attrib_storage {
+  attrib_EMPTY,   /**< no value */
+  attrib_INLINE,  /**< data.data points to value.small */
+  attrib_HEAP,    /**< data.data was allocated to fit the value */
+};
+
+
 struct mwAwareAttribute {
   guint32 key;
+
+  /** the attribute's value. Depending on storage, the data member
+      may reference the inline buffer below */
   struct mwOpaque data;
+  enum attrib_storage storage;
+
+  union {
+    guchar small[ATTRIB_INLINE_LEN];
+    gsize alloc;  /**< size of the data.data allocation, for HEAP */
+  } value;
+
+  /** data decoded as a boolean and as an integer, updated whenever
+      the value changes */
+  gboolean as_boolean;
+  guint32 as_integer;
 };
 
 
@@ -89,6 +142,19 @@ struct aware_entry {
   /** collection of attribute values for this entry.
       map of ATTRIB_KEY(mwAwareAttribute):mwAwareAttribute */
   GHashTable *attribs;
+
+  /** TRUE once an AWARE_ADD for this entry has been sent over the
+      current channel */
+  gboolean upstream;
+
+  /** TRUE once any status has been received for this entry */
+  gboolean known;
+
+  /** for group entries, the members seen so far. Shared by every
+      list watching the group, so that each member need only be
+      expanded into those lists once. map of
+      mwAwareIdBlock:mwAwareIdBlock */
+  GHashTable *members;
 };
 
 
@@ -119,10 +185,17 @@ enum msg_types {
 };
 
 
+static void member_free(struct mwAwareIdBlock *idb) {
+  mwAwareIdBlock_clear(idb);
+  g_free(idb);
+}
+
+
 static void aware_entry_free(struct aware_entry *ae) {
   mwAwareSnapshot_clear(&ae->aware);
   g_list_free(ae->membership);
   g_hash_table_destroy(ae->attribs);
+  if(ae->members) g_hash_table_destroy(ae->members);
   g_free(ae);
 }
 
@@ -134,18 +207,132 @@ static void attrib_entry_free(struct attrib_entry *ae) {
 
 
 static void attrib_free(struct mwAwareAttribute *attrib) {
-  mwOpaque_clear(&attrib->data);
+  if(attrib->storage == attrib_HEAP)
+    g_free(attrib->data.data);
   g_free(attrib);
 }
 
 
+static guint32 attrib_decode_integer(const guchar *d, gsize len) {
+  /* these mirror reading the value as a guint32, a gboolean followed
+     by a guint16, a guint16, or a gboolean respectively */
+  if(len >= 4) {
+    return ((guint32) d[0] << 0x18) | (d[1] << 0x10) | (d[2] << 0x08) | d[3];
+  } else if(len == 3) {
+    return (d[1] << 0x08) | d[2];
+  } else if(len == 2) {
+    return (d[0] << 0x08) | d[1];
+  } else if(len) {
+    return !! d[0];
+  } else {
+    return 0x00;
+  }
+}
+
+
+static gboolean attrib_decode_boolean(const guchar *d, gsize len) {
+  if(len >= 4) {
+    return !! (d[0] | d[1] | d[2] | d[3]);
+  } else if(len >= 2) {
+    return !! (d[0] | d[1]);
+  } else if(len) {
+    return !! d[0];
+  } else {
+    return FALSE;
+  }
+}
+
+
+/** replace the value of a stored attribute with a copy of data,
+    re-using the existing storage where it fits */
+static void attrib_store(struct mwAwareAttribute *attrib,
+			 const struct mwOpaque *data) {
+
+  gsize len = data->len;
+  guchar *buf;
+
+  if(! len || ! data->data) {
+    if(attrib->storage == attrib_HEAP)
+      g_free(attrib->data.data);
+
+    attrib->storage = attrib_EMPTY;
+    attrib->data.data = NULL;
+    attrib->data.len = 0;
+
+    attrib->as_boolean = FALSE;
+    attrib->as_integer = 0x00;
+    return;
+  }
+
+  if(len <= ATTRIB_INLINE_LEN) {
+    if(attrib->storage == attrib_HEAP)
+      g_free(attrib->data.data);
+
+    attrib->storage = attrib_INLINE;
+    buf = attrib->value.small;
+
+  } else if(attrib->storage == attrib_HEAP && attrib->value.alloc >= len) {
+    buf = attrib->data.data;
+
+  } else {
+    if(attrib->storage == attrib_HEAP)
+      g_free(attrib->data.data);
+
+    attrib->storage = attrib_HEAP;
+    attrib->value.alloc = len;
+    buf = g_malloc(len);
+  }
+
+  /* the incoming value may be the very data being replaced */
+  memmove(buf, data->data, len);
+  attrib->data.data = buf;
+  attrib->data.len = len;
+
+  attrib->as_boolean = attrib_decode_boolean(buf, len);
+  attrib->as_integer = attrib_decode_integer(buf, len);
+}
+
+
+static struct aware_shard *shard_for(struct mwServiceAware *srvc,
+				     const struct mwAwareIdBlock *id) {
+
+  return srvc->shards + (mwAwareIdBlock_hash(id) % srvc->shard_count);
+}
+
+
+static struct aware_shard *shard_by_channel(struct mwServiceAware *srvc,
+					    struct mwChannel *chan) {
+  guint i;
+
+  for(i = 0; i < srvc->shard_count; i++) {
+    if(srvc->shards[i].channel == chan)
+      return srvc->shards + i;
+  }
+
+  return NULL;
+}
+
+
+static GHashTable *entries_new(void) {
+  return g_hash_table_new_full((GHashFunc) mwAwareIdBlock_hash,
+			       (GEqualFunc) mwAwareIdBlock_equal,
+			       NULL,
+			       (GDestroyNotify) aware_entry_free);
+}
+
+
 static struct aware_entry *aware_find(struct mwServiceAware *srvc,
 				      struct mwAwareIdBlock *srch) {
+  struct aware_shard *shard;
+
   g_return_val_if_fail(srvc != NULL, NULL);
-  g_return_val_if_fail(srvc->entries != NULL, NULL);
+  g_return_val_if_fail(srvc->shards != NULL, NULL);
   g_return_val_if_fail(srch != NULL, NULL);
+
+  shard = shard_for(srvc, srch);
+  g_return_val_if_fail(shard->entries != NULL, NULL);
   
-  return g_hash_table_lookup(srvc->entries, srch);
+  return g_hash_table_lookup(shard->entries, srch);
 }
 
 
@@ -159,6 +346,10 @@ static struct aware_entry *list_aware_find(struct mwAwareList *list,
 }
 
 
+#define COALESCING(srvc) \
+  ((srvc)->coalesce_window && MW_SERVICE_IS_LIVE(srvc))
+
+
 static void compose_list(struct mwPutBuffer *b, GList *id_list) {
   guint32_put(b, g_list_length(id_list));
   for(; id_list; id_list = id_list->next)
@@ -184,6 +375,37 @@ static int send_add(struct mwChannel *chan, GList *id_list) {
 }
 
 
+/** send every entry in a map of ENTRY_KEY(aware_entry):aware_entry,
+    composed straight from the map rather than from a collected
+    list, which matters for large watch sets on reconnect */
+static int send_add_all(struct mwChannel *chan, GHashTable *entries) {
+  struct mwPutBuffer *b;
+  struct mwOpaque o;
+  GHashTableIter iter;
+  gpointer v;
+  int ret;
+
+  g_return_val_if_fail(chan != NULL, 0);
+
+  b = mwPutBuffer_new();
+  guint32_put(b, g_hash_table_size(entries));
+
+  map_iter_init(&iter, entries);
+  while(map_iter_next(&iter, NULL, &v)) {
+    struct aware_entry *aware = v;
+    mwAwareIdBlock_put(b, ENTRY_KEY(aware));
+    aware->upstream = TRUE;
+  }
+
+  mwPutBuffer_finalize(&o, b);
+
+  ret = mwChannel_send(chan, msg_AWARE_ADD, &o);
+  mwOpaque_clear(&o);
+
+  return ret;
+}
+
+
 static int send_rem(struct mwChannel *chan, GList *id_list) {
   struct mwPutBuffer *b = mwPutBuffer_new();
   struct mwOpaque o;
@@ -227,16 +449,21 @@ static int remove_unused(struct mwServiceAware *srvc) {
   */
 
   int ret = 0;
-  GList *dead = NULL, *l;
+  guint i;
+
+  g_info("bring out your dead *clang*");
+
+  for(i = 0; i < srvc->shard_count; i++) {
+    struct aware_shard *shard = srvc->shards + i;
+    GList *dead = NULL, *l;
+
+    if(shard->entries)
+      g_hash_table_foreach_steal(shard->entries, collect_dead, &dead);
+
+    if(! dead) continue;
 
-  if(srvc->entries) {
-    g_info("bring out your dead *clang*");
-    g_hash_table_foreach_steal(srvc->entries, collect_dead, &dead);
-  }
- 
-  if(dead) {
     if(MW_SERVICE_IS_LIVE(srvc))
-      ret = send_rem(srvc->channel, dead) || ret;
+      ret = send_rem(shard->channel, dead) || ret;
     
     for(l = dead; l; l = l->next)
       aware_entry_free(l->data);
@@ -248,35 +475,164 @@ static int remove_unused(struct mwServiceAware *srvc) {
 }
 
 
-static int send_attrib_list(struct mwServiceAware *srvc) {
+static void pending_mark(struct mwServiceAware *srvc,
+			 struct aware_entry *aware) {
+
+  struct mwAwareHandler *handler = srvc->handler;
+  gboolean opened;
+
+  if(! srvc->pending)
+    srvc->pending = g_hash_table_new((GHashFunc) mwAwareIdBlock_hash,
+				     (GEqualFunc) mwAwareIdBlock_equal);
+
+  opened = ! g_hash_table_size(srvc->pending);
+  g_hash_table_insert(srvc->pending, ENTRY_KEY(aware), aware);
+
+  if(opened && handler && handler->schedule_flush)
+    handler->schedule_flush(srvc, srvc->coalesce_window);
+}
+
+
+struct pending_collect {
+  GList *adds;
+  GList *dead;
+};
+
+
+static gboolean collect_pending(gpointer key, gpointer val, gpointer data) {
+  // `key` unused
+  (void)key;
+  struct aware_entry *aware = val;
+  struct pending_collect *pc = data;
+
+  if(aware->membership) {
+    if(! aware->upstream)
+      pc->adds = g_list_prepend(pc->adds, aware);
+
+  } else {
+    pc->dead = g_list_prepend(pc->dead, aware);
+  }
+
+  return TRUE;
+}
+
+
+static int pending_flush(struct mwServiceAware *srvc) {
+  /* - steal everything from the pending set
+     - entries which gained a member and were never sent are added,
+     unless their shard is yet to be accepted, which sends them all
+     - entries which lost all members are removed from the service,
+     and those which had been sent are removed upstream
+     - anything else had its changes cancel out
+  */
+
+  struct pending_collect pc = { NULL, NULL };
+  GList **adds, **rem, *l;
+  gboolean live;
+  guint i;
+  int ret = 0;
+
+  if(! srvc->pending) return 0;
+  g_hash_table_foreach_steal(srvc->pending, collect_pending, &pc);
+
+  live = MW_SERVICE_IS_LIVE(srvc);
+
+  /* sort the changes out by shard, as each has its own channel */
+  adds = g_new0(GList *, srvc->shard_count);
+  rem = g_new0(GList *, srvc->shard_count);
+
+  for(l = pc.adds; l; l = l->next) {
+    struct aware_entry *aware = l->data;
+    i = shard_for(srvc, ENTRY_KEY(aware)) - srvc->shards;
+    adds[i] = g_list_prepend(adds[i], aware);
+  }
+
+  for(l = pc.dead; l; l = l->next) {
+    struct aware_entry *aware = l->data;
+    struct aware_shard *shard = shard_for(srvc, ENTRY_KEY(aware));
+
+    g_hash_table_steal(shard->entries, ENTRY_KEY(aware));
+
+    i = shard - srvc->shards;
+    if(aware->upstream) rem[i] = g_list_prepend(rem[i], aware);
+  }
+
+  for(i = 0; i < srvc->shard_count; i++) {
+    struct aware_shard *shard = srvc->shards + i;
+    struct mwChannel *chan = shard->channel;
+
+    if(live && chan && shard->accepted && adds[i]) {
+      ret = send_add(chan, adds[i]) || ret;
+
+      for(l = adds[i]; l; l = l->next)
+	((struct aware_entry *) l->data)->upstream = TRUE;
+    }
+
+    if(live && chan && rem[i])
+      ret = send_rem(chan, rem[i]) || ret;
+
+    g_list_free(adds[i]);
+    g_list_free(rem[i]);
+  }
+
+  for(l = pc.dead; l; l = l->next)
+    aware_entry_free(l->data);
+
+  g_free(adds);
+  g_free(rem);
+  g_list_free(pc.adds);
+  g_list_free(pc.dead);
+
+  return ret;
+}
+
+
+static int send_attrib_chan(struct mwServiceAware *srvc,
+			    struct mwChannel *chan) {
   struct mwPutBuffer *b;
   struct mwOpaque o;
 
+  GHashTableIter iter;
+  gpointer k;
   int tmp;
-  GList *l;
 
   g_return_val_if_fail(srvc != NULL, -1);
-  g_return_val_if_fail(srvc->channel != NULL, 0);
-
-  l = map_collect_keys(srvc->attribs);
-  tmp = g_list_length(l);
+  g_return_val_if_fail(chan != NULL, 0);
 
   b = mwPutBuffer_new();
   guint32_put(b, 0x00);
-  guint32_put(b, tmp);
-  
-  for(; l; l = g_list_delete_link(l, l)) {
-    guint32_put(b, GPOINTER_TO_UINT(l->data));
+  guint32_put(b, g_hash_table_size(srvc->attribs));
+
+  map_iter_init(&iter, srvc->attribs);
+  while(map_iter_next(&iter, &k, NULL)) {
+    guint32_put(b, GPOINTER_TO_UINT(k));
   }
 
   mwPutBuffer_finalize(&o, b);
-  tmp = mwChannel_send(srvc->channel, msg_OPT_WATCH, &o);
+  tmp = mwChannel_send(chan, msg_OPT_WATCH, &o);
   mwOpaque_clear(&o);
 
   return tmp;
 }
 
 
+/** the attribute watch list applies per channel, so it has to be
+    sent over each shard's channel */
+static int send_attrib_list(struct mwServiceAware *srvc) {
+  int ret = 0;
+  guint i;
+
+  g_return_val_if_fail(srvc != NULL, -1);
+
+  for(i = 0; i < srvc->shard_count; i++) {
+    struct mwChannel *chan = srvc->shards[i].channel;
+    if(chan) ret = send_attrib_chan(srvc, chan) || ret;
+  }
+
+  return ret;
+}
+
+
 static gboolean collect_attrib_dead(gpointer key, gpointer val,
 				    gpointer data) {
 
@@ -315,20 +671,31 @@ static void recv_accept(struct mwServiceAware *srvc,
 			struct mwChannel *chan,
 			struct mwMsgChannelAccept *msg) {
 
+  struct aware_shard *shard;
+
   // `msg` unused
   (void)msg;
 
-  g_return_if_fail(srvc->channel != NULL);
-  g_return_if_fail(srvc->channel == chan);
+  g_return_if_fail(chan != NULL);
+
+  shard = shard_by_channel(srvc, chan);
+  g_return_if_fail(shard != NULL);
 
   if(MW_SERVICE_IS_STARTING(MW_SERVICE(srvc))) {
-    GList *list = NULL;
+    guint i;
+
+    /* anything still pending is either dead or about to be sent */
+    pending_flush(srvc);
 
-    list = map_collect_values(srvc->entries);
-    send_add(chan, list);
-    g_list_free(list);
+    send_add_all(chan, shard->entries);
 
-    send_attrib_list(srvc);
+    send_attrib_chan(srvc, chan);
+    shard->accepted = TRUE;
+
+    /* the service is only started once every shard is open */
+    for(i = 0; i < srvc->shard_count; i++) {
+      if(! srvc->shards[i].accepted) return;
+    }
 
     mwService_started(MW_SERVICE(srvc));
 
@@ -342,12 +709,20 @@ static void recv_destroy(struct mwServiceAware *srvc,
 			 struct mwChannel *chan,
 			 struct mwMsgChannelDestroy *msg) {
 
-  // `chan` unused
-  (void)chan;
+  struct aware_shard *shard;
+
   // `msg` unused
   (void)msg;
 
-  srvc->channel = NULL;
+  /* losing any one shard stops the whole service, which will take
+     care of the others */
+  shard = shard_by_channel(srvc, chan);
+  if(shard) {
+    shard->channel = NULL;
+    shard->accepted = FALSE;
+  }
+
+  pending_flush(srvc);
   mwService_stop(MW_SERVICE(srvc));
 
   /** @todo session sense service and mwService_start */
@@ -370,10 +745,18 @@ static void status_recv(struct mwServiceAware *srvc,
        status */
     return;
   }
+
+  /* the server will re-send identical status, eg after a reconnect.
+     There's nothing new to tell the lists in that case */
+  if(aware->known && mwAwareSnapshot_equal(&aware->aware, idb)) {
+    srvc->suppressed++;
+    return;
+  }
   
   /* clear the existing status, then clone in the new status */
   mwAwareSnapshot_clear(&aware->aware);
   mwAwareSnapshot_clone(&aware->aware, idb);
+  aware->known = TRUE;
   
   /* trigger each of the entry's lists */
   for(l = aware->membership; l; l = l->next) {
@@ -411,8 +794,7 @@ static void attrib_recv(struct mwServiceAware *srvc,
     g_hash_table_insert(aware->attribs, k, old_attrib);
   }
   
-  mwOpaque_clear(&old_attrib->data);
-  mwOpaque_clone(&old_attrib->data, &attrib->data);
+  attrib_store(old_attrib, &attrib->data);
   
   for(l = aware->membership; l; l = l->next) {
     struct mwAwareList *list = l->data;
@@ -449,7 +831,8 @@ static gboolean list_add(struct mwAwareList *list,
 					   (GDestroyNotify) attrib_free);
     mwAwareIdBlock_clone(ENTRY_KEY(aware), id);
 
-    g_hash_table_insert(srvc->entries, ENTRY_KEY(aware), aware);
+    g_hash_table_insert(shard_for(srvc, id)->entries,
+			ENTRY_KEY(aware), aware);
   }
 
   aware->membership = g_list_append(aware->membership, list);
@@ -460,34 +843,76 @@ static gboolean list_add(struct mwAwareList *list,
 }
 
 
+/** tell a list the status already known for one of its entries. The
+    server's repeat of it is suppressed by status_recv, so a list
+    joining an entry other lists have had status for would otherwise
+    never hear of it */
+static void list_known(struct mwAwareList *list, struct mwAwareIdBlock *id) {
+  struct mwAwareListHandler *handler = list->handler;
+  struct aware_entry *aware;
+
+  aware = list_aware_find(list, id);
+  if(aware && aware->known && handler && handler->on_aware)
+    handler->on_aware(list, &aware->aware);
+}
+
+
 static void group_member_recv(struct mwServiceAware *srvc,
 			      struct mwAwareSnapshot *idb) {
-  /* @todo
-     - look up group by id
-     - find each list group belongs to
-     - add user to lists
+  /* - look up group by id
+     - if the member is already known to the group, it's already in
+     each of the group's lists
+     - otherwise remember it, and add user to lists
+     - send a single add for the member, if it's not already upstream
   */
 
   struct mwAwareIdBlock gsrch = { mwAware_GROUP, idb->group, NULL };
-  struct aware_entry *grp;
-  GList *l, *m;
+  struct mwAwareIdBlock *member;
+  struct aware_entry *grp, *aware;
+  GList *joined = NULL, *m;
 
   grp = aware_find(srvc, &gsrch);
   g_return_if_fail(grp != NULL); /* this could happen, with timing. */
 
-  l = g_list_prepend(NULL, &idb->id);
+  if(! grp->members) {
+    grp->members = g_hash_table_new_full((GHashFunc) mwAwareIdBlock_hash,
+					 (GEqualFunc) mwAwareIdBlock_equal,
+					 (GDestroyNotify) member_free, NULL);
+
+  } else if(g_hash_table_lookup(grp->members, &idb->id)) {
+    return;
+  }
+
+  member = g_new0(struct mwAwareIdBlock, 1);
+  mwAwareIdBlock_clone(member, &idb->id);
+  g_hash_table_insert(grp->members, member, member);
 
   for(m = grp->membership; m; m = m->next) {
+    if(list_add(m->data, member))
+      joined = g_list_prepend(joined, m->data);
+  }
+
+  if(! joined) return;
+  aware = aware_find(srvc, member);
+
+  /* if we just list_add, we won't receive updates for attributes, so
+     the member is added upstream too, once however many lists it
+     joined */
+  if(COALESCING(srvc)) {
+    pending_mark(srvc, aware);
 
-    /* if we just list_add, we won't receive updates for attributes,
-       so annoyingly we have to turn around and send out an add aware
-       message for each incoming group member */
+  } else if(MW_SERVICE_IS_LIVE(srvc) && ! aware->upstream) {
+    struct aware_shard *shard = shard_for(srvc, member);
+    GList *l = g_list_prepend(NULL, member);
 
-    /* list_add(m->data, &idb->id); */
-    mwAwareList_addAware(m->data, l);
+    send_add(shard->channel, l);
+    aware->upstream = TRUE;
+    g_list_free(l);
   }
 
-  g_list_free(l);
+  joined = g_list_reverse(joined);
+  for(; joined; joined = g_list_delete_link(joined, joined))
+    list_known(joined->data, &idb->id);
 }
 
 
@@ -606,63 +1031,95 @@ static void recv_OPT_GOT_UNSET(struct mwServiceAware *srvc,
 }
 
 
-static void recv(struct mwService *srvc, struct mwChannel *chan,
-		 guint16 type, struct mwOpaque *data) {
+/** wraps one of the recv_ functions above as a mwService_funcRecv, for
+    the service's dispatch table */
+#define HANDLER(msg)							\
+  static void handle_##msg(struct mwService *srvc,			\
+			   struct mwChannel *chan,			\
+			   guint16 type, struct mwOpaque *data) {	\
+    struct mwServiceAware *srvc_aware = (struct mwServiceAware *) srvc; \
+    struct mwGetBuffer *b;						\
+    (void)type;								\
+    g_return_if_fail(shard_by_channel(srvc_aware, chan) != NULL);	\
+    g_return_if_fail(data != NULL);					\
+    b = mwGetBuffer_wrap(data);						\
+    recv_##msg(srvc_aware, b);						\
+    mwGetBuffer_free(b);						\
+  }
 
-  struct mwServiceAware *srvc_aware = (struct mwServiceAware *) srvc;
-  struct mwGetBuffer *b;
 
-  g_return_if_fail(srvc_aware->channel == chan);
-  g_return_if_fail(srvc->session == mwChannel_getSession(chan));
-  g_return_if_fail(data != NULL);
+HANDLER(SNAPSHOT)
+HANDLER(UPDATE)
+HANDLER(GROUP)
+HANDLER(OPT_GOT_SET)
+HANDLER(OPT_GOT_UNSET)
 
-  b = mwGetBuffer_wrap(data);
 
-  switch(type) {
-  case msg_AWARE_SNAPSHOT:
-    recv_SNAPSHOT(srvc_aware, b);
-    break;
+#undef HANDLER
 
-  case msg_AWARE_UPDATE:
-    recv_UPDATE(srvc_aware, b);
-    break;
 
-  case msg_AWARE_GROUP:
-    recv_GROUP(srvc_aware, b);
-    break;
+static void handle_ignored(struct mwService *srvc, struct mwChannel *chan,
+			   guint16 type, struct mwOpaque *data) {
 
-  case msg_OPT_GOT_SET:
-    recv_OPT_GOT_SET(srvc_aware, b);
-    break;
+  // `srvc` `chan` `type` `data` unused
+  (void)srvc;
+  (void)chan;
+  (void)type;
+  (void)data;
+}
 
-  case msg_OPT_GOT_UNSET:
-    recv_OPT_GOT_UNSET(srvc_aware, b);
-    break;
 
-  case msg_OPT_GOT_UNKNOWN:
-  case msg_OPT_DID_SET:
-  case msg_OPT_DID_UNSET:
-  case msg_OPT_DID_ERROR:
-    break;
+static const struct mwServiceHandler handlers[] = {
+  { msg_AWARE_SNAPSHOT,   handle_SNAPSHOT },
+  { msg_AWARE_UPDATE,     handle_UPDATE },
+  { msg_AWARE_GROUP,      handle_GROUP },
+  { msg_OPT_GOT_SET,      handle_OPT_GOT_SET },
+  { msg_OPT_GOT_UNSET,    handle_OPT_GOT_UNSET },
+  { msg_OPT_GOT_UNKNOWN,  handle_ignored },
+  { msg_OPT_DID_SET,      handle_ignored },
+  { msg_OPT_DID_UNSET,    handle_ignored },
+  { msg_OPT_DID_ERROR,    handle_ignored },
+};
 
-  default:
-    mw_mailme_opaque(data, "unknown message in aware service: 0x%04x", type);
-  }
 
-  mwGetBuffer_free(b);  
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *srvc, struct mwChannel *chan,
+		 guint16 type, struct mwOpaque *data) {
+
+  // `srvc` `chan` unused
+  (void)srvc;
+  (void)chan;
+
+  mw_mailme_opaque(data, "unknown message in aware service: 0x%04x", type);
 }
 
 
 static void clear(struct mwService *srvc) {
   struct mwServiceAware *srvc_aware = (struct mwServiceAware *) srvc;
+  guint i;
 
   g_return_if_fail(srvc != NULL);
 
   while(srvc_aware->lists)
     mwAwareList_free( (struct mwAwareList *) srvc_aware->lists->data );
 
-  g_hash_table_destroy(srvc_aware->entries);
-  srvc_aware->entries = NULL;
+  if(srvc_aware->pending) {
+    g_hash_table_destroy(srvc_aware->pending);
+    srvc_aware->pending = NULL;
+  }
+
+  for(i = 0; i < srvc_aware->shard_count; i++) {
+    struct aware_shard *shard = srvc_aware->shards + i;
+
+    if(shard->entries) {
+      g_hash_table_destroy(shard->entries);
+      shard->entries = NULL;
+    }
+  }
+
+  g_free(srvc_aware->shards);
+  srvc_aware->shards = NULL;
+  srvc_aware->shard_count = 0;
 
   g_hash_table_destroy(srvc_aware->attribs);
   srvc_aware->attribs = NULL;
@@ -696,17 +1153,39 @@ static struct mwChannel *make_blist(struct mwServiceAware *srvc,
 }
 
 
+static void stop_shards(struct mwServiceAware *srvc) {
+  guint i;
+
+  for(i = 0; i < srvc->shard_count; i++) {
+    struct aware_shard *shard = srvc->shards + i;
+
+    if(shard->channel) {
+      mwChannel_destroy(shard->channel, ERR_SUCCESS, NULL);
+      shard->channel = NULL;
+    }
+    shard->accepted = FALSE;
+  }
+}
+
+
 static void start(struct mwService *srvc) {
   struct mwServiceAware *srvc_aware;
-  struct mwChannel *chan = NULL;
+  struct mwChannelSet *cs;
+  guint i;
 
   srvc_aware = (struct mwServiceAware *) srvc;
-  chan = make_blist(srvc_aware, mwSession_getChannels(srvc->session));
+  cs = mwSession_getChannels(srvc->session);
 
-  if(chan != NULL) {
-    srvc_aware->channel = chan;
-  } else {
-    mwService_stopped(srvc);
+  for(i = 0; i < srvc_aware->shard_count; i++) {
+    struct mwChannel *chan = make_blist(srvc_aware, cs);
+
+    if(! chan) {
+      stop_shards(srvc_aware);
+      mwService_stopped(srvc);
+      return;
+    }
+
+    srvc_aware->shards[i].channel = chan;
   }
 }
 
@@ -716,11 +1195,8 @@ static void stop(struct mwService *srvc) {
 
   srvc_aware = (struct mwServiceAware *) srvc;
 
-  if(srvc_aware->channel) {
-    mwChannel_destroy(srvc_aware->channel, ERR_SUCCESS, NULL);
-    srvc_aware->channel = NULL;
-  }
-
+  stop_shards(srvc_aware);
+  pending_flush(srvc_aware);
   mwService_stopped(srvc);
 }
 
@@ -737,10 +1213,10 @@ mwServiceAware_new(struct mwSession *session,
 
   srvc = g_new0(struct mwServiceAware, 1);
   srvc->handler = handler;
-  srvc->entries = g_hash_table_new_full((GHashFunc) mwAwareIdBlock_hash,
-					(GEqualFunc) mwAwareIdBlock_equal,
-					NULL,
-					(GDestroyNotify) aware_entry_free);
+
+  srvc->shard_count = 1;
+  srvc->shards = g_new0(struct aware_shard, 1);
+  srvc->shards->entries = entries_new();
 
   srvc->attribs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
 					(GDestroyNotify) attrib_entry_free);
@@ -757,10 +1233,91 @@ mwServiceAware_new(struct mwSession *session,
   service->get_name = name;
   service->get_desc = desc;
 
+  mwService_setHandlers(service, handlers, G_N_ELEMENTS(handlers));
+
   return srvc;
 }
 
 
+void mwServiceAware_setCoalesceWindow(struct mwServiceAware *srvc,
+				      guint window_ms) {
+  g_return_if_fail(srvc != NULL);
+
+  srvc->coalesce_window = window_ms;
+  if(! window_ms) pending_flush(srvc);
+}
+
+
+guint mwServiceAware_getCoalesceWindow(struct mwServiceAware *srvc) {
+  g_return_val_if_fail(srvc != NULL, 0);
+  return srvc->coalesce_window;
+}
+
+
+int mwServiceAware_flush(struct mwServiceAware *srvc) {
+  g_return_val_if_fail(srvc != NULL, -1);
+  return pending_flush(srvc);
+}
+
+
+static gboolean rehome_entry(gpointer key, gpointer val, gpointer data) {
+  // `key` unused
+  (void)key;
+  struct aware_entry *aware = val;
+  struct mwServiceAware *srvc = data;
+
+  g_hash_table_insert(shard_for(srvc, ENTRY_KEY(aware))->entries,
+		      ENTRY_KEY(aware), aware);
+  return TRUE;
+}
+
+
+int mwServiceAware_setShardCount(struct mwServiceAware *srvc, guint count) {
+  struct aware_shard *old;
+  guint old_count, i;
+
+  g_return_val_if_fail(srvc != NULL, -1);
+  g_return_val_if_fail(count > 0, -1);
+  g_return_val_if_fail(! MW_SERVICE_IS_LIVE(srvc), -1);
+
+  if(count == srvc->shard_count) return 0;
+
+  old = srvc->shards;
+  old_count = srvc->shard_count;
+
+  srvc->shards = g_new0(struct aware_shard, count);
+  srvc->shard_count = count;
+
+  for(i = 0; i < count; i++)
+    srvc->shards[i].entries = entries_new();
+
+  /* move every entry over to its new shard. The old tables are
+     stolen from so that the entries aren't free'd along with them */
+  for(i = 0; i < old_count; i++) {
+    GHashTable *entries = old[i].entries;
+
+    if(! entries) continue;
+    g_hash_table_foreach_steal(entries, rehome_entry, srvc);
+    g_hash_table_destroy(entries);
+  }
+
+  g_free(old);
+  return 0;
+}
+
+
+guint mwServiceAware_getShardCount(struct mwServiceAware *srvc) {
+  g_return_val_if_fail(srvc != NULL, 0);
+  return srvc->shard_count;
+}
+
+
+guint64 mwServiceAware_getSuppressedCount(struct mwServiceAware *srvc) {
+  g_return_val_if_fail(srvc != NULL, 0);
+  return srvc->suppressed;
+}
+
+
 int mwServiceAware_setAttribute(struct mwServiceAware *srvc,
 				guint32 key, struct mwOpaque *data) {
   struct mwPutBuffer *b;
@@ -776,7 +1333,7 @@ int mwServiceAware_setAttribute(struct mwServiceAware *srvc,
   mwOpaque_put(b, data);
 
   mwPutBuffer_finalize(&o, b);
-  ret = mwChannel_send(srvc->channel, msg_OPT_DO_SET, &o);
+  ret = mwChannel_send(srvc->shards->channel, msg_OPT_DO_SET, &o);
   mwOpaque_clear(&o);
 
   return ret;
@@ -851,7 +1408,7 @@ int mwServiceAware_unsetAttribute(struct mwServiceAware *srvc,
   guint32_put(b, key);
   
   mwPutBuffer_finalize(&o, b);
-  ret = mwChannel_send(srvc->channel, msg_OPT_DO_UNSET, &o);
+  ret = mwChannel_send(srvc->shards->channel, msg_OPT_DO_UNSET, &o);
   mwOpaque_clear(&o);
 
   return ret;
@@ -865,63 +1422,14 @@ guint32 mwAwareAttribute_getKey(const struct mwAwareAttribute *attrib) {
 
 
 gboolean mwAwareAttribute_asBoolean(const struct mwAwareAttribute *attrib) {
-  struct mwGetBuffer *b;
-  gboolean ret;
-  
   if(! attrib) return FALSE;
-
-  b = mwGetBuffer_wrap(&attrib->data);
-  if(attrib->data.len >= 4) {
-    guint32 r32 = 0x00;
-    guint32_get(b, &r32);
-    ret = !! r32;
-
-  } else if(attrib->data.len >= 2) {
-    guint16 r16 = 0x00;
-    guint16_get(b, &r16);
-    ret = !! r16;
-
-  } else if(attrib->data.len) {
-    gboolean_get(b, &ret);
-  }
-
-  mwGetBuffer_free(b);
-
-  return ret;
+  return attrib->as_boolean;
 }
 
 
 guint32 mwAwareAttribute_asInteger(const struct mwAwareAttribute *attrib) {
-  struct mwGetBuffer *b;
-  guint32 r32 = 0x00;
-  
   if(! attrib) return 0x00;
-
-  b = mwGetBuffer_wrap(&attrib->data);
-  if(attrib->data.len >= 4) {
-    guint32_get(b, &r32);
-
-  } else if(attrib->data.len == 3) {
-    gboolean rb = FALSE;
-    guint16 r16 = 0x00;
-    gboolean_get(b, &rb);
-    guint16_get(b, &r16);
-    r32 = (guint32) r16;
-
-  } else if(attrib->data.len == 2) {
-    guint16 r16 = 0x00;
-    guint16_get(b, &r16);
-    r32 = (guint32) r16;
-
-  } else if(attrib->data.len) {
-    gboolean rb = FALSE;
-    gboolean_get(b, &rb);
-    r32 = (guint32) rb;
-  }
-
-  mwGetBuffer_free(b);
-
-  return r32;
+  return attrib->as_integer;
 }
 
 
@@ -1170,7 +1678,7 @@ int mwAwareList_addAware(struct mwAwareList *list, GList *id_list) {
   */
 
   struct mwServiceAware *srvc;
-  GList *additions = NULL;
+  GList *additions = NULL, *groups = NULL, *known = NULL;
   int ret = 0;
 
   g_return_val_if_fail(list != NULL, -1);
@@ -1179,16 +1687,67 @@ int mwAwareList_addAware(struct mwAwareList *list, GList *id_list) {
   g_return_val_if_fail(srvc != NULL, -1);
 
   for(; id_list; id_list = id_list->next) {
-    if(list_add(list, id_list->data))
-      additions = g_list_prepend(additions, id_list->data);
+    struct mwAwareIdBlock *id = id_list->data;
+    struct aware_entry *aware;
+
+    if(! list_add(list, id))
+      continue;
+
+    /* a group already being watched by another list brings along
+       the members it's known to have so far */
+    aware = list_aware_find(list, id);
+    if(aware->members)
+      groups = g_list_prepend(groups, aware);
+
+    if(aware->known)
+      known = g_list_prepend(known, id);
+
+    if(COALESCING(srvc)) {
+      pending_mark(srvc, aware);
+    } else {
+      additions = g_list_prepend(additions, id);
+    }
   }
 
   /* if the service is alive-- or getting there-- we'll need to send
      these additions upstream */
-  if(MW_SERVICE_IS_LIVE(srvc) && additions)
-    ret = send_add(srvc->channel, additions);
+  if(MW_SERVICE_IS_LIVE(srvc) && additions) {
+    guint i;
+
+    for(i = 0; i < srvc->shard_count; i++) {
+      struct aware_shard *shard = srvc->shards + i;
+      GList *l, *sent = NULL;
+
+      for(l = additions; l; l = l->next) {
+	if(shard_for(srvc, l->data) == shard)
+	  sent = g_list_prepend(sent, l->data);
+      }
+
+      if(! sent) continue;
+
+      ret = send_add(shard->channel, sent) || ret;
+      for(l = sent; l; l = l->next)
+	aware_find(srvc, l->data)->upstream = TRUE;
+
+      g_list_free(sent);
+    }
+  }
 
   g_list_free(additions);
+
+  for(; groups; groups = g_list_delete_link(groups, groups)) {
+    struct aware_entry *grp = groups->data;
+    GList *members = map_collect_values(grp->members);
+
+    ret = mwAwareList_addAware(list, members) || ret;
+    g_list_free(members);
+  }
+
+  /* only once the list is complete, as the handler may change it */
+  known = g_list_reverse(known);
+  for(; known; known = g_list_delete_link(known, known))
+    list_known(list, known->data);
+
   return ret;
 }
 
@@ -1225,9 +1784,12 @@ int mwAwareList_removeAware(struct mwAwareList *list, GList *id_list) {
 
     aware->membership = g_list_remove(aware->membership, list);
     g_hash_table_remove(list->entries, id);
+
+    if(COALESCING(srvc))
+      pending_mark(srvc, aware);
   }
 
-  return remove_unused(srvc);
+  return COALESCING(srvc)? 0: remove_unused(srvc);
 }
 
 
@@ -1238,6 +1800,9 @@ static void dismember_aware(gpointer k, struct aware_entry *aware,
   (void)k;
 
   aware->membership = g_list_remove(aware->membership, list);
+
+  if(COALESCING(list->service))
+    pending_mark(list->service, aware);
 }
 
 
@@ -1254,9 +1819,10 @@ int mwAwareList_removeAllAware(struct mwAwareList *list) {
   if(list->entries) {
     g_hash_table_foreach(list->entries, (GHFunc) dismember_aware, list);
     g_hash_table_destroy(list->entries);
+    list->entries = NULL;
   }
 
-  return remove_unused(srvc);
+  return COALESCING(srvc)? 0: remove_unused(srvc);
 }
 
 
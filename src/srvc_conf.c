@@ -45,7 +45,7 @@
 
 
 /** @see mwMsgChannelSend::type
-    @see recv */
+    @see handlers */
 enum msg_type {
   msg_WELCOME  = 0x0000,  /**< welcome message */
   msg_INVITE   = 0x0001,  /**< outgoing invitation */
@@ -522,37 +522,52 @@ static void MESSAGE_recv(struct mwServiceConference *srvc,
 }
 
 
-static void recv(struct mwService *srvc, struct mwChannel *chan,
-		 guint16 type, struct mwOpaque *data) {
+/** wraps one of the _recv functions above as a mwService_funcRecv, for
+    the service's dispatch table */
+#define HANDLER(msg)							\
+  static void handle_##msg(struct mwService *srvc,			\
+			   struct mwChannel *chan,			\
+			   guint16 type, struct mwOpaque *data) {	\
+    struct mwServiceConference *srvc_conf;				\
+    struct mwConference *conf;						\
+    struct mwGetBuffer *b;						\
+    (void)type;								\
+    srvc_conf = (struct mwServiceConference *) srvc;			\
+    conf = conf_find(srvc_conf, chan);					\
+    g_return_if_fail(conf != NULL);					\
+    b = mwGetBuffer_wrap(data);						\
+    msg##_recv(srvc_conf, conf, b);					\
+    mwGetBuffer_free(b);						\
+  }
 
-  struct mwServiceConference *srvc_conf = (struct mwServiceConference *) srvc;
-  struct mwConference *conf = conf_find(srvc_conf, chan);
-  struct mwGetBuffer *b;
 
-  g_return_if_fail(conf != NULL);
+HANDLER(WELCOME)
+HANDLER(JOIN)
+HANDLER(PART)
+HANDLER(MESSAGE)
 
-  b = mwGetBuffer_wrap(data);
 
-  switch(type) {
-  case msg_WELCOME:
-    WELCOME_recv(srvc_conf, conf, b);
-    break;
+#undef HANDLER
 
-  case msg_JOIN:
-    JOIN_recv(srvc_conf, conf, b);
-    break;
 
-  case msg_PART:
-    PART_recv(srvc_conf, conf, b);
-    break;
+static const struct mwServiceHandler handlers[] = {
+  { msg_WELCOME,  handle_WELCOME },
+  { msg_JOIN,     handle_JOIN },
+  { msg_PART,     handle_PART },
+  { msg_MESSAGE,  handle_MESSAGE },
+};
 
-  case msg_MESSAGE:
-    MESSAGE_recv(srvc_conf, conf, b);
-    break;
 
-  default:
-    ; /* hrm. should log this. TODO */
-  }
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *srvc, struct mwChannel *chan,
+		 guint16 type, struct mwOpaque *data) {
+
+  // `srvc` `chan` unused
+  (void)srvc;
+  (void)chan;
+
+  mw_mailme_opaque(data, "unknown message in conference service: 0x%04x",
+		   type);
 }
 
 
@@ -622,6 +637,8 @@ mwServiceConference_new(struct mwSession *session,
 
   srvc_conf->handler = handler;
 
+  mwService_setHandlers(srvc, handlers, G_N_ELEMENTS(handlers));
+
   return srvc_conf;
 }
 
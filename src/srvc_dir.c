@@ -53,6 +53,9 @@ struct mwServiceDirectory {
   guint32 counter;       /**< counter of request IDs */
   GHashTable *requests;  /**< map of request ID:directory */
   GHashTable *books;     /**< book->name:mwAddressBook */
+
+  guint prefetch;        /**< pages to fetch ahead of the one viewed */
+  guint cache_pages;     /**< pages to keep for each address book */
 };
 
 
@@ -62,6 +65,19 @@ struct mwAddressBook {
   guint32 id;        /**< id or type or something */
   char *name;        /**< name of address book */
   GHashTable *dirs;  /**< dir->id:mwDirectory */
+
+  GHashTable *pages;  /**< page->key:dir_page, shared by the dirs */
+  GQueue page_lru;    /**< the same pages, most recently used first */
+};
+
+
+/** a page of search results, as a directory's handler is given it */
+struct dir_page {
+  char *key;         /**< from page_key */
+  guint ref;         /**< held by the cache, and during delivery */
+  guint32 offset;    /**< offset of the page, from the server */
+  GList *members;    /**< list of mwDirectoryMember */
+  GList link;        /**< this page's place in page_lru */
 };
 
 
@@ -76,6 +92,15 @@ struct mwDirectory {
 
   mwSearchHandler handler;
   struct mw_datum client_data;
+
+  char *query;        /**< current search, empty for browsing */
+  guint page;         /**< index of the page being viewed */
+  gint server;        /**< page the server's cursor is on, or -1 */
+  guint end;          /**< count of pages, once known */
+  guint page_len;     /**< members in the first page */
+  guint32 pending;    /**< request ID of the page being fetched */
+  guint pending_page; /**< index of the page being fetched */
+  gboolean want;      /**< the handler is waiting on the viewed page */
 };
 
 
@@ -96,6 +121,7 @@ static guint32 map_request(struct mwDirectory *dir) {
 /** called when directory is removed from the service directory map */
 static void dir_free(struct mwDirectory *dir) {
   map_guint_remove(dir->service->requests, dir->search_id);
+  g_free(dir->query);
   g_free(dir);
 }
 
@@ -108,14 +134,108 @@ static void dir_remove(struct mwDirectory *dir) {
 }
 
 
-__attribute__((used))
-static struct mwDirectory *dir_new(struct mwAddressBook *book, guint32 id) {
-  struct mwDirectory *dir = g_new0(struct mwDirectory, 1);
-  dir->service = book->service;
-  dir->book = book;
-  dir->id = id;
-  map_guint_insert(book->dirs, id, dir);
-  return dir;
+/** add an opened directory to its owning address book, under the id
+    the server gave it */
+static void dir_register(struct mwDirectory *dir) {
+  map_guint_insert(dir->book->dirs, dir->id, dir);
+}
+
+
+static void free_members(GList *members) {
+  for(; members; members = g_list_delete_link(members, members)) {
+    struct mwDirectoryMember *m = members->data;
+    g_free(m->id);
+    g_free(m->long_name);
+    g_free(m->short_name);
+    g_free(m);
+  }
+}
+
+
+static char *page_key(const char *query, guint index) {
+  return g_strdup_printf("%u:%s", index, query);
+}
+
+
+static struct dir_page *page_new(const char *query, guint index,
+				 guint32 offset, GList *members) {
+
+  struct dir_page *page = g_new0(struct dir_page, 1);
+  page->key = page_key(query, index);
+  page->ref = 1;
+  page->offset = offset;
+  page->members = members;
+  page->link.data = page;
+  return page;
+}
+
+
+static void page_unref(struct dir_page *page) {
+  if(--page->ref) return;
+
+  g_free(page->key);
+  free_members(page->members);
+  g_free(page);
+}
+
+
+static void page_drop(struct mwAddressBook *book, struct dir_page *page) {
+  g_queue_unlink(&book->page_lru, &page->link);
+  g_hash_table_remove(book->pages, page->key);
+  page_unref(page);
+}
+
+
+/** drop the least recently used pages until there are no more than
+    size left */
+static void book_trim(struct mwAddressBook *book, guint size) {
+  while(book->page_lru.length > size)
+    page_drop(book, book->page_lru.tail->data);
+}
+
+
+/** find a cached page without counting it as used */
+static struct dir_page *page_peek(struct mwAddressBook *book,
+				  const char *query, guint index) {
+  struct dir_page *page;
+  char *key;
+
+  key = page_key(query, index);
+  page = g_hash_table_lookup(book->pages, key);
+  g_free(key);
+
+  return page;
+}
+
+
+static struct dir_page *page_lookup(struct mwAddressBook *book,
+				    const char *query, guint index) {
+
+  struct dir_page *page = page_peek(book, query, index);
+
+  if(page) {
+    g_queue_unlink(&book->page_lru, &page->link);
+    g_queue_push_head_link(&book->page_lru, &page->link);
+  }
+
+  return page;
+}
+
+
+static void page_store(struct mwAddressBook *book, struct dir_page *page) {
+  struct dir_page *old;
+  guint size = book->service->cache_pages;
+
+  if(! size) return;
+
+  old = g_hash_table_lookup(book->pages, page->key);
+  if(old) page_drop(book, old);
+
+  page->ref++;
+  g_hash_table_insert(book->pages, page->key, page);
+  g_queue_push_head_link(&book->page_lru, &page->link);
+
+  book_trim(book, size);
 }
 
 
@@ -123,7 +243,10 @@ static struct mwDirectory *dir_new(struct mwAddressBook *book, guint32 id) {
     directories as well */
 static void book_free(struct mwAddressBook *book) {
   g_hash_table_destroy(book->dirs);
+  book_trim(book, 0);
+  g_hash_table_destroy(book->pages);
   g_free(book->name);
+  g_free(book);
 }
 
 
@@ -141,7 +264,10 @@ static struct mwAddressBook *book_new(struct mwServiceDirectory *srvc,
   book->id = id;
   book->name = g_strdup(name);
   book->dirs = map_guint_new_full((GDestroyNotify) dir_free);
-  g_hash_table_insert(srvc->books, book->name, book);
+  book->pages = g_hash_table_new(g_str_hash, g_str_equal);
+
+  /* replaced, key and all, as a book of the same name is freed */
+  g_hash_table_replace(srvc->books, book->name, book);
   return book;
 }
 
@@ -296,64 +422,329 @@ static void recv_list(struct mwServiceDirectory *srvc,
     book_new(srvc, name, id);
     g_free(name);
   }
+
+  mwGetBuffer_free(b);
+}
+
+
+/** send a search request, moving the server's cursor one page
+    forward or back */
+static int dir_step(struct mwDirectory *dir, gboolean forward) {
+  struct mwChannel *chan = dir->service->channel;
+  struct mwPutBuffer *b;
+  struct mwOpaque o;
+  int ret;
+
+  g_return_val_if_fail(chan != NULL, -1);
+
+  b = mwPutBuffer_new();
+  guint32_put(b, map_request(dir));
+  guint32_put(b, dir->id);
+
+  if(forward) {
+    guint16_put(b, 0xffff);      /* some magic? */
+    guint32_put(b, 0x00000000);  /* next results */
+  } else {
+    guint16_put(b, 0x0061);      /* some magic? */
+    guint32_put(b, 0x00000001);  /* prev results */
+  }
+
+  mwPutBuffer_finalize(&o, b);
+  ret = mwChannel_send(chan, action_search, &o);
+  mwOpaque_clear(&o);
+
+  return ret;
+}
+
+
+/** send a search request, moving the server's cursor to the first
+    page of results for the directory's query */
+static int dir_seek(struct mwDirectory *dir) {
+  struct mwChannel *chan = dir->service->channel;
+  struct mwPutBuffer *b;
+  struct mwOpaque o;
+  int ret;
+
+  g_return_val_if_fail(chan != NULL, -1);
+
+  b = mwPutBuffer_new();
+  guint32_put(b, map_request(dir));
+  guint32_put(b, dir->id);
+  guint16_put(b, 0x0061);      /* some magic? */
+  guint32_put(b, 0x00000008);  /* seek results */
+  mwString_put(b, dir->query);
+
+  mwPutBuffer_finalize(&o, b);
+  ret = mwChannel_send(chan, action_search, &o);
+  mwOpaque_clear(&o);
+
+  return ret;
+}
+
+
+/** Fetch the first page the directory needs and doesn't have: the
+    viewed page if the handler is waiting on it, then any missing
+    pages within prefetch of it. The server only moves its cursor a
+    page at a time, so the page fetched may be one on the way there.
+    One page is fetched at a time, the next once it arrives. */
+static int dir_fetch(struct mwDirectory *dir) {
+  struct mwServiceDirectory *srvc = dir->service;
+  guint ahead = MIN(srvc->prefetch, srvc->cache_pages);
+  guint t, last;
+  int ret;
+
+  if(dir->pending || ! dir->query) return 0;
+  if(dir->page >= dir->end) return 0;
+
+  last = MIN(dir->page + ahead, dir->end - 1);
+
+  /* the viewed page is only missing if it's still wanted */
+  t = dir->page;
+  if(! dir->want) {
+    for(t++; t <= last; t++)
+      if(! page_peek(dir->book, dir->query, t)) break;
+    if(t > last) return 0;
+  }
+
+  if(dir->server < 0 || (t == 0 && dir->server == 0)) {
+    /* browsing has no query to seek with, but starts at the top */
+    ret = *dir->query? dir_seek(dir): dir_step(dir, TRUE);
+    dir->pending_page = 0;
+
+  } else if(t > (guint) dir->server) {
+    ret = dir_step(dir, TRUE);
+    dir->pending_page = dir->server + 1;
+
+  } else {
+    ret = dir_step(dir, FALSE);
+    dir->pending_page = dir->server - 1;
+  }
+
+  if(ret) {
+    map_guint_remove(srvc->requests, dir->search_id);
+  } else {
+    dir->pending = dir->search_id;
+  }
+
+  return ret;
+}
+
+
+/** deliver the viewed page from the cache if it's there, otherwise
+    wait on it. Either way, fetch whatever else is wanted */
+static int dir_show(struct mwDirectory *dir) {
+  struct dir_page *page;
+  int ret;
+
+  page = page_lookup(dir->book, dir->query, dir->page);
+  dir->want = (page == NULL);
+
+  ret = dir_fetch(dir);
+
+  if(page) {
+    page->ref++;
+    dir->handler(dir, ERR_SUCCESS, page->offset, page->members);
+    page_unref(page);
+  }
+
+  return ret;
 }
 
 
 static void recv_open(struct mwServiceDirectory *srvc,
 		      struct mwOpaque *data) {
 
-  // `srvc` unused
-  (void)srvc;
-  // `data` unused
-  (void)data;
+  struct mwDirectoryHandler *handler = srvc->handler;
+  struct mwGetBuffer *b;
+  guint32 request, code;
+  struct mwDirectory *dir;
 
   /* look up the directory associated with this request id, 
      mark it as open, and trigger the event */
+
+  b = mwGetBuffer_wrap(data);
+  guint32_get(b, &request);
+  guint32_get(b, &code);
+
+  dir = map_guint_lookup(srvc->requests, request);
+  map_guint_remove(srvc->requests, request);
+
+  if(! dir || ! MW_DIRECTORY_IS_PENDING(dir)) {
+    g_debug("no directory pending on request 0x%x", request);
+
+  } else if(code || mwGetBuffer_error(b)) {
+    dir->state = mwDirectory_ERROR;
+    if(handler->dir_closed)
+      handler->dir_closed(dir, code? code: ERR_FAILURE);
+
+  } else {
+    gboolean foo_1;
+    guint16 foo_2;
+
+    guint32_get(b, &dir->id);
+    gboolean_get(b, &foo_1);
+    guint16_get(b, &foo_2);
+
+    dir->state = mwDirectory_OPEN;
+    dir_register(dir);
+
+    if(handler->dir_opened)
+      handler->dir_opened(dir);
+  }
+
+  mwGetBuffer_free(b);
+}
+
+
+static GList *load_members(struct mwGetBuffer *b, guint32 count) {
+  GList *members = NULL;
+
+  while(count-- && ! mwGetBuffer_error(b)) {
+    struct mwDirectoryMember *m = g_new0(struct mwDirectoryMember, 1);
+
+    guint16_get(b, &m->type);
+    mwString_get(b, &m->id);
+    mwString_get(b, &m->long_name);
+    mwString_get(b, &m->short_name);
+    guint16_get(b, &m->foo);
+
+    members = g_list_prepend(members, m);
+  }
+
+  return g_list_reverse(members);
 }
 
 
 static void recv_search(struct mwServiceDirectory *srvc,
 			struct mwOpaque *data) {
 
-  // `srvc` unused
-  (void)srvc;
-  // `data` unused
-  (void)data;
+  struct mwGetBuffer *b;
+  guint32 request, code, offset = 0, count = 0;
+  struct mwDirectory *dir;
+  struct dir_page *page;
+  GList *members = NULL;
+  guint index;
+  gboolean deliver;
 
   /* look up the directory associated with this request id,
      trigger the event */
-}
 
+  b = mwGetBuffer_wrap(data);
+  guint32_get(b, &request);
+  guint32_get(b, &code);
 
-static void recv(struct mwServiceDirectory *srvc,
-		 struct mwChannel *chan,
-		 guint16 msg_type, struct mwOpaque *data) {
-  
-  g_return_if_fail(srvc != NULL);
-  g_return_if_fail(chan != NULL);
-  g_return_if_fail(chan == srvc->channel);
-  g_return_if_fail(data != NULL);
+  dir = map_guint_lookup(srvc->requests, request);
+  map_guint_remove(srvc->requests, request);
+
+  /* replies to searches since replaced are of no more use */
+  if(! dir || ! dir->pending || dir->pending != request) {
+    mwGetBuffer_free(b);
+    return;
+  }
+
+  dir->pending = 0;
+  index = dir->pending_page;
+  dir->server = index;
+
+  if(! code) {
+    guint32_get(b, &offset);
+    guint32_get(b, &count);
+    members = load_members(b, count);
+
+    if(mwGetBuffer_error(b)) {
+      g_warning("error parsing directory search results");
+      code = ERR_FAILURE;
+    }
+  }
+  mwGetBuffer_free(b);
+
+  if(code) {
+    free_members(members);
+
+    /* fetch no further, and tell the handler if it's waiting */
+    dir->end = MIN(dir->end, index);
+    deliver = dir->want;
+    dir->want = FALSE;
+
+    if(deliver) dir->handler(dir, code, 0, NULL);
+    return;
+  }
+
+  /* a page shorter than the first, or an empty one, is past the
+     last of the results */
+  if(index == 0) dir->page_len = count;
+  if(! count) {
+    dir->end = MIN(dir->end, index);
+  } else if(count < dir->page_len) {
+    dir->end = MIN(dir->end, index + 1);
+  }
+
+  page = page_new(dir->query, index, offset, members);
+  if(count) page_store(dir->book, page);
 
-  switch(msg_type) {
-  case action_list:
-    recv_list(srvc, data);
-    break;
+  deliver = dir->want && index == dir->page;
+  if(deliver) dir->want = FALSE;
 
-  case action_open:
-    recv_open(srvc, data);
-    break;
+  /* keep fetching before calling the handler, which may destroy the
+     directory */
+  dir_fetch(dir);
 
-  case action_close:
-    ; /* I don't think we should receive these */
-    break;
+  if(deliver) dir->handler(dir, ERR_SUCCESS, offset, page->members);
+  page_unref(page);
+}
 
-  case action_search:
-    recv_search(srvc, data);
-    break;
 
-  default:
-    mw_mailme_opaque(data, "msg type 0x%04x in directory service", msg_type);
+/** wraps one of the recv_ functions above as a mwService_funcRecv, for
+    the service's dispatch table */
+#define HANDLER(msg)							\
+  static void handle_##msg(struct mwService *service,			\
+			   struct mwChannel *chan,			\
+			   guint16 type, struct mwOpaque *data) {	\
+    struct mwServiceDirectory *srvc;					\
+    (void)type;								\
+    srvc = (struct mwServiceDirectory *) service;			\
+    g_return_if_fail(chan == srvc->channel);				\
+    g_return_if_fail(data != NULL);					\
+    recv_##msg(srvc, data);						\
   }
+
+
+HANDLER(list)
+HANDLER(open)
+HANDLER(search)
+
+
+#undef HANDLER
+
+
+static void handle_ignored(struct mwService *srvc, struct mwChannel *chan,
+			   guint16 type, struct mwOpaque *data) {
+
+  // `srvc` `chan` `type` `data` unused
+  (void)srvc;
+  (void)chan;
+  (void)type;
+  (void)data;
+}
+
+
+static const struct mwServiceHandler handlers[] = {
+  { action_list,    handle_list },
+  { action_open,    handle_open },
+  { action_close,   handle_ignored },  /* shouldn't be received */
+  { action_search,  handle_search },
+};
+
+
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *srvc, struct mwChannel *chan,
+		 guint16 msg_type, struct mwOpaque *data) {
+
+  // `srvc` `chan` unused
+  (void)srvc;
+  (void)chan;
+
+  mw_mailme_opaque(data, "msg type 0x%04x in directory service", msg_type);
 }
 
 
@@ -379,12 +770,15 @@ mwServiceDirectory_new(struct mwSession *session,
   service->recv_create = (mwService_funcRecvCreate) recv_create;
   service->recv_accept = (mwService_funcRecvAccept) recv_accept;
   service->recv_destroy = (mwService_funcRecvDestroy) recv_destroy;
-  service->recv = (mwService_funcRecv) recv;
+  service->recv = recv;
 
   srvc->handler = handler;
   srvc->requests = map_guint_new();
   srvc->books = g_hash_table_new_full(g_str_hash, g_str_equal,
 				      NULL, (GDestroyNotify) book_free);
+
+  mwService_setHandlers(service, handlers, G_N_ELEMENTS(handlers));
+
   return srvc;
 }
 
@@ -418,6 +812,22 @@ int mwServiceDirectory_refreshAddressBooks(struct mwServiceDirectory *srvc) {
 }
 
 
+void mwServiceDirectory_setPaging(struct mwServiceDirectory *srvc,
+				  guint prefetch, guint cache) {
+  GHashTableIter iter;
+  gpointer v;
+
+  g_return_if_fail(srvc != NULL);
+
+  srvc->prefetch = prefetch;
+  srvc->cache_pages = cache;
+
+  map_iter_init(&iter, srvc->books);
+  while(map_iter_next(&iter, NULL, &v))
+    book_trim(v, cache);
+}
+
+
 GList *mwServiceDirectory_getAddressBooks(struct mwServiceDirectory *srvc) {
   g_return_val_if_fail(srvc != NULL, NULL);
   g_return_val_if_fail(srvc->books != NULL, NULL);
@@ -555,96 +965,63 @@ int mwDirectory_open(struct mwDirectory *dir, mwSearchHandler cb) {
 }
 
 
-int mwDirectory_next(struct mwDirectory *dir) {  
-  struct mwServiceDirectory *srvc;
-  struct mwChannel *chan;
-  struct mwPutBuffer *b;
-  struct mwOpaque o;
-  int ret;
+/** start over with a new query, or an empty one for browsing */
+static void dir_reset(struct mwDirectory *dir, const char *query) {
 
-  g_return_val_if_fail(dir != NULL, -1);
-  g_return_val_if_fail(MW_DIRECTORY_IS_OPEN(dir), -1);
+  /* forget any page still on its way for an earlier query */
+  if(dir->pending) {
+    map_guint_remove(dir->service->requests, dir->pending);
+    dir->pending = 0;
+  }
 
-  srvc = dir->service;
-  g_return_val_if_fail(srvc != NULL, -1);
+  g_free(dir->query);
+  dir->query = g_strdup(query);
+  dir->page = 0;
+  dir->server = -1;
+  dir->end = G_MAXUINT;
+  dir->page_len = 0;
+}
 
-  chan = srvc->channel;
-  g_return_val_if_fail(chan != NULL, -1);
 
-  b = mwPutBuffer_new();
-  guint32_put(b, map_request(dir));
-  guint32_put(b, dir->id);
-  guint16_put(b, 0xffff);      /* some magic? */
-  guint32_put(b, 0x00000000);  /* next results */
+int mwDirectory_next(struct mwDirectory *dir) {
+  g_return_val_if_fail(dir != NULL, -1);
+  g_return_val_if_fail(MW_DIRECTORY_IS_OPEN(dir), -1);
+  g_return_val_if_fail(dir->service->channel != NULL, -1);
 
-  mwPutBuffer_finalize(&o, b);
-  ret = mwChannel_send(chan, action_search, &o);
-  mwOpaque_clear(&o);
+  /* the first next of a fresh directory lists its first page */
+  if(! dir->query) {
+    dir_reset(dir, "");
+    return dir_show(dir);
+  }
 
-  return ret;
+  if(dir->page + 1 >= dir->end) return -1;
+
+  dir->page++;
+  return dir_show(dir);
 }
 
 
 int mwDirectory_previous(struct mwDirectory *dir) {
-  struct mwServiceDirectory *srvc;
-  struct mwChannel *chan;
-  struct mwPutBuffer *b;
-  struct mwOpaque o;
-  int ret;
-
   g_return_val_if_fail(dir != NULL, -1);
   g_return_val_if_fail(MW_DIRECTORY_IS_OPEN(dir), -1);
+  g_return_val_if_fail(dir->service->channel != NULL, -1);
 
-  srvc = dir->service;
-  g_return_val_if_fail(srvc != NULL, -1);
-
-  chan = srvc->channel;
-  g_return_val_if_fail(chan != NULL, -1);
+  if(! dir->query || ! dir->page) return -1;
 
-  b = mwPutBuffer_new();
-  guint32_put(b, map_request(dir));
-  guint32_put(b, dir->id);
-  guint16_put(b, 0x0061);      /* some magic? */
-  guint32_put(b, 0x00000001);  /* prev results */
-
-  mwPutBuffer_finalize(&o, b);
-  ret = mwChannel_send(chan, action_search, &o);
-  mwOpaque_clear(&o);
-
-  return ret;
+  dir->page--;
+  return dir_show(dir);
 }
 
 
 int mwDirectory_search(struct mwDirectory *dir, const char *query) {
-  struct mwServiceDirectory *srvc;
-  struct mwChannel *chan;
-  struct mwPutBuffer *b;
-  struct mwOpaque o;
-  int ret;
-
   g_return_val_if_fail(dir != NULL, -1);
   g_return_val_if_fail(MW_DIRECTORY_IS_OPEN(dir), -1);
   g_return_val_if_fail(query != NULL, -1);
   g_return_val_if_fail(*query != '\0', -1);
+  g_return_val_if_fail(dir->service->channel != NULL, -1);
 
-  srvc = dir->service;
-  g_return_val_if_fail(srvc != NULL, -1);
-
-  chan = srvc->channel;
-  g_return_val_if_fail(chan != NULL, -1);
-
-  b = mwPutBuffer_new();
-  guint32_put(b, map_request(dir));
-  guint32_put(b, dir->id);
-  guint16_put(b, 0x0061);      /* some magic? */
-  guint32_put(b, 0x00000008);  /* seek results */
-  mwString_put(b, query);
-
-  mwPutBuffer_finalize(&o, b);
-  ret = mwChannel_send(chan, action_search, &o);
-  mwOpaque_clear(&o);
-
-  return ret;
+  dir_reset(dir, query);
+  return dir_show(dir);
 }
 
 
@@ -683,7 +1060,13 @@ int mwDirectory_destroy(struct mwDirectory *dir) {
   if(MW_DIRECTORY_IS_OPEN(dir) || MW_DIRECTORY_IS_PENDING(dir)) {
     ret = dir_close(dir);
   }
-  dir_remove(dir);
+
+  /* only a directory which opened is in its book's map */
+  if(map_guint_lookup(dir->book->dirs, dir->id) == dir) {
+    dir_remove(dir);
+  } else {
+    dir_free(dir);
+  }
 
   return ret;
 }
@@ -19,6 +19,15 @@
 */
 
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include <glib.h>
 
 #include "mw_channel.h"
@@ -29,6 +38,7 @@
 #include "mw_service.h"
 #include "mw_session.h"
 #include "mw_srvc_ft.h"
+#include "mw_timer.h"
 #include "mw_util.h"
 
 
@@ -44,11 +54,39 @@
 #define msg_RECEIVED  0x0002
 
 
+/** chunks a sender may have unacknowledged, unless told otherwise */
+#define DEFAULT_WINDOW  4
+
+
+/** fewest chunks a sender's window may hold. Receivers batch their
+    acks to at most this many chunks, so a full window always draws
+    an ack */
+#define MIN_WINDOW      DEFAULT_WINDOW
+
+
+/** bytes in each chunk a sender sends, unless told otherwise */
+#define DEFAULT_CHUNK   (8 * 1024)
+
+
+/** most bytes a sender may have unacknowledged, whatever its window.
+    Chunks are written to the session as they're sent, so this bounds
+    what a transfer can leave queued there */
+#define MAX_IN_FLIGHT   (1024 * 1024)
+
+
 struct mwServiceFileTransfer {
   struct mwService service;
 
   struct mwFileTransferHandler *handler;
   GList *transfers;
+
+  GQueue active;      /**< transfers sending from a file, in turn */
+  gboolean running;   /**< sched_run is in progress */
+
+  guint64 budget;     /**< bytes per second for all transfers, or 0 */
+  gint64 tokens;      /**< bytes which may be sent now, or owed */
+  gint64 refilled;    /**< monotonic time tokens were last topped up */
+  struct mwTimer timer;  /**< waits on the budget */
 };
 
 
@@ -67,6 +105,32 @@ struct mwFileTransfer {
   guint32 remaining;
 
   struct mw_datum client_data;
+
+  guint64 bytes;      /**< bytes sent or received */
+  guint64 acks;       /**< acknowledgements sent or received */
+  guint in_flight;    /**< chunks sent but not yet acknowledged */
+  gint64 opened_at;   /**< monotonic time the transfer opened */
+
+  guint window;       /**< most chunks to have in flight */
+  gsize chunk;        /**< bytes in each chunk read from source */
+
+  int source;         /**< file being sent by ft_pump, or -1 */
+  guint64 source_off; /**< offset in source of the transfer's start */
+  guchar *buf;        /**< chunk buffer for reading from source */
+  guchar *map;        /**< source mapped from a page boundary, or NULL */
+  gsize map_len;      /**< length of map */
+  gsize map_skip;     /**< offset in map of source_off */
+  gboolean direct;    /**< source goes to the session by io_sendfile */
+
+  int sink;           /**< file being received into, or -1 */
+  guint64 sink_off;   /**< offset in sink of the transfer's start */
+  guchar *sink_buf;   /**< region being received into, or NULL */
+  guint ack_every;    /**< chunks to receive into a sink per ack */
+  guint unacked;      /**< chunks received into a sink, not acked */
+  gboolean blocked;   /**< waiting on the channel to drain */
+
+  guint weight;       /**< chunks to send in each scheduler turn */
+  GList link;         /**< in the service's active queue */
 };
 
 
@@ -119,6 +183,290 @@ static void ft_state(struct mwFileTransfer *ft,
 	 ft_state_str(state));
 
   ft->state = state;
+
+  if(state == mwFileTransfer_OPEN)
+    ft->opened_at = g_get_monotonic_time();
+}
+
+
+/** stop sending from a file, closing it */
+static void ft_source_close(struct mwFileTransfer *ft) {
+  if(ft->source < 0) return;
+
+  g_queue_unlink(&ft->service->active, &ft->link);
+
+  close(ft->source);
+  ft->source = -1;
+
+  g_free(ft->buf);
+  ft->buf = NULL;
+
+#ifdef HAVE_MMAP
+  if(ft->map) munmap(ft->map, ft->map_len);
+#endif
+  ft->map = NULL;
+  ft->direct = FALSE;
+}
+
+
+/** stop receiving into a file or region, closing the file */
+static void ft_sink_close(struct mwFileTransfer *ft) {
+  if(ft->sink >= 0) close(ft->sink);
+  ft->sink = -1;
+  ft->sink_buf = NULL;
+}
+
+
+/** write a received chunk to the sink, at the offset it belongs */
+static int ft_sink_write(struct mwFileTransfer *ft,
+			 struct mwOpaque *data) {
+
+  guint64 done = ft->size - ft->remaining;
+  const guchar *buf = data->data;
+  gsize len = data->len;
+
+  if(ft->sink_buf) {
+    memcpy(ft->sink_buf + done, buf, len);
+    return 0;
+  }
+
+  while(len) {
+    ssize_t ret = pwrite(ft->sink, buf, len,
+			 (off_t) (ft->sink_off + done));
+
+    if(ret > 0) {
+      buf += ret;
+      len -= ret;
+      done += ret;
+
+    } else if(ret < 0 && errno == EINTR) {
+      continue;
+
+    } else {
+      g_warning("error writing file for transfer: %s",
+		ret? g_strerror(errno): "no space");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+/** choose how the source will be sent. Straight from file to socket
+    if the session can and the channel isn't encrypted, otherwise from
+    a read-only mapping of the file, or failing that by reading each
+    chunk into a buffer */
+static void ft_source_open(struct mwFileTransfer *ft) {
+  struct mwChannel *chan = ft->channel;
+  struct mwSession *s = mwChannel_getSession(chan);
+#ifdef HAVE_MMAP
+  struct stat st;
+#endif
+
+  if(mwSession_getHandler(s)->io_sendfile
+     && ! mwChannel_getCipherInstance(chan)) {
+    ft->direct = TRUE;
+    return;
+  }
+
+#ifdef HAVE_MMAP
+  /* a file shorter than the transfer would fault when read through
+     a mapping, so leave those to pread to report */
+  if(ft->remaining && ! fstat(ft->source, &st)
+     && (guint64) st.st_size >= ft->source_off + ft->remaining) {
+
+    long page = sysconf(_SC_PAGESIZE);
+    guint64 start = ft->source_off;
+    void *map;
+
+    if(page > 0) start -= start % page;
+
+    ft->map_skip = ft->source_off - start;
+    ft->map_len = ft->map_skip + ft->remaining;
+
+    map = mmap(NULL, ft->map_len, PROT_READ, MAP_SHARED,
+	       ft->source, (off_t) start);
+
+    if(map != MAP_FAILED) {
+      madvise(map, ft->map_len, MADV_SEQUENTIAL);
+      ft->map = map;
+      return;
+    }
+
+    g_debug("couldn't map file for transfer: %s", g_strerror(errno));
+  }
+#endif
+
+  ft->buf = g_malloc(ft->chunk);
+}
+
+
+/** account for a chunk having been sent */
+static void ft_sent(struct mwFileTransfer *ft, gsize len) {
+  ft->remaining -= len;
+  ft->bytes += len;
+  ft->in_flight++;
+}
+
+
+/** whether the transfer has a chunk it may send now */
+static gboolean ft_ready(struct mwFileTransfer *ft) {
+  return ft->source >= 0 && ! ft->blocked && ft->remaining
+    && mwFileTransfer_isOpen(ft)
+    && ft->in_flight < ft->window;
+}
+
+
+/** send the next chunk from the transfer's source file.
+
+    @returns the bytes sent, or zero if the channel pushed back or the
+    transfer failed and was closed */
+static gsize ft_chunk(struct mwFileTransfer *ft) {
+  guint64 done = ft->size - ft->remaining;
+  guint64 off = ft->source_off + done;
+  gsize len = MIN(ft->chunk, ft->remaining);
+  struct mwOpaque o;
+  ssize_t got;
+  int ret;
+
+  if(ft->direct) {
+    ret = mwChannel_sendFile(ft->channel, msg_TRANSFER,
+			     ft->source, off, len);
+    if(ret) {
+      ft_source_close(ft);
+      mwFileTransfer_close(ft, ERR_FAILURE);
+      return 0;
+    }
+
+    ft_sent(ft, len);
+    if(! ft->remaining) ft_source_close(ft);
+    return len;
+  }
+
+  if(ft->map) {
+    o.data = ft->map + ft->map_skip + done;
+    o.len = len;
+
+  } else {
+    do {
+      got = pread(ft->source, ft->buf, len, off);
+    } while(got < 0 && errno == EINTR);
+
+    if(got <= 0) {
+      g_warning("error reading file for transfer: %s",
+		got? g_strerror(errno): "unexpected end of file");
+      ft_source_close(ft);
+      mwFileTransfer_close(ft, ERR_FAILURE);
+      return 0;
+    }
+
+    o.data = ft->buf;
+    o.len = got;
+  }
+
+  ret = mwFileTransfer_send(ft, &o);
+  if(ret == MW_CHANNEL_WOULD_BLOCK) {
+    ft->blocked = TRUE;
+    return 0;
+
+  } else if(ret) {
+    ft_source_close(ft);
+    mwFileTransfer_close(ft, ERR_FAILURE);
+    return 0;
+  }
+
+  if(! ft->remaining) ft_source_close(ft);
+  return o.len;
+}
+
+
+/** top up the service's byte budget for the time since it was last
+    topped up, holding at most a tenth of a second's worth */
+static void sched_refill(struct mwServiceFileTransfer *srvc) {
+  gint64 now = g_get_monotonic_time();
+  gint64 cap = MAX(srvc->budget / 10, 1);
+  gint64 elapsed = now - srvc->refilled;
+
+  srvc->refilled = now;
+
+  if(elapsed >= G_USEC_PER_SEC) {
+    srvc->tokens = cap;
+  } else if(elapsed > 0) {
+    srvc->tokens += elapsed * srvc->budget / G_USEC_PER_SEC;
+    if(srvc->tokens > cap) srvc->tokens = cap;
+  }
+}
+
+
+static void sched_run(struct mwServiceFileTransfer *srvc);
+
+
+static void sched_timeout(struct mwTimer *timer, gpointer data) {
+  // `timer` unused
+  (void)timer;
+
+  sched_run(data);
+}
+
+
+/** send chunks from every transfer with a source file, in turn, until
+    none can send any more. Each transfer sends up to its weight in
+    chunks per turn. Within a budget, stops once it's spent, and waits
+    on the session's timer wheel for it to be topped up */
+static void sched_run(struct mwServiceFileTransfer *srvc) {
+  struct mwSession *session = mwService_getSession(MW_SERVICE(srvc));
+  struct mwTimerWheel *wheel = mwSession_getTimerWheel(session);
+  gboolean limited = srvc->budget && wheel;
+  guint idle = 0;
+
+  /* sending may close a transfer, calling the client, which may in
+     turn start another. It'll be picked up by the run in progress */
+  if(srvc->running) return;
+  srvc->running = TRUE;
+
+  if(limited) sched_refill(srvc);
+
+  while(idle < srvc->active.length) {
+    GList *l = srvc->active.head;
+    struct mwFileTransfer *ft = l->data;
+    gboolean sent = FALSE;
+    guint i;
+
+    /* move to the back before sending, as a failure unlinks it */
+    g_queue_unlink(&srvc->active, l);
+    g_queue_push_tail_link(&srvc->active, l);
+
+    for(i = 0; i < ft->weight && ft_ready(ft); i++) {
+      gsize len;
+
+      if(limited && srvc->tokens <= 0) {
+	guint msec = (- srvc->tokens) * 1000 / srvc->budget + 1;
+	mwTimer_schedule(&srvc->timer, wheel, msec);
+	srvc->running = FALSE;
+	return;
+      }
+
+      /* ft may be gone if this fails */
+      len = ft_chunk(ft);
+      if(! len) break;
+
+      if(limited) srvc->tokens -= len;
+      sent = TRUE;
+    }
+
+    idle = sent? 0: idle + 1;
+  }
+
+  srvc->running = FALSE;
+}
+
+
+/** have the scheduler look at the transfer's service, as it may now
+    be able to send */
+static void ft_pump(struct mwFileTransfer *ft) {
+  if(ft->source < 0) return;
+  sched_run(ft->service);
 }
 
 
@@ -220,6 +568,28 @@ static void recv_channelDestroy(struct mwServiceFileTransfer *srvc,
 }
 
 
+/** acknowledge count chunks received into a sink. A single chunk gets
+    the plain, empty ack that every client expects */
+static int ft_ack(struct mwFileTransfer *ft, guint count) {
+  struct mwPutBuffer *b;
+  struct mwOpaque o;
+  int ret;
+
+  if(count <= 1)
+    return mwFileTransfer_ack(ft);
+
+  b = mwPutBuffer_new();
+  guint32_put(b, count);
+  mwPutBuffer_finalize(&o, b);
+
+  ft->acks++;
+  ret = mwChannel_sendEncrypted(ft->channel, msg_RECEIVED, &o, FALSE);
+  mwOpaque_clear(&o);
+
+  return ret;
+}
+
+
 static void recv_TRANSFER(struct mwFileTransfer *ft,
 			  struct mwOpaque *data) {
 
@@ -234,8 +604,30 @@ static void recv_TRANSFER(struct mwFileTransfer *ft,
   if(data->len > ft->remaining) {
     /* @todo handle error */
 
+  } else if(ft->sink >= 0 || ft->sink_buf) {
+    if(ft_sink_write(ft, data)) {
+      mwFileTransfer_close(ft, ERR_FAILURE);
+      return;
+    }
+
+    ft->remaining -= data->len;
+    ft->bytes += data->len;
+    ft->unacked++;
+
+    /* the last chunk is always acked, as the sender waits on it */
+    if(! ft->remaining || ft->unacked >= ft->ack_every) {
+      ft_ack(ft, ft->unacked);
+      ft->unacked = 0;
+    }
+
+    if(! ft->remaining) {
+      ft_sink_close(ft);
+      ft_state(ft, mwFileTransfer_DONE);
+    }
+
   } else {
     ft->remaining -= data->len;
+    ft->bytes += data->len;
 
     if(! ft->remaining)
       ft_state(ft, mwFileTransfer_DONE);
@@ -249,54 +641,104 @@ static void recv_TRANSFER(struct mwFileTransfer *ft,
 static void recv_RECEIVED(struct mwFileTransfer *ft,
 			  struct mwOpaque *data) {
 
-  // `data` unused
-  (void)data;
-
   struct mwServiceFileTransfer *srvc;
   struct mwFileTransferHandler *handler;
+  guint32 count = 1;
+  gboolean done;
   
   srvc = ft->service;
   handler = srvc->handler;
 
-  if(! ft->remaining)
+  /* a batched ack carries the count of chunks it covers, a plain one
+     covers a single chunk */
+  if(data->len) {
+    struct mwGetBuffer *b = mwGetBuffer_wrap(data);
+    guint32_get(b, &count);
+    if(mwGetBuffer_error(b) || ! count) count = 1;
+    mwGetBuffer_free(b);
+  }
+
+  ft->acks++;
+  ft->in_flight -= MIN(count, ft->in_flight);
+
+  /* done once the last of the chunks sent has been acked */
+  done = ! ft->remaining && ! ft->in_flight;
+
+  if(done)
     ft_state(ft, mwFileTransfer_DONE);
 
   if(handler->ft_ack)
     handler->ft_ack(ft);
 
-  if(! ft->remaining)
+  if(done) {
     mwFileTransfer_close(ft, mwFileTransfer_SUCCESS);
+    return;
+  }
+
+  /* last, as a failed send closes and likely frees the transfer */
+  ft_pump(ft);
 }
 
 
+/** wraps one of the recv_ functions above as a mwService_funcRecv, for
+    the service's dispatch table */
+#define HANDLER(msg)							\
+  static void handle_##msg(struct mwService *srvc,			\
+			   struct mwChannel *chan,			\
+			   guint16 type, struct mwOpaque *data) {	\
+    struct mwFileTransfer *ft;						\
+    (void)srvc;								\
+    (void)type;								\
+    ft = mwChannel_getServiceData(chan);				\
+    g_return_if_fail(ft != NULL);					\
+    recv_##msg(ft, data);						\
+  }
+
+
+HANDLER(TRANSFER)
+HANDLER(RECEIVED)
+
+
+#undef HANDLER
+
+
+static const struct mwServiceHandler handlers[] = {
+  { msg_TRANSFER,  handle_TRANSFER },
+  { msg_RECEIVED,  handle_RECEIVED },
+};
+
+
+/** only sees those message types missing from the handlers table */
 static void recv(struct mwService *srvc, struct mwChannel *chan,
 		 guint16 type, struct mwOpaque *data) {
 
-  // `srvc` unused
+  // `srvc` `chan` unused
   (void)srvc;
+  (void)chan;
 
+  mw_mailme_opaque(data, "unknown message in ft service: 0x%04x", type);
+}
+
+
+/** the channel has room again after refusing a chunk */
+static void drained(struct mwService *srvc, struct mwChannel *chan) {
   struct mwFileTransfer *ft;
-  
-  ft = mwChannel_getServiceData(chan);
-  g_return_if_fail(ft != NULL);
 
-  switch(type) {
-  case msg_TRANSFER:
-    recv_TRANSFER(ft, data);
-    break;
+  // `srvc` unused
+  (void)srvc;
 
-  case msg_RECEIVED:
-    recv_RECEIVED(ft, data);
-    break;
+  ft = mwChannel_getServiceData(chan);
+  if(! ft) return;
 
-  default:
-    mw_mailme_opaque(data, "unknown message in ft service: 0x%04x", type);
-  }
+  ft->blocked = FALSE;
+  ft_pump(ft);
 }
 
 
 static void clear(struct mwServiceFileTransfer *srvc) {
   struct mwFileTransferHandler *h;
+
+  mwTimer_cancel(&srvc->timer);
   
   h = srvc->handler;
   if(h && h->clear)
@@ -329,6 +771,8 @@ static void start(struct mwService *srvc) {
 
 
 static void stop(struct mwServiceFileTransfer *srvc) {
+  mwTimer_cancel(&srvc->timer);
+
   while(srvc->transfers) {
     mwFileTransfer_free(srvc->transfers->data);
   }
@@ -350,11 +794,15 @@ mwServiceFileTransfer_new(struct mwSession *session,
   srvc_ft = g_new0(struct mwServiceFileTransfer, 1);
   srvc = MW_SERVICE(srvc_ft);
 
+  g_queue_init(&srvc_ft->active);
+  mwTimer_init(&srvc_ft->timer, sched_timeout, srvc_ft);
+
   mwService_init(srvc, session, mwService_FILE_TRANSFER);
   srvc->recv_create = (mwService_funcRecvCreate) recv_channelCreate;
   srvc->recv_accept = (mwService_funcRecvAccept) recv_channelAccept;
   srvc->recv_destroy = (mwService_funcRecvDestroy) recv_channelDestroy;
   srvc->recv = recv;
+  srvc->drained = drained;
   srvc->clear = (mwService_funcClear) clear;
   srvc->get_name = name;
   srvc->get_desc = desc;
@@ -363,6 +811,8 @@ mwServiceFileTransfer_new(struct mwSession *session,
 
   srvc_ft->handler = handler;
 
+  mwService_setHandlers(srvc, handlers, G_N_ELEMENTS(handlers));
+
   return srvc_ft;
 }
 
@@ -397,6 +847,13 @@ mwFileTransfer_new(struct mwServiceFileTransfer *srvc,
   ft->filename = g_strdup(filename);
   ft->message = g_strdup(msg);
   ft->size = ft->remaining = filesize;
+  ft->window = DEFAULT_WINDOW;
+  ft->chunk = DEFAULT_CHUNK;
+  ft->source = -1;
+  ft->sink = -1;
+  ft->ack_every = 1;
+  ft->weight = 1;
+  ft->link.data = ft;
 
   ft_state(ft, mwFileTransfer_NEW);
 
@@ -569,6 +1026,9 @@ int mwFileTransfer_close(struct mwFileTransfer *ft, guint32 code) {
   if(mwFileTransfer_isOpen(ft))
     ft_state(ft, mwFileTransfer_CANCEL_LOCAL);
 
+  ft_source_close(ft);
+  ft_sink_close(ft);
+
   if(ft->channel) {
     ret = mwChannel_destroy(ft->channel, code, NULL);
     ft->channel = NULL;
@@ -602,6 +1062,8 @@ void mwFileTransfer_free(struct mwFileTransfer *ft) {
   }
 
   mwFileTransfer_removeClientData(ft);
+  ft_source_close(ft);
+  ft_sink_close(ft);
 
   mwIdBlock_clear(&ft->who);
   g_free(ft->filename);
@@ -629,7 +1091,7 @@ int mwFileTransfer_send(struct mwFileTransfer *ft,
   }
 
   ret = mwChannel_send(chan, msg_TRANSFER, data);
-  if(! ret) ft->remaining -= data->len;
+  if(! ret) ft_sent(ft, data->len);
   
   /* we're not done until we receive an ACK for the last piece of
      outgoing data */
@@ -647,10 +1109,147 @@ int mwFileTransfer_ack(struct mwFileTransfer *ft) {
   g_return_val_if_fail(chan != NULL, -1);
   g_return_val_if_fail(mwChannel_isIncoming(chan), -1);
 
+  ft->acks++;
   return mwChannel_sendEncrypted(chan, msg_RECEIVED, NULL, FALSE);
 }
 
 
+int mwFileTransfer_sendFile(struct mwFileTransfer *ft, int fd,
+			    guint64 offset) {
+
+  g_return_val_if_fail(ft != NULL, -1);
+  g_return_val_if_fail(fd >= 0, -1);
+  g_return_val_if_fail(ft->source < 0, -1);
+  g_return_val_if_fail(mwFileTransfer_isOpen(ft), -1);
+  g_return_val_if_fail(ft->channel != NULL, -1);
+  g_return_val_if_fail(mwChannel_isOutgoing(ft->channel), -1);
+
+  /* the source's offsets, and its mapping, are all relative to the
+     start of the transfer */
+  g_return_val_if_fail(ft->remaining == ft->size, -1);
+
+  /* there'll be no acks to finish an empty transfer */
+  if(! ft->size) {
+    close(fd);
+    ft_state(ft, mwFileTransfer_DONE);
+    return mwFileTransfer_close(ft, mwFileTransfer_SUCCESS);
+  }
+
+  ft->source = fd;
+  ft->source_off = offset;
+  ft_source_open(ft);
+  g_queue_push_tail_link(&ft->service->active, &ft->link);
+
+  ft_pump(ft);
+  return 0;
+}
+
+
+void mwFileTransfer_setWindow(struct mwFileTransfer *ft,
+			      guint window, gsize chunk) {
+
+  g_return_if_fail(ft != NULL);
+  g_return_if_fail(window > 0);
+  g_return_if_fail(chunk > 0);
+  g_return_if_fail(chunk <= MAX_IN_FLIGHT / MIN_WINDOW);
+
+  /* the buffer is sized for the chunk, so hold it while sending */
+  g_return_if_fail(! ft->buf || chunk == ft->chunk);
+
+  ft->window = CLAMP(window, MIN_WINDOW, MAX_IN_FLIGHT / chunk);
+  ft->chunk = chunk;
+
+  ft_pump(ft);
+}
+
+
+static gboolean ft_can_sink(struct mwFileTransfer *ft) {
+  g_return_val_if_fail(ft != NULL, FALSE);
+  g_return_val_if_fail(ft->sink < 0 && ! ft->sink_buf, FALSE);
+  g_return_val_if_fail(ft->channel != NULL, FALSE);
+  g_return_val_if_fail(mwChannel_isIncoming(ft->channel), FALSE);
+
+  /* only what's yet to arrive goes to the sink */
+  g_return_val_if_fail(ft->remaining == ft->size, FALSE);
+  return TRUE;
+}
+
+
+int mwFileTransfer_recvFile(struct mwFileTransfer *ft, int fd,
+			    guint64 offset) {
+
+  g_return_val_if_fail(fd >= 0, -1);
+  if(! ft_can_sink(ft)) return -1;
+
+  ft->sink = fd;
+  ft->sink_off = offset;
+  return 0;
+}
+
+
+int mwFileTransfer_recvBuffer(struct mwFileTransfer *ft,
+			      guchar *buf, gsize len) {
+
+  g_return_val_if_fail(buf != NULL, -1);
+  if(! ft_can_sink(ft)) return -1;
+  g_return_val_if_fail(len >= ft->size, -1);
+
+  ft->sink_buf = buf;
+  return 0;
+}
+
+
+void mwFileTransfer_setAckBatch(struct mwFileTransfer *ft, guint chunks) {
+  g_return_if_fail(ft != NULL);
+  ft->ack_every = CLAMP(chunks, 1, MIN_WINDOW);
+}
+
+
+void mwFileTransfer_getStats(struct mwFileTransfer *ft,
+			     struct mwFileTransferStats *stats) {
+
+  g_return_if_fail(ft != NULL);
+  g_return_if_fail(stats != NULL);
+
+  stats->bytes = ft->bytes;
+  stats->acks = ft->acks;
+  stats->in_flight = ft->in_flight;
+  stats->usec = 0;
+  stats->rate = 0;
+  stats->queued = ft->remaining;
+  stats->eta = 0;
+
+  if(ft->opened_at) {
+    stats->usec = g_get_monotonic_time() - ft->opened_at;
+    if(stats->usec)
+      stats->rate = ft->bytes * G_GUINT64_CONSTANT(1000000) / stats->usec;
+  }
+
+  if(stats->rate)
+    stats->eta = stats->queued * G_GUINT64_CONSTANT(1000000) / stats->rate;
+}
+
+
+void mwFileTransfer_setWeight(struct mwFileTransfer *ft, guint weight) {
+  g_return_if_fail(ft != NULL);
+  ft->weight = weight? weight: 1;
+}
+
+
+void mwServiceFileTransfer_setBudget(struct mwServiceFileTransfer *srvc,
+				     guint64 rate) {
+
+  g_return_if_fail(srvc != NULL);
+
+  srvc->budget = rate;
+  srvc->tokens = MAX(rate / 10, 1);
+  srvc->refilled = g_get_monotonic_time();
+
+  mwTimer_cancel(&srvc->timer);
+  sched_run(srvc);
+}
+
+
 void mwFileTransfer_setClientData(struct mwFileTransfer *ft,
 				  gpointer data, GDestroyNotify clean) {
   g_return_if_fail(ft != NULL);
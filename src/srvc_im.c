@@ -666,18 +666,18 @@ static void recv_data(struct mwServiceIm *srvc, struct mwChannel *chan,
 }
 
 
-static void recv(struct mwService *srvc, struct mwChannel *chan,
-		 guint16 type, struct mwOpaque *data) {
+static void recv_MESSAGE(struct mwService *srvc, struct mwChannel *chan,
+			 guint16 type, struct mwOpaque *data) {
 
-  /* - ensure message type is something we want
-     - parse message type into either mwIMText or mwIMData
+  /* - parse message type into either mwIMText or mwIMData
      - handle
   */
 
   struct mwGetBuffer *b;
   guint32 mt;
 
-  g_return_if_fail(type == msg_MESSAGE);
+  // `type` unused
+  (void)type;
 
   b = mwGetBuffer_wrap(data);
   guint32_get(b, &mt);
@@ -708,6 +708,23 @@ static void recv(struct mwService *srvc, struct mwChannel *chan,
 }
 
 
+static const struct mwServiceHandler handlers[] = {
+  { msg_MESSAGE,  recv_MESSAGE },
+};
+
+
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *srvc, struct mwChannel *chan,
+		 guint16 type, struct mwOpaque *data) {
+
+  // `srvc` `chan` unused
+  (void)srvc;
+  (void)chan;
+
+  mw_mailme_opaque(data, "unknown message in IM service: 0x%04x", type);
+}
+
+
 static void clear(struct mwServiceIm *srvc) {
   struct mwImHandler *h;
 
@@ -779,6 +796,8 @@ struct mwServiceIm *mwServiceIm_new(struct mwSession *session,
   srvc_im->features = mwImClient_PLAIN;
   srvc_im->handler = hndl;
 
+  mwService_setHandlers(srvc, handlers, G_N_ELEMENTS(handlers));
+
   return srvc_im;
 }
 
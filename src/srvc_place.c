@@ -631,52 +631,59 @@ static int recv_UNKNOWNa(struct mwPlace *place, struct mwGetBuffer *b) {
 }
 
 
-static void recv(struct mwService *service, struct mwChannel *chan,
-		 guint16 type, struct mwOpaque *data) {
+/** wraps one of the recv_ functions above as a mwService_funcRecv, for
+    the service's dispatch table */
+#define HANDLER(msg)							\
+  static void handle_##msg(struct mwService *service,			\
+			   struct mwChannel *chan,			\
+			   guint16 type, struct mwOpaque *data) {	\
+    struct mwPlace *place;						\
+    struct mwGetBuffer *b;						\
+    (void)service;							\
+    place = mwChannel_getServiceData(chan);				\
+    g_return_if_fail(place != NULL);					\
+    b = mwGetBuffer_wrap(data);						\
+    if(recv_##msg(place, b)) {						\
+      mw_mailme_opaque(data, "Troubling parsing message type 0x0%x"	\
+		       " on place %s", type, NSTR(place->name));	\
+    }									\
+    mwGetBuffer_free(b);						\
+  }
 
-  // `service` unused
-  (void)service;
 
-  struct mwPlace *place;
-  struct mwGetBuffer *b;
-  int res = 0;
+HANDLER(JOIN_RESPONSE)
+HANDLER(INFO)
+HANDLER(MESSAGE)
+HANDLER(SECTION)
+HANDLER(UNKNOWNa)
 
-  place = mwChannel_getServiceData(chan);
-  g_return_if_fail(place != NULL);
 
-  b = mwGetBuffer_wrap(data);
-  switch(type) {
-  case msg_in_JOIN_RESPONSE:
-    res = recv_JOIN_RESPONSE(place, b);
-    break;
+#undef HANDLER
 
-  case msg_in_INFO:
-    res = recv_INFO(place, b);
-    break;
 
-  case msg_in_MESSAGE:
-    res = recv_MESSAGE(place, b);
-    break;
+static const struct mwServiceHandler handlers[] = {
+  { msg_in_JOIN_RESPONSE,  handle_JOIN_RESPONSE },
+  { msg_in_INFO,           handle_INFO },
+  { msg_in_MESSAGE,        handle_MESSAGE },
+  { msg_in_SECTION,        handle_SECTION },
+  { msg_in_UNKNOWNa,       handle_UNKNOWNa },
+};
 
-  case msg_in_SECTION:
-    res = recv_SECTION(place, b);
-    break;
 
-  case msg_in_UNKNOWNa:
-    res = recv_UNKNOWNa(place, b);
-    break;
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *service, struct mwChannel *chan,
+		 guint16 type, struct mwOpaque *data) {
 
-  default:
-    mw_mailme_opaque(data, "Received unknown message type 0x%x on place %s",
-		     type, NSTR(place->name));
-  }
+  // `service` unused
+  (void)service;
 
-  if(res) {
-    mw_mailme_opaque(data, "Troubling parsing message type 0x0%x on place %s",
-		     type, NSTR(place->name));
-  }
+  struct mwPlace *place;
+
+  place = mwChannel_getServiceData(chan);
+  g_return_if_fail(place != NULL);
 
-  mwGetBuffer_free(b);
+  mw_mailme_opaque(data, "Received unknown message type 0x%x on place %s",
+		   type, NSTR(place->name));
 }
 
 
@@ -812,6 +819,8 @@ mwServicePlace_new(struct mwSession *session,
   srvc->get_name = get_name;
   srvc->get_desc = get_desc;
 
+  mwService_setHandlers(srvc, handlers, G_N_ELEMENTS(handlers));
+
   return srvc_place;
 }
 
@@ -19,6 +19,7 @@
 */
 
 #include <glib.h>
+#include <string.h>
 
 #include "mw_channel.h"
 #include "mw_common.h"
@@ -27,6 +28,7 @@
 #include "mw_service.h"
 #include "mw_session.h"
 #include "mw_srvc_resolve.h"
+#include "mw_timer.h"
 
 
 #define PROTOCOL_TYPE  0x00000015
@@ -43,6 +45,28 @@ struct mwServiceResolve {
   struct mwChannel *channel;  /**< channel for this service */
   GHashTable *searches;       /**< guint32:struct mw_search */
   guint32 counter;            /**< incremented to provide searche IDs */
+  guint timeout;              /**< milliseconds a search may take */
+
+  GHashTable *cache;          /**< char*:struct cache_entry, or NULL */
+  GQueue cache_lru;           /**< cache entries, most recent first */
+  guint cache_size;           /**< most entries to keep */
+  guint cache_ttl;            /**< seconds an entry may be used for */
+  struct mwResolveCacheStats cache_stats;
+
+  guint coalesce_msec;        /**< longest to gather a batch for */
+  guint coalesce_max;         /**< most queries to gather in a batch */
+  GHashTable *open;           /**< flags:struct mw_batch, gathering */
+  GHashTable *batches;        /**< guint32:struct mw_batch, sent */
+  GHashTable *pending;        /**< char*:struct batch_slot, unanswered */
+};
+
+
+/** a cached result for a single query */
+struct cache_entry {
+  char *key;                  /**< from cache_key */
+  struct mwResolveResult *result;
+  gint64 expires;             /**< monotonic time, or zero for never */
+  GList link;                 /**< this entry's place in cache_lru */
 };
 
 
@@ -54,9 +78,71 @@ struct mw_search {
   mwResolveHandler handler;
   gpointer data;
   GDestroyNotify cleanup;
+  struct mwTimer timer;       /**< pending if there's a timeout */
+
+  GList *queries;             /**< query strings, kept for the cache */
+  guint32 flags;
+
+  struct batch_slot *slot;    /**< batched query this is waiting on */
+};
+
+
+/** single-query searches with the same flags, gathered to be sent as
+    one request */
+struct mw_batch {
+  struct mwServiceResolve *service;
+  guint32 id;                 /**< ID of the request on the wire */
+  guint32 flags;
+  gboolean sent;              /**< in batches rather than open */
+
+  GList *slots;               /**< struct batch_slot, most recent first */
+  guint count;                /**< length of slots */
+  guint waiters;              /**< searches waiting on any slot */
+
+  struct mwTimer timer;       /**< sends the batch when it's gathered */
 };
 
 
+/** a distinct query in a batch, and the searches waiting on it */
+struct batch_slot {
+  struct mw_batch *batch;
+  char *key;                  /**< from cache_key */
+  char *query;
+  GList *waiters;             /**< struct mw_search */
+};
+
+
+static void search_free(struct mw_search *search);
+
+
+/** the search went unanswered, so fail it */
+static void search_timeout(struct mwTimer *timer, gpointer data) {
+  struct mw_search *search = data;
+  struct mwServiceResolve *srvc = search->service;
+  gpointer key = GUINT_TO_POINTER(search->id);
+
+  // `timer` unused
+  (void)timer;
+
+  /* out of the table first, in case the handler cancels it */
+  g_hash_table_steal(srvc->searches, key);
+  search->handler(srvc, search->id, CONNECTION_TIMED, NULL, search->data);
+  search_free(search);
+}
+
+
+static guint32 next_id(struct mwServiceResolve *srvc) {
+  guint32 id;
+
+  /* we want search IDs that aren't SEARCH_ERROR */
+  do {
+    id = srvc->counter++;
+  } while(id == SEARCH_ERROR);
+
+  return id;
+}
+
+
 static struct mw_search *search_new(struct mwServiceResolve *srvc,
 				    mwResolveHandler handler,
 				    gpointer data, GDestroyNotify cleanup) {
@@ -66,25 +152,68 @@ static struct mw_search *search_new(struct mwServiceResolve *srvc,
   search->service = srvc;
   search->handler = handler;
 
-  /* we want search IDs that aren't SEARCH_ERROR */
-  do {
-    search->id = srvc->counter++;
-  } while(search->id == SEARCH_ERROR);
-
+  search->id = next_id(srvc);
   search->data = data;
   search->cleanup = cleanup;
 
+  mwTimer_init(&search->timer, search_timeout, search);
+
   return search;
 }
 
 
+/** take a batch out of whichever table holds it, freeing it */
+static void batch_drop(struct mwServiceResolve *srvc,
+		       struct mw_batch *batch) {
+
+  GHashTable *t = batch->sent? srvc->batches: srvc->open;
+  gpointer key = batch->sent?
+    GUINT_TO_POINTER(batch->id): GUINT_TO_POINTER(batch->flags);
+
+  /* a batch being answered or failed has already been stolen */
+  if(g_hash_table_lookup(t, key) == batch)
+    g_hash_table_remove(t, key);
+}
+
+
+/** stop a search waiting on a batched query. A query nobody is
+    waiting on is no longer pending, and a batch nobody is waiting on
+    is dropped */
+static void search_unbatch(struct mw_search *search) {
+  struct mwServiceResolve *srvc = search->service;
+  struct batch_slot *slot = search->slot;
+  struct mw_batch *batch = slot->batch;
+
+  search->slot = NULL;
+  slot->waiters = g_list_remove(slot->waiters, search);
+
+  if(! slot->waiters &&
+     g_hash_table_lookup(srvc->pending, slot->key) == slot) {
+    g_hash_table_remove(srvc->pending, slot->key);
+  }
+
+  if(! --batch->waiters)
+    batch_drop(srvc, batch);
+}
+
+
 /** called whenever a mw_search is removed from the searches table of
     the service */
 static void search_free(struct mw_search *search) {
   g_return_if_fail(search != NULL);
 
+  mwTimer_cancel(&search->timer);
+
+  if(search->slot)
+    search_unbatch(search);
+
   if(search->cleanup)
     search->cleanup(search->data);
+
+  while(search->queries) {
+    g_free(search->queries->data);
+    search->queries = g_list_delete_link(search->queries, search->queries);
+  }
   
   g_free(search);
 }
@@ -165,6 +294,13 @@ static void clear(struct mwServiceResolve *srvc) {
     g_hash_table_destroy(srvc->searches);
     srvc->searches = NULL;
   }
+
+  /* the pending table goes last, as freeing a batch updates it */
+  g_hash_table_destroy(srvc->open);
+  g_hash_table_destroy(srvc->batches);
+  g_hash_table_destroy(srvc->pending);
+
+  mwServiceResolve_setCache(srvc, 0, 0);
 }
 
 
@@ -220,84 +356,608 @@ static void recv_destroy(struct mwServiceResolve *srvc,
 }
 
 
-static GList *load_matches(struct mwGetBuffer *b, guint32 count) {
-  GList *matches = NULL;
+/** what it takes to hold the results of a response */
+struct results_size {
+  guint results;
+  guint matches;
+  gsize strings;  /**< string bytes, including terminators */
+};
 
-  while(count--) {
-    struct mwResolveMatch *m = g_new0(struct mwResolveMatch, 1);
 
-    mwString_get(b, &m->id);
-    mwString_get(b, &m->name);
-    mwString_get(b, &m->desc);
-    guint32_get(b, &m->type);
- 
-    matches = g_list_append(matches, m);
+/** skip a string, adding up the space needed to keep it */
+static gboolean measure_string(struct mwGetBuffer *b, gsize *total) {
+  guint16 len = 0;
+
+  guint16_get(b, &len);
+  if(mwGetBuffer_error(b)) return FALSE;
+
+  if(len) {
+    if(mwGetBuffer_advance(b, len) != len) return FALSE;
+    *total += len + 1;
   }
 
-  return matches;
+  return TRUE;
 }
 
 
-static GList *load_results(struct mwGetBuffer *b, guint32 count) {
-  GList *results = NULL;
+static gboolean measure_results(struct mwGetBuffer *b, guint32 count,
+				struct results_size *size) {
 
   while(count--) {
-    struct mwResolveResult *r = g_new0(struct mwResolveResult, 1);
-    guint32 junk, matches;
+    guint32 junk, matches = 0;
 
     guint32_get(b, &junk);
-    guint32_get(b, &r->code);
-    mwString_get(b, &r->name);
-
+    guint32_get(b, &junk);
+    if(! measure_string(b, &size->strings)) return FALSE;
     guint32_get(b, &matches);
-    r->matches = load_matches(b, matches);
 
-    results = g_list_append(results, r);
+    size->results++;
+
+    while(matches--) {
+      if(! measure_string(b, &size->strings) ||
+	 ! measure_string(b, &size->strings) ||
+	 ! measure_string(b, &size->strings)) return FALSE;
+
+      guint32_get(b, &junk);
+      if(mwGetBuffer_error(b)) return FALSE;
+
+      size->matches++;
+    }
   }
 
-  return results;
+  return ! mwGetBuffer_error(b);
 }
 
 
-static void free_matches(GList *matches) {
-  for(; matches; matches = g_list_delete_link(matches, matches)) {
-    struct mwResolveMatch *m = matches->data;
-    g_free(m->id);
-    g_free(m->name);
-    g_free(m->desc);
-    g_free(m);
+/** read a string into space already set aside for it at *str */
+static char *arena_string(struct mwGetBuffer *b, char **str) {
+  guint16 len = 0;
+  char *s = *str;
+
+  guint16_get(b, &len);
+  if(! len) return NULL;
+
+  mwGetBuffer_read(b, s, len);
+  s[len] = '\0';
+  *str += len + 1;
+
+  return s;
+}
+
+
+/** link count list nodes over the elements of an array */
+static GList *arena_list(GList *nodes, gpointer array, gsize elem,
+			 guint count) {
+  guint i;
+
+  for(i = 0; i < count; i++) {
+    nodes[i].data = (guchar *) array + (i * elem);
+    nodes[i].prev = i? &nodes[i - 1]: NULL;
+    nodes[i].next = (i + 1 < count)? &nodes[i + 1]: NULL;
   }
+
+  return count? nodes: NULL;
 }
 
 
+/** Parse the results of a response. Everything, down to the list
+    nodes and strings, is carved out of a single block measured by a
+    first pass over the response. The block starts with the list's
+    first node, so is freed by free_results.
+
+    @returns FALSE if the response is malformed */
+static gboolean load_results(struct mwGetBuffer *b, guint32 count,
+			     GList **list) {
+
+  struct results_size size = { 0, 0, 0 };
+  gsize start = mwGetBuffer_remaining(b);
+  GList *r_nodes, *m_nodes;
+  struct mwResolveResult *results;
+  struct mwResolveMatch *matches;
+  guchar *block;
+  char *str;
+  guint i;
+
+  *list = NULL;
+
+  if(! measure_results(b, count, &size)) return FALSE;
+  if(! size.results) return TRUE;
+
+  /* back to where the results start */
+  mwGetBuffer_reset(b);
+  mwGetBuffer_advance(b, mwGetBuffer_remaining(b) - start);
+
+  block = g_malloc(size.results * (sizeof(GList) + sizeof(*results)) +
+		   size.matches * (sizeof(GList) + sizeof(*matches)) +
+		   size.strings);
+
+  r_nodes = (GList *) block;
+  results = (struct mwResolveResult *) (r_nodes + size.results);
+  m_nodes = (GList *) (results + size.results);
+  matches = (struct mwResolveMatch *) (m_nodes + size.matches);
+  str = (char *) (matches + size.matches);
+
+  for(i = 0; i < size.results; i++) {
+    struct mwResolveResult *r = results + i;
+    guint32 junk, j;
+
+    guint32_get(b, &junk);
+    guint32_get(b, &r->code);
+    r->name = arena_string(b, &str);
+    guint32_get(b, &r->match_count);
+
+    r->match_array = matches;
+    r->matches = arena_list(m_nodes, matches, sizeof(*matches),
+			    r->match_count);
+
+    for(j = 0; j < r->match_count; j++) {
+      struct mwResolveMatch *m = matches + j;
+
+      m->id = arena_string(b, &str);
+      m->name = arena_string(b, &str);
+      m->desc = arena_string(b, &str);
+      guint32_get(b, &m->type);
+    }
+
+    matches += r->match_count;
+    m_nodes += r->match_count;
+  }
+
+  *list = arena_list(r_nodes, results, sizeof(*results), size.results);
+  return TRUE;
+}
+
+
+/** free the list from load_results */
 static void free_results(GList *results) {
-  for(; results; results = g_list_delete_link(results, results)) {
+  g_free(results);
+}
+
+
+static gsize copy_len(const char *s) {
+  return s? strlen(s) + 1: 0;
+}
+
+
+/** copy a string into space already set aside for it at *str */
+static char *copy_string(const char *s, char **str) {
+  gsize len = copy_len(s);
+  char *c = *str;
+
+  if(! len) return NULL;
+
+  memcpy(c, s, len);
+  *str += len;
+  return c;
+}
+
+
+/** copy a result into a single block, starting with the result
+    itself, so that it's freed with g_free */
+static struct mwResolveResult *result_copy(struct mwResolveResult *r) {
+  struct mwResolveResult *c;
+  struct mwResolveMatch *m;
+  GList *nodes;
+  gsize len = 0;
+  char *str;
+  guint i;
+
+  len += copy_len(r->name);
+  for(i = 0; i < r->match_count; i++) {
+    len += copy_len(r->match_array[i].id);
+    len += copy_len(r->match_array[i].name);
+    len += copy_len(r->match_array[i].desc);
+  }
+
+  c = g_malloc(sizeof(*c) + r->match_count * (sizeof(GList) + sizeof(*m)) +
+	       len);
+  nodes = (GList *) (c + 1);
+  m = (struct mwResolveMatch *) (nodes + r->match_count);
+  str = (char *) (m + r->match_count);
+
+  c->code = r->code;
+  c->name = copy_string(r->name, &str);
+  c->match_count = r->match_count;
+  c->match_array = m;
+  c->matches = arena_list(nodes, m, sizeof(*m), r->match_count);
+
+  for(i = 0; i < r->match_count; i++) {
+    m[i].id = copy_string(r->match_array[i].id, &str);
+    m[i].name = copy_string(r->match_array[i].name, &str);
+    m[i].desc = copy_string(r->match_array[i].desc, &str);
+    m[i].type = r->match_array[i].type;
+  }
+
+  return c;
+}
+
+
+/** free a list of results from result_copy */
+static void free_copies(GList *results) {
+  for(; results; results = g_list_delete_link(results, results))
+    g_free(results->data);
+}
+
+
+static char *cache_key(const char *query, guint32 flags) {
+  return g_strdup_printf("%x:%s", flags, query);
+}
+
+
+static void cache_entry_free(struct cache_entry *e) {
+  g_free(e->key);
+  g_free(e->result);
+  g_free(e);
+}
+
+
+static void cache_remove(struct mwServiceResolve *srvc,
+			 struct cache_entry *e) {
+
+  g_queue_unlink(&srvc->cache_lru, &e->link);
+  g_hash_table_remove(srvc->cache, e->key);
+}
+
+
+/** find an unexpired result for the query, and mark it as recently
+    used */
+static struct mwResolveResult *cache_lookup(struct mwServiceResolve *srvc,
+					    const char *query, guint32 flags) {
+
+  struct cache_entry *e;
+  char *key;
+
+  key = cache_key(query, flags);
+  e = g_hash_table_lookup(srvc->cache, key);
+  g_free(key);
+
+  if(! e) return NULL;
+
+  if(e->expires && e->expires <= g_get_monotonic_time()) {
+    srvc->cache_stats.expired++;
+    cache_remove(srvc, e);
+    return NULL;
+  }
+
+  g_queue_unlink(&srvc->cache_lru, &e->link);
+  g_queue_push_head_link(&srvc->cache_lru, &e->link);
+
+  return e->result;
+}
+
+
+static void cache_insert(struct mwServiceResolve *srvc,
+			 const char *query, guint32 flags,
+			 struct mwResolveResult *result) {
+
+  struct cache_entry *e, *old;
+
+  /* a partial result may come out differently next time */
+  if(result->code == mwResolveCode_PARTIAL) return;
+
+  e = g_new0(struct cache_entry, 1);
+  e->key = cache_key(query, flags);
+  e->result = result_copy(result);
+  e->link.data = e;
+
+  if(srvc->cache_ttl)
+    e->expires = g_get_monotonic_time() + (gint64) srvc->cache_ttl * 1000000;
+
+  /* drop any older answer to the same query */
+  old = g_hash_table_lookup(srvc->cache, e->key);
+  if(old) cache_remove(srvc, old);
+
+  g_hash_table_insert(srvc->cache, e->key, e);
+  g_queue_push_head_link(&srvc->cache_lru, &e->link);
+
+  while(srvc->cache_lru.length > srvc->cache_size) {
+    srvc->cache_stats.evicted++;
+    cache_remove(srvc, srvc->cache_lru.tail->data);
+  }
+}
+
+
+/** cache the results of a search, which arrive in the same order as
+    the queries they answer */
+static void cache_results(struct mwServiceResolve *srvc,
+			  struct mw_search *search, GList *results) {
+
+  GList *q = search->queries;
+
+  if(g_list_length(q) != g_list_length(results)) return;
+
+  for(; q; q = q->next, results = results->next)
+    cache_insert(srvc, q->data, search->flags, results->data);
+}
+
+
+/** answer a request from the cache, if every query is in it.
+
+    @returns TRUE if the handler was called */
+static gboolean cache_answer(struct mwServiceResolve *srvc,
+			     struct mw_search *search,
+			     GList *queries, guint32 flags) {
+
+  GList *results = NULL;
+  guint32 code = 0;
+  gboolean first = TRUE;
+
+  for(; queries; queries = queries->next) {
+    struct mwResolveResult *r = cache_lookup(srvc, queries->data, flags);
+
+    if(! r) {
+      srvc->cache_stats.misses++;
+      free_copies(results);
+      return FALSE;
+    }
+
+    /* a mix of result codes makes for a partial success overall */
+    if(first) {
+      code = r->code;
+      first = FALSE;
+    } else if(code != r->code) {
+      code = mwResolveCode_PARTIAL;
+    }
+
+    results = g_list_prepend(results, result_copy(r));
+  }
+
+  srvc->cache_stats.hits++;
+
+  results = g_list_reverse(results);
+  search->handler(srvc, search->id, code, results, search->data);
+  free_copies(results);
+
+  return TRUE;
+}
+
+
+static void batch_free(struct mw_batch *batch) {
+  struct mwServiceResolve *srvc = batch->service;
+
+  mwTimer_cancel(&batch->timer);
+
+  while(batch->slots) {
+    struct batch_slot *slot = batch->slots->data;
+    GList *l;
+
+    for(l = slot->waiters; l; l = l->next) {
+      struct mw_search *search = l->data;
+      search->slot = NULL;
+    }
+    g_list_free(slot->waiters);
+
+    if(g_hash_table_lookup(srvc->pending, slot->key) == slot)
+      g_hash_table_remove(srvc->pending, slot->key);
+
+    g_free(slot->key);
+    g_free(slot->query);
+    g_free(slot);
+
+    batch->slots = g_list_delete_link(batch->slots, batch->slots);
+  }
+
+  g_free(batch);
+}
+
+
+/** call the handler of every search waiting on a slot */
+static void slot_answer(struct mwServiceResolve *srvc,
+			struct batch_slot *slot,
+			guint32 code, GList *results) {
+
+  struct mw_search *search;
+
+  while(slot->waiters) {
+    search = slot->waiters->data;
+
+    g_hash_table_steal(srvc->searches, GUINT_TO_POINTER(search->id));
+    search->handler(srvc, search->id, code, results, search->data);
+    search_free(search);
+  }
+}
+
+
+/** fail every search waiting on a batch which has already been taken
+    out of its table, and free it */
+static void batch_fail(struct mwServiceResolve *srvc,
+		       struct mw_batch *batch, guint32 code) {
+  GList *l;
+
+  for(l = batch->slots; l; l = l->next)
+    slot_answer(srvc, l->data, code, NULL);
+
+  batch_free(batch);
+}
+
+
+/** answer the searches waiting on a batch, which has already been
+    taken out of the batches table, and free it */
+static void batch_answer(struct mwServiceResolve *srvc,
+			 struct mw_batch *batch, GList *results) {
+  GList *l;
+
+  /* the results are in the order the queries were sent */
+  if(g_list_length(results) != batch->count) {
+    g_warning("resolve batch 0x%x: %u queries, %u results",
+	      batch->id, batch->count, g_list_length(results));
+    batch_fail(srvc, batch, ERR_FAILURE);
+    return;
+  }
+
+  for(l = batch->slots; l; l = l->next, results = results->next) {
+    struct batch_slot *slot = l->data;
     struct mwResolveResult *r = results->data;
-    g_free(r->name);
-    free_matches(r->matches);
-    g_free(r);
+    GList single = { r, NULL, NULL };
+
+    if(srvc->cache)
+      cache_insert(srvc, slot->query, batch->flags, r);
+
+    slot_answer(srvc, slot, r->code, &single);
   }
+
+  batch_free(batch);
 }
 
 
-static void recv(struct mwServiceResolve *srvc,
-		 struct mwChannel *chan,
-		 guint16 type, struct mwOpaque *data) {
+/** send a batch, moving it from the open table to the batches table.
+    If that fails, the batch is left out of both for the caller to
+    fail */
+static int batch_send(struct mwServiceResolve *srvc,
+		      struct mw_batch *batch) {
+
+  struct mwPutBuffer *b;
+  struct mwOpaque o = { 0, 0 };
+  GList *l;
+  int ret;
+
+  mwTimer_cancel(&batch->timer);
+  g_hash_table_steal(srvc->open, GUINT_TO_POINTER(batch->flags));
+
+  b = mwPutBuffer_new();
+  guint32_put(b, 0x00);
+  guint32_put(b, batch->id);
+  guint32_put(b, batch->count);
+  for(l = batch->slots; l; l = l->next) {
+    struct batch_slot *slot = l->data;
+    mwString_put(b, slot->query);
+  }
+  guint32_put(b, batch->flags);
+
+  mwPutBuffer_finalize(&o, b);
+  ret = mwChannel_send(srvc->channel, RESOLVE_ACTION, &o);
+  mwOpaque_clear(&o);
+
+  if(! ret) {
+    batch->sent = TRUE;
+    g_hash_table_insert(srvc->batches, GUINT_TO_POINTER(batch->id), batch);
+  }
+
+  return ret;
+}
+
+
+static void batch_timeout(struct mwTimer *timer, gpointer data) {
+  struct mw_batch *batch = data;
+
+  // `timer` unused
+  (void)timer;
+
+  if(batch_send(batch->service, batch))
+    batch_fail(batch->service, batch, ERR_FAILURE);
+}
+
+
+static struct mw_batch *batch_new(struct mwServiceResolve *srvc,
+				  guint32 flags) {
+
+  struct mw_batch *batch = g_new0(struct mw_batch, 1);
+  struct mwSession *session = mwService_getSession(MW_SERVICE(srvc));
+  struct mwTimerWheel *wheel = mwSession_getTimerWheel(session);
+
+  batch->service = srvc;
+  batch->id = next_id(srvc);
+  batch->flags = flags;
+
+  mwTimer_init(&batch->timer, batch_timeout, batch);
+  if(wheel) mwTimer_schedule(&batch->timer, wheel, srvc->coalesce_msec);
+
+  g_hash_table_insert(srvc->open, GUINT_TO_POINTER(flags), batch);
+
+  return batch;
+}
+
+
+/** add a search to the searches table, and start its timeout */
+static void search_track(struct mwServiceResolve *srvc,
+			 struct mw_search *search) {
+
+  struct mwSession *session = mwService_getSession(MW_SERVICE(srvc));
+  struct mwTimerWheel *wheel = mwSession_getTimerWheel(session);
+
+  g_hash_table_insert(srvc->searches, GUINT_TO_POINTER(search->id), search);
+
+  if(wheel && srvc->timeout)
+    mwTimer_schedule(&search->timer, wheel, srvc->timeout);
+}
+
+
+/** add a single-query search to the batch for its flags, or to the
+    batch already asking the same question.
+
+    @returns non-zero if the batch had to be sent at once and that
+    failed, in which case the search has been taken out of the batch
+    and freed without calling its handler */
+static int search_batch(struct mwServiceResolve *srvc,
+			struct mw_search *search,
+			const char *query, guint32 flags) {
+
+  struct mwSession *session = mwService_getSession(MW_SERVICE(srvc));
+  struct batch_slot *slot;
+  struct mw_batch *batch;
+  char *key;
+
+  key = cache_key(query, flags);
+  slot = g_hash_table_lookup(srvc->pending, key);
+
+  if(slot) {
+    g_free(key);
+
+  } else {
+    batch = g_hash_table_lookup(srvc->open, GUINT_TO_POINTER(flags));
+    if(! batch) batch = batch_new(srvc, flags);
+
+    slot = g_new0(struct batch_slot, 1);
+    slot->batch = batch;
+    slot->key = key;
+    slot->query = g_strdup(query);
+
+    batch->slots = g_list_prepend(batch->slots, slot);
+    batch->count++;
+
+    g_hash_table_insert(srvc->pending, key, slot);
+  }
+
+  batch = slot->batch;
+  slot->waiters = g_list_prepend(slot->waiters, search);
+  batch->waiters++;
+  search->slot = slot;
+
+  /* without a timer wheel, there's no waiting for others to join */
+  if(batch->sent || (batch->count < srvc->coalesce_max &&
+		      mwSession_getTimerWheel(session))) {
+    return 0;
+  }
+
+  if(! batch_send(srvc, batch)) return 0;
+
+  /* the caller hears of this search's failure from the return value,
+     and the others waiting on the batch from their handlers */
+  g_hash_table_steal(srvc->searches, GUINT_TO_POINTER(search->id));
+  search_free(search);
+  batch_fail(srvc, batch, ERR_FAILURE);
+
+  return -1;
+}
+
+
+static void recv_ACTION(struct mwServiceResolve *srvc,
+			struct mwChannel *chan,
+			guint16 type, struct mwOpaque *data) {
 
   struct mwGetBuffer *b;
   guint32 junk, id, code, count;
   struct mw_search *search;
+  struct mw_batch *batch;
+
+  // `type` unused
+  (void)type;
 
   g_return_if_fail(srvc != NULL);
   g_return_if_fail(chan != NULL);
   g_return_if_fail(chan == srvc->channel);
   g_return_if_fail(data != NULL);
 
-  if(type != RESOLVE_ACTION) {
-    mw_mailme_opaque(data, "unknown message in resolve service: 0x%04x", type);
-    return;
-  }
-
   b = mwGetBuffer_wrap(data);
   guint32_get(b, &junk);
   guint32_get(b, &id);
@@ -311,12 +971,30 @@ static void recv(struct mwServiceResolve *srvc,
   }
   
   search = g_hash_table_lookup(srvc->searches, GUINT_TO_POINTER(id));
+  batch = g_hash_table_lookup(srvc->batches, GUINT_TO_POINTER(id));
 
-  if(search) {
-    GList *results = load_results(b, count);
-    if(mwGetBuffer_error(b)) {
+  if(batch) {
+    GList *results;
+    gboolean ok = load_results(b, count, &results);
+
+    g_hash_table_steal(srvc->batches, GUINT_TO_POINTER(id));
+
+    if(! ok) {
       g_warning("error parsing search results");
+      batch_fail(srvc, batch, ERR_FAILURE);
     } else {
+      batch_answer(srvc, batch, results);
+    }
+    free_results(results);
+
+  } else if(search) {
+    GList *results;
+    if(! load_results(b, count, &results)) {
+      g_warning("error parsing search results");
+    } else {
+      if(srvc->cache && search->queries)
+	cache_results(srvc, search, results);
+
       g_debug("triggering handler");
       search->handler(srvc, id, code, results, search->data);
     }
@@ -331,6 +1009,23 @@ static void recv(struct mwServiceResolve *srvc,
 }
 
 
+static const struct mwServiceHandler handlers[] = {
+  { RESOLVE_ACTION,  (mwService_funcRecv) recv_ACTION },
+};
+
+
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *srvc, struct mwChannel *chan,
+		 guint16 type, struct mwOpaque *data) {
+
+  // `srvc` `chan` unused
+  (void)srvc;
+  (void)chan;
+
+  mw_mailme_opaque(data, "unknown message in resolve service: 0x%04x", type);
+}
+
+
 struct mwServiceResolve *mwServiceResolve_new(struct mwSession *session) {
   struct mwServiceResolve *srvc_resolve;
   struct mwService *srvc;
@@ -347,11 +1042,20 @@ struct mwServiceResolve *mwServiceResolve_new(struct mwSession *session) {
   srvc->recv_create = (mwService_funcRecvCreate) recv_create;
   srvc->recv_accept = (mwService_funcRecvAccept) recv_accept;
   srvc->recv_destroy = (mwService_funcRecvDestroy) recv_destroy;
-  srvc->recv = (mwService_funcRecv) recv;
+  srvc->recv = recv;
   srvc->start = (mwService_funcStart) start;
   srvc->stop = (mwService_funcStop) stop;
   srvc->clear = (mwService_funcClear) clear;
 
+  srvc_resolve->open = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					     NULL, (GDestroyNotify) batch_free);
+  srvc_resolve->batches = g_hash_table_new_full(g_direct_hash,
+						g_direct_equal, NULL,
+						(GDestroyNotify) batch_free);
+  srvc_resolve->pending = g_hash_table_new(g_str_hash, g_str_equal);
+
+  mwService_setHandlers(srvc, handlers, G_N_ELEMENTS(handlers));
+
   return srvc_resolve;
 }
 
@@ -374,6 +1078,33 @@ guint32 mwServiceResolve_resolve(struct mwServiceResolve *srvc,
 
   search = search_new(srvc, handler, data, cleanup);
 
+  if(srvc->cache && cache_answer(srvc, search, queries, flags)) {
+    guint32 id = search->id;
+    search_free(search);
+    return id;
+  }
+
+  if(! srvc->channel || ! srvc->searches) {
+    search_free(search);
+    return SEARCH_ERROR;
+  }
+
+  if(count == 1 && srvc->coalesce_max > 1) {
+    guint32 id = search->id;
+    search_track(srvc, search);
+    return search_batch(srvc, search, queries->data, flags)?
+      SEARCH_ERROR: id;
+  }
+
+  if(srvc->cache) {
+    search->flags = flags;
+    for(; queries; queries = queries->next)
+      search->queries = g_list_prepend(search->queries,
+				       g_strdup(queries->data));
+    search->queries = g_list_reverse(search->queries);
+    queries = search->queries;
+  }
+
   b = mwPutBuffer_new();
   guint32_put(b, 0x00); /* to be overwritten */
   guint32_put(b, search->id);
@@ -390,8 +1121,7 @@ guint32 mwServiceResolve_resolve(struct mwServiceResolve *srvc,
     return SEARCH_ERROR;
 
   } else {
-    g_hash_table_insert(srvc->searches,
-			GUINT_TO_POINTER(search->id), search);
+    search_track(srvc, search);
     return search->id;
   }
 }
@@ -406,3 +1136,98 @@ void mwServiceResolve_cancelResolve(struct mwServiceResolve *srvc,
   g_hash_table_remove(srvc->searches, GUINT_TO_POINTER(id));
 }
 
+
+void mwServiceResolve_setTimeout(struct mwServiceResolve *srvc,
+				 guint msec) {
+  g_return_if_fail(srvc != NULL);
+  srvc->timeout = msec;
+}
+
+
+guint mwServiceResolve_getTimeout(struct mwServiceResolve *srvc) {
+  g_return_val_if_fail(srvc != NULL, 0);
+  return srvc->timeout;
+}
+
+
+void mwServiceResolve_setCache(struct mwServiceResolve *srvc,
+			       guint size, guint ttl) {
+
+  g_return_if_fail(srvc != NULL);
+
+  srvc->cache_size = size;
+  srvc->cache_ttl = ttl;
+
+  if(! size) {
+    if(srvc->cache) {
+      mwServiceResolve_clearCache(srvc);
+      g_hash_table_destroy(srvc->cache);
+      srvc->cache = NULL;
+    }
+    return;
+  }
+
+  if(! srvc->cache) {
+    srvc->cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+					(GDestroyNotify) cache_entry_free);
+  }
+
+  while(srvc->cache_lru.length > size) {
+    srvc->cache_stats.evicted++;
+    cache_remove(srvc, srvc->cache_lru.tail->data);
+  }
+}
+
+
+void mwServiceResolve_clearCache(struct mwServiceResolve *srvc) {
+  g_return_if_fail(srvc != NULL);
+
+  while(srvc->cache_lru.head)
+    cache_remove(srvc, srvc->cache_lru.head->data);
+}
+
+
+void mwServiceResolve_getCacheStats(struct mwServiceResolve *srvc,
+				    struct mwResolveCacheStats *stats) {
+
+  g_return_if_fail(srvc != NULL);
+  g_return_if_fail(stats != NULL);
+
+  *stats = srvc->cache_stats;
+  stats->entries = srvc->cache_lru.length;
+}
+
+
+void mwServiceResolve_setCoalesce(struct mwServiceResolve *srvc,
+				  guint msec, guint max) {
+
+  GHashTableIter iter;
+  gpointer v;
+
+  g_return_if_fail(srvc != NULL);
+
+  srvc->coalesce_msec = msec;
+  srvc->coalesce_max = max;
+
+  if(max > 1) return;
+
+  /* send whatever has been gathered so far */
+  while(g_hash_table_size(srvc->open)) {
+    g_hash_table_iter_init(&iter, srvc->open);
+    g_hash_table_iter_next(&iter, NULL, &v);
+    if(batch_send(srvc, v)) batch_fail(srvc, v, ERR_FAILURE);
+  }
+}
+
+
+guint mwResolveResult_getMatchCount(const struct mwResolveResult *r) {
+  g_return_val_if_fail(r != NULL, 0);
+  return r->match_count;
+}
+
+
+struct mwResolveMatch *
+mwResolveResult_getMatch(const struct mwResolveResult *r, guint n) {
+  g_return_val_if_fail(r != NULL, NULL);
+  return (n < r->match_count)? r->match_array + n: NULL;
+}
@@ -27,6 +27,7 @@
 #include "mw_service.h"
 #include "mw_session.h"
 #include "mw_srvc_store.h"
+#include "mw_timer.h"
 
 
 #define PROTOCOL_TYPE  0x00000025
@@ -59,6 +60,9 @@ struct mwStorageReq {
   mwStorageCallback cb;        /**< callback to notify upon completion */
   gpointer data;               /**< user data to pass with callback */
   GDestroyNotify data_free;    /**< optionally frees user data */
+
+  struct mwServiceStorage *service;  /**< owning service */
+  struct mwTimer timer;        /**< pending if there's a timeout */
 };
 
 
@@ -73,6 +77,9 @@ struct mwServiceStorage {
 
   /** keep track of the counter */
   guint32 id_counter;
+
+  /** milliseconds a request may take, or zero for no limit */
+  guint timeout;
 };
 
 
@@ -177,6 +184,8 @@ static void request_trigger(struct mwServiceStorage *srvc,
 
 
 static void request_free(struct mwStorageReq *req) {
+  mwTimer_cancel(&req->timer);
+
   if(req->data_free) {
     req->data_free(req->data);
     req->data = NULL;
@@ -196,6 +205,19 @@ static void request_remove(struct mwServiceStorage *srvc,
 }
 
 
+static void request_timeout(struct mwTimer *timer, gpointer data) {
+  struct mwStorageReq *req = data;
+  struct mwServiceStorage *srvc = req->service;
+
+  // `timer` unused
+  (void)timer;
+
+  req->result_code = CONNECTION_TIMED;
+  request_trigger(srvc, req);
+  request_remove(srvc, req);
+}
+
+
 static const char *get_name(struct mwService *srvc) {
 
   // `srvc` unused
@@ -344,8 +366,8 @@ static void recv_channelDestroy(struct mwService *srvc,
 }
 
 
-static void recv(struct mwService *srvc, struct mwChannel *chan,
-		 guint16 type, struct mwOpaque *data) {
+static void recv_reply(struct mwService *srvc, struct mwChannel *chan,
+		       guint16 type, struct mwOpaque *data) {
 
   /* process into results, trigger callbacks */
 
@@ -387,6 +409,25 @@ static void recv(struct mwService *srvc, struct mwChannel *chan,
 }
 
 
+static const struct mwServiceHandler handlers[] = {
+  { action_loaded,  recv_reply },
+  { action_saved,   recv_reply },
+};
+
+
+/** only sees those message types missing from the handlers table */
+static void recv(struct mwService *srvc, struct mwChannel *chan,
+		 guint16 type, struct mwOpaque *data) {
+
+  // `srvc` `chan` unused
+  (void)srvc;
+  (void)chan;
+
+  mw_mailme_opaque(data, "unknown message in storage service: 0x%04x",
+		   type);
+}
+
+
 static void clear(struct mwService *srvc) {
   struct mwServiceStorage *srvc_stor;
   GList *l;
@@ -420,6 +461,8 @@ struct mwServiceStorage *mwServiceStorage_new(struct mwSession *session) {
   srvc->stop = stop;
   srvc->clear = clear;
 
+  mwService_setHandlers(srvc, handlers, G_N_ELEMENTS(handlers));
+
   return srvc_store;
 }
 
@@ -556,17 +599,37 @@ static struct mwStorageReq *request_new(struct mwServiceStorage *srvc,
 					gpointer data, GDestroyNotify df) {
 
   struct mwStorageReq *req = g_new0(struct mwStorageReq, 1);
+  struct mwSession *session = mwService_getSession(MW_SERVICE(srvc));
+  struct mwTimerWheel *wheel = mwSession_getTimerWheel(session);
 
   req->id = ++srvc->id_counter;
   req->item = item;
   req->cb = cb;
   req->data = data;
   req->data_free = df;
+  req->service = srvc;
+
+  mwTimer_init(&req->timer, request_timeout, req);
+  if(wheel && srvc->timeout)
+    mwTimer_schedule(&req->timer, wheel, srvc->timeout);
 
   return req;
 }
 
 
+void mwServiceStorage_setTimeout(struct mwServiceStorage *srvc,
+				 guint msec) {
+  g_return_if_fail(srvc != NULL);
+  srvc->timeout = msec;
+}
+
+
+guint mwServiceStorage_getTimeout(struct mwServiceStorage *srvc) {
+  g_return_val_if_fail(srvc != NULL, 0);
+  return srvc->timeout;
+}
+
+
 void mwServiceStorage_load(struct mwServiceStorage *srvc,
 			   struct mwStorageUnit *item,
 			   mwStorageCallback cb,
@@ -0,0 +1,268 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "mw_timer.h"
+
+
+/** each level of the wheel has this many slots, as a power of two */
+#define WHEEL_BITS    6
+#define WHEEL_SIZE    (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SIZE - 1)
+
+
+/** count of levels. Each level's slots span WHEEL_SIZE times as long
+    as the level below, so the wheel covers 2^24 ms, over four hours.
+    Timers due later still wait in the top level, and are placed again
+    each time it turns */
+#define WHEEL_LEVELS  4
+
+
+#define WHEEL_SPAN    (G_GUINT64_CONSTANT(1) << (WHEEL_BITS * WHEEL_LEVELS))
+
+
+struct mwTimerWheel {
+  gint64 epoch;     /**< g_get_monotonic_time at creation */
+  guint64 now;      /**< the next tick to be run */
+
+  guint count[WHEEL_LEVELS];  /**< pending timers in each level */
+  struct mwTimer *slots[WHEEL_LEVELS][WHEEL_SIZE];
+};
+
+
+static guint64 wheel_clock(struct mwTimerWheel *w) {
+  return (g_get_monotonic_time() - w->epoch) / 1000;
+}
+
+
+static void timer_unlink(struct mwTimer *t) {
+  *t->pprev = t->next;
+  if(t->next) t->next->pprev = t->pprev;
+
+  t->wheel->count[t->level]--;
+
+  t->next = NULL;
+  t->pprev = NULL;
+  t->wheel = NULL;
+}
+
+
+/** put a timer in the slot for its expiry, relative to the wheel's
+    present tick */
+static void timer_place(struct mwTimerWheel *w, struct mwTimer *t) {
+  guint64 when = t->expires;
+  guint64 delta;
+  struct mwTimer **slot;
+  guint level = 0;
+
+  if(when < w->now) when = w->now;
+
+  delta = when - w->now;
+  if(delta >= WHEEL_SPAN) {
+    delta = WHEEL_SPAN - 1;
+    when = w->now + delta;
+  }
+
+  while(level < WHEEL_LEVELS - 1 &&
+	delta >= (G_GUINT64_CONSTANT(1) << (WHEEL_BITS * (level + 1)))) {
+    level++;
+  }
+
+  slot = &w->slots[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+  t->wheel = w;
+  t->level = level;
+  t->next = *slot;
+  t->pprev = slot;
+  if(*slot) (*slot)->pprev = &t->next;
+  *slot = t;
+
+  w->count[level]++;
+}
+
+
+/** move every timer in a slot of an upper level down to where it now
+    belongs */
+static void wheel_cascade(struct mwTimerWheel *w, guint level, guint idx) {
+  struct mwTimer *t;
+
+  while( (t = w->slots[level][idx]) ) {
+    timer_unlink(t);
+    timer_place(w, t);
+  }
+}
+
+
+/** run the present tick, and advance the wheel past it */
+static void wheel_tick(struct mwTimerWheel *w) {
+  guint64 tick = w->now;
+  struct mwTimer *pending, *t;
+  guint level;
+
+  /* each time a level comes round to its first slot, the next level
+     up turns by one, and that slot's timers are brought down */
+  for(level = 1; level < WHEEL_LEVELS; level++) {
+    guint idx = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    if(tick & ((G_GUINT64_CONSTANT(1) << (WHEEL_BITS * level)) - 1)) break;
+    wheel_cascade(w, level, idx);
+  }
+
+  /* take the due timers out of the wheel before calling any, so that
+     rescheduling from a call can't land back in this slot */
+  pending = w->slots[0][tick & WHEEL_MASK];
+  w->slots[0][tick & WHEEL_MASK] = NULL;
+  if(pending) pending->pprev = &pending;
+
+  w->now = tick + 1;
+
+  while( (t = pending) ) {
+    timer_unlink(t);
+    t->func(t, t->data);
+  }
+}
+
+
+struct mwTimerWheel *mwTimerWheel_new(void) {
+  struct mwTimerWheel *w = g_new0(struct mwTimerWheel, 1);
+  w->epoch = g_get_monotonic_time();
+  return w;
+}
+
+
+void mwTimerWheel_free(struct mwTimerWheel *w) {
+  guint level, idx;
+
+  g_return_if_fail(w != NULL);
+
+  for(level = 0; level < WHEEL_LEVELS; level++) {
+    for(idx = 0; idx < WHEEL_SIZE; idx++) {
+      struct mwTimer *t;
+      while( (t = w->slots[level][idx]) ) timer_unlink(t);
+    }
+  }
+
+  g_free(w);
+}
+
+
+guint64 mwTimerWheel_getTime(struct mwTimerWheel *w) {
+  g_return_val_if_fail(w != NULL, 0);
+  return w->now;
+}
+
+
+void mwTimerWheel_run(struct mwTimerWheel *w) {
+  guint64 target;
+
+  g_return_if_fail(w != NULL);
+
+  target = wheel_clock(w);
+
+  while(w->now <= target) {
+    guint level = 0;
+    guint64 step, next;
+
+    /* find the lowest level with anything in it. Until that level
+       next turns, the ticks in between have nothing to do */
+    while(level < WHEEL_LEVELS && ! w->count[level]) level++;
+
+    if(level == WHEEL_LEVELS) {
+      w->now = target + 1;
+      break;
+    }
+
+    if(level == 0) {
+      wheel_tick(w);
+      continue;
+    }
+
+    step = G_GUINT64_CONSTANT(1) << (WHEEL_BITS * level);
+    next = (w->now + step - 1) & ~(step - 1);
+
+    if(next == w->now) {
+      wheel_tick(w);
+    } else {
+      w->now = MIN(next, target + 1);
+    }
+  }
+}
+
+
+gint mwTimerWheel_getTimeout(struct mwTimerWheel *w) {
+  guint64 clock, due;
+  guint level, i;
+
+  g_return_val_if_fail(w != NULL, -1);
+
+  for(level = 0; level < WHEEL_LEVELS && ! w->count[level]; level++);
+  if(level == WHEEL_LEVELS) return -1;
+
+  if(level == 0) {
+    for(i = 0; i < WHEEL_SIZE; i++) {
+      if(w->slots[0][(w->now + i) & WHEEL_MASK]) break;
+    }
+    due = w->now + i;
+
+  } else {
+    guint64 step = G_GUINT64_CONSTANT(1) << (WHEEL_BITS * level);
+    due = (w->now + step - 1) & ~(step - 1);
+  }
+
+  clock = wheel_clock(w);
+  if(due <= clock) return 0;
+  return (gint) MIN(due - clock, G_MAXINT);
+}
+
+
+void mwTimer_init(struct mwTimer *t, mwTimer_func func, gpointer data) {
+  g_return_if_fail(t != NULL);
+
+  t->next = NULL;
+  t->pprev = NULL;
+  t->wheel = NULL;
+  t->expires = 0;
+  t->level = 0;
+  t->func = func;
+  t->data = data;
+}
+
+
+void mwTimer_schedule(struct mwTimer *t, struct mwTimerWheel *w,
+		      guint msec) {
+
+  g_return_if_fail(t != NULL);
+  g_return_if_fail(t->func != NULL);
+  g_return_if_fail(w != NULL);
+
+  if(t->pprev) timer_unlink(t);
+
+  t->expires = wheel_clock(w) + msec;
+  timer_place(w, t);
+}
+
+
+void mwTimer_cancel(struct mwTimer *t) {
+  g_return_if_fail(t != NULL);
+  if(t->pprev) timer_unlink(t);
+}
+
+
+gboolean mwTimer_isPending(struct mwTimer *t) {
+  g_return_val_if_fail(t != NULL, FALSE);
+  return t->pprev != NULL;
+}
@@ -0,0 +1,48 @@
+/*
+  Meanwhile - Unofficial Lotus Sametime Community Client Library
+  Copyright (C) 2004  Christopher (siege) O'Brien
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Library General Public
+  License as published by the Free Software Foundation; either
+  version 2 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Library General Public License for more details.
+
+  You should have received a copy of the GNU Library General Public
+  License along with this library; if not, write to the Free
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <time.h>
+
+#include "mw_debug.h"
+#include "mw_trace.h"
+
+
+const struct mwTraceHandler *mw_trace_handler = NULL;
+
+
+void mwTrace_setHandler(const struct mwTraceHandler *handler) {
+  mw_trace_handler = handler;
+}
+
+
+const struct mwTraceHandler *mwTrace_getHandler(void) {
+  return mw_trace_handler;
+}
+
+
+guint64 mwTrace_now(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if(! clock_gettime(CLOCK_MONOTONIC, &ts))
+    return (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+
+  return (guint64) g_get_monotonic_time() * 1000;
+}